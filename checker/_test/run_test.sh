@@ -199,8 +199,9 @@ test_common_alt()
 	fi
 }
 
-# Test 18.
-test_exec_failed()
+# Checks the output of the commands against the reference file, for what
+# bash does not do the same way.
+test_output_ref()
 {
 	init_test
 
@@ -213,6 +214,40 @@ test_exec_failed()
 	cleanup_test
 }
 
+# Test 18.
+test_exec_failed()
+{
+	test_output_ref
+}
+
+# Creates CGROUP_DIR, a cgroup v2 directory for the jobs of test 38, in
+# the cgroup of the checker; fails if there is none it can create.
+make_cgroup()
+{
+	local root
+
+	for root in /sys/fs/cgroup /sys/fs/cgroup/unified; do
+		[ "$(stat -f -c %T "$root" 2> /dev/null)" = "cgroup2fs" ] || continue
+		CGROUP_DIR="$root$(sed -n 's/^0:://p' /proc/self/cgroup)/mini-shell-$$"
+		mkdir "$CGROUP_DIR" 2> /dev/null && return 0
+	done
+
+	return 1
+}
+
+# Test 38.
+test_cgroup_report()
+{
+	if ! make_cgroup; then
+		skip_test
+		return
+	fi
+
+	export MINISHELL_TEST_CGROUP="$CGROUP_DIR"
+	test_output_ref
+	rmdir "$CGROUP_DIR"
+}
+
 
 test_fun_array=(								\
 	test_coding_style	"Sources check"				10	\
@@ -234,6 +269,27 @@ test_fun_array=(								\
 	test_common_alt		"Testing sleep command"			7	\
 	test_common_alt		"Testing fscanf function"		7	\
 	test_exec_failed	"Testing unknown command"		4	\
+	test_output_ref		"Testing timeouts"			0	\
+	test_common		"Testing command groups"		0	\
+	test_common		"Testing for and while loops"		0	\
+	test_common		"Testing functions"			0	\
+	test_common		"Testing command substitution"		0	\
+	test_common		"Testing process substitution"		0	\
+	test_common		"Testing here-documents"		0	\
+	test_common		"Testing pathname expansion"		0	\
+	test_output_ref		"Testing commands split in batches"	0	\
+	test_common		"Testing brace expansion"		0	\
+	test_common		"Testing field splitting"		0	\
+	test_common		"Testing parameter expansion"		0	\
+	test_common		"Testing arithmetic expansion"		0	\
+	test_common		"Testing the read builtin"		0	\
+	test_output_ref		"Testing jobs in cgroups"		0	\
+	test_output_ref		"Testing the ulimit builtin"		0	\
+	test_output_ref		"Testing process groups"		0	\
+	test_output_ref		"Testing set -o failfast"		0	\
+	test_output_ref		"Testing jobs and the terminal"		0	\
+	test_cgroup_report	"Testing the reports of cgroups"	0	\
+	test_output_ref		"Testing multi-line commands in scripts"	0	\
 )
 
 # ----------------- Run test ------------------------------------------------- #
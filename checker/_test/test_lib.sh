@@ -69,6 +69,11 @@ test_do_pass()
 	printf "passed  [%02d/%02d]\n" "$points" "$max_points"
 }
 
+test_do_skip()
+{
+	printf "skipped [ 0/%02d]\n" "$max_points"
+}
+
 
 DF=${DF:--BEbwu}
 
@@ -103,6 +108,18 @@ basic_test()
 	fi
 }
 
+# Reports a test that cannot run here.
+skip_test()
+{
+	printf "%02d) %s" "$test_index" "$description"
+
+	for ((i = 0; i < 56 - ${#description}; i++)); do
+		printf "."
+	done
+
+	test_do_skip
+}
+
 
 check_source()
 {
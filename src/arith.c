@@ -0,0 +1,731 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+#include "arith.h"
+#include "utils.h"
+
+/* how deep variables whose values are expressions may go */
+#define ARITH_MAX_DEPTH 32
+
+enum arith_operator {
+	ARITH_OP_NONE,
+	ARITH_OP_ADD, ARITH_OP_SUB, ARITH_OP_MUL, ARITH_OP_DIV, ARITH_OP_MOD, ARITH_OP_POW,
+	ARITH_OP_SHL, ARITH_OP_SHR, ARITH_OP_LT, ARITH_OP_LE, ARITH_OP_GT, ARITH_OP_GE, ARITH_OP_EQ, ARITH_OP_NE,
+	ARITH_OP_AND, ARITH_OP_XOR, ARITH_OP_OR, ARITH_OP_LOGICAL_AND, ARITH_OP_LOGICAL_OR,
+	ARITH_OP_NOT, ARITH_OP_COMPLEMENT, ARITH_OP_NEGATE, ARITH_OP_PLUS
+};
+
+enum operator_kind {
+	OPERATOR_BINARY,
+	OPERATOR_ASSIGN,	/* "=" (ARITH_OP_NONE) and "+=" and the like */
+	OPERATOR_OTHER		/* "(", "?", "++"... */
+};
+
+/* Longest first, so that the first match of the text is the token */
+static const struct operator {
+	const char *text;
+	enum operator_kind kind;
+	int precedence;		/* of a binary operator */
+	enum arith_operator op;
+} operators[] = {
+	{ "<<=", OPERATOR_ASSIGN, 0, ARITH_OP_SHL },
+	{ ">>=", OPERATOR_ASSIGN, 0, ARITH_OP_SHR },
+	{ "**", OPERATOR_BINARY, 11, ARITH_OP_POW },
+	{ "<<", OPERATOR_BINARY, 8, ARITH_OP_SHL },
+	{ ">>", OPERATOR_BINARY, 8, ARITH_OP_SHR },
+	{ "<=", OPERATOR_BINARY, 7, ARITH_OP_LE },
+	{ ">=", OPERATOR_BINARY, 7, ARITH_OP_GE },
+	{ "==", OPERATOR_BINARY, 6, ARITH_OP_EQ },
+	{ "!=", OPERATOR_BINARY, 6, ARITH_OP_NE },
+	{ "&&", OPERATOR_BINARY, 2, ARITH_OP_LOGICAL_AND },
+	{ "||", OPERATOR_BINARY, 1, ARITH_OP_LOGICAL_OR },
+	{ "+=", OPERATOR_ASSIGN, 0, ARITH_OP_ADD },
+	{ "-=", OPERATOR_ASSIGN, 0, ARITH_OP_SUB },
+	{ "*=", OPERATOR_ASSIGN, 0, ARITH_OP_MUL },
+	{ "/=", OPERATOR_ASSIGN, 0, ARITH_OP_DIV },
+	{ "%=", OPERATOR_ASSIGN, 0, ARITH_OP_MOD },
+	{ "&=", OPERATOR_ASSIGN, 0, ARITH_OP_AND },
+	{ "^=", OPERATOR_ASSIGN, 0, ARITH_OP_XOR },
+	{ "|=", OPERATOR_ASSIGN, 0, ARITH_OP_OR },
+	{ "++", OPERATOR_OTHER, 0, ARITH_OP_ADD },
+	{ "--", OPERATOR_OTHER, 0, ARITH_OP_SUB },
+	{ "*", OPERATOR_BINARY, 10, ARITH_OP_MUL },
+	{ "/", OPERATOR_BINARY, 10, ARITH_OP_DIV },
+	{ "%", OPERATOR_BINARY, 10, ARITH_OP_MOD },
+	{ "+", OPERATOR_BINARY, 9, ARITH_OP_ADD },
+	{ "-", OPERATOR_BINARY, 9, ARITH_OP_SUB },
+	{ "<", OPERATOR_BINARY, 7, ARITH_OP_LT },
+	{ ">", OPERATOR_BINARY, 7, ARITH_OP_GT },
+	{ "&", OPERATOR_BINARY, 5, ARITH_OP_AND },
+	{ "^", OPERATOR_BINARY, 4, ARITH_OP_XOR },
+	{ "|", OPERATOR_BINARY, 3, ARITH_OP_OR },
+	{ "=", OPERATOR_ASSIGN, 0, ARITH_OP_NONE },
+	{ "!", OPERATOR_OTHER, 0, ARITH_OP_NOT },
+	{ "~", OPERATOR_OTHER, 0, ARITH_OP_COMPLEMENT },
+	{ "?", OPERATOR_OTHER, 0, ARITH_OP_NONE },
+	{ ":", OPERATOR_OTHER, 0, ARITH_OP_NONE },
+	{ ",", OPERATOR_OTHER, 0, ARITH_OP_NONE },
+	{ "(", OPERATOR_OTHER, 0, ARITH_OP_NONE },
+	{ ")", OPERATOR_OTHER, 0, ARITH_OP_NONE },
+};
+
+/*
+ * The compiled form: a program for a stack machine, in which "&&", "||"
+ * and "?:" are jumps.
+ */
+enum arith_code {
+	ARITH_NUMBER,		/* push value */
+	ARITH_VARIABLE,		/* push the value of name */
+	ARITH_UNARY,		/* replace the top with op top */
+	ARITH_BINARY,		/* replace a and b on top with a op b */
+	ARITH_ASSIGN,		/* set name to the top (to name op top) */
+	ARITH_STEP,		/* add value to name, push the new one */
+	ARITH_STEP_AFTER,	/* the same, push the old one */
+	ARITH_JUMP_ZERO,	/* pop, and jump to value if it was 0 */
+	ARITH_JUMP,		/* jump to value */
+	ARITH_AND,		/* jump to value if the top is 0, pop it if not */
+	ARITH_OR,		/* jump to value with 1 if the top is not 0 */
+	ARITH_BOOL,		/* replace the top with 0 or 1 */
+	ARITH_POP
+};
+
+struct arith_op {
+	enum arith_code code;
+	enum arith_operator op;
+	long long value;
+	char *name;
+};
+
+struct arith {
+	struct arith_op *ops;
+	size_t count;
+	size_t size;
+};
+
+enum token_kind {
+	TOKEN_END,
+	TOKEN_NUMBER,
+	TOKEN_NAME,
+	TOKEN_OPERATOR,
+	TOKEN_ERROR
+};
+
+struct token {
+	enum token_kind kind;
+	const char *start;
+	size_t length;
+	long long number;
+	const struct operator *op;
+};
+
+struct compiler {
+	const char *p;
+	const char *end;
+	struct token token;	/* the next one, not consumed yet */
+	struct arith *a;
+	const char *error;
+};
+
+static void arith_free(struct arith *a)
+{
+	size_t i;
+
+	if (a == NULL)
+		return;
+	for (i = 0; i < a->count; i++)
+		free(a->ops[i].name);
+	free(a->ops);
+	free(a);
+}
+
+static size_t emit(struct compiler *c, enum arith_code code,
+		enum arith_operator op, long long value, const struct token *name)
+{
+	struct arith *a = c->a;
+	struct arith_op *o;
+
+	if (a->count == a->size) {
+		a->size = a->size == 0 ? 16 : 2 * a->size;
+		a->ops = realloc(a->ops, a->size * sizeof(*a->ops));
+		DIE(a->ops == NULL, "Error allocating expression.");
+	}
+
+	o = &a->ops[a->count];
+	o->code = code;
+	o->op = op;
+	o->value = value;
+	o->name = NULL;
+	if (name != NULL) {
+		o->name = strndup(name->start, name->length);
+		DIE(o->name == NULL, "Error allocating expression.");
+	}
+
+	return a->count++;
+}
+
+/**
+ * A number: decimal, hexadecimal after "0x", octal after a '0'.
+ */
+static bool scan_number(const char *p, const char *end, long long *value,
+		const char **stop)
+{
+	unsigned long long v = 0;
+	int base = 10, digit;
+
+	if (end - p > 2 && p[0] == '0' && (p[1] | 0x20) == 'x') {
+		base = 16;
+		p += 2;
+	} else if (p[0] == '0') {
+		base = 8;
+	}
+
+	for (; p < end && isalnum((unsigned char)*p); p++) {
+		digit = isdigit((unsigned char)*p) ? *p - '0' :
+			(*p | 0x20) - 'a' + 10;
+		if (digit >= base)
+			return false;
+		v = v * base + digit;
+	}
+
+	*value = (long long)v;
+	*stop = p;
+	return true;
+}
+
+static void next(struct compiler *c)
+{
+	struct token *t = &c->token;
+	const char *p = c->p;
+	size_t i, n;
+
+	while (p < c->end && isspace((unsigned char)*p))
+		p++;
+
+	t->start = p;
+	t->kind = TOKEN_ERROR;
+	if (p == c->end) {
+		t->kind = TOKEN_END;
+	} else if (isdigit((unsigned char)*p)) {
+		if (scan_number(p, c->end, &t->number, &p))
+			t->kind = TOKEN_NUMBER;
+	} else if (*p == '_' || isalpha((unsigned char)*p)) {
+		while (p < c->end && (*p == '_' || isalnum((unsigned char)*p)))
+			p++;
+		t->kind = TOKEN_NAME;
+	} else {
+		for (i = 0; i < sizeof(operators) / sizeof(*operators); i++) {
+			n = strlen(operators[i].text);
+			if ((size_t)(c->end - p) >= n &&
+			    memcmp(p, operators[i].text, n) == 0) {
+				t->kind = TOKEN_OPERATOR;
+				t->op = &operators[i];
+				p += n;
+				break;
+			}
+		}
+	}
+
+	t->length = p - t->start;
+	c->p = p;
+}
+
+static bool is_operator(const struct compiler *c, const char *text)
+{
+	return c->token.kind == TOKEN_OPERATOR &&
+		strcmp(c->token.op->text, text) == 0;
+}
+
+static bool fail(struct compiler *c, const char *error)
+{
+	if (c->error == NULL)
+		c->error = error;
+	return false;
+}
+
+static bool expect(struct compiler *c, const char *text)
+{
+	if (!is_operator(c, text))
+		return fail(c, c->token.kind == TOKEN_END ?
+				"unexpected end of expression" : "syntax error");
+	next(c);
+	return true;
+}
+
+static bool parse_comma(struct compiler *c);
+static bool parse_assign(struct compiler *c);
+
+static bool parse_primary(struct compiler *c)
+{
+	struct token name = c->token;
+
+	switch (c->token.kind) {
+	case TOKEN_NUMBER:
+		emit(c, ARITH_NUMBER, ARITH_OP_NONE, c->token.number, NULL);
+		next(c);
+		return true;
+
+	case TOKEN_NAME:
+		next(c);
+		if (is_operator(c, "++") || is_operator(c, "--")) {
+			emit(c, ARITH_STEP_AFTER, ARITH_OP_NONE,
+					c->token.op->op == ARITH_OP_ADD ? 1 : -1, &name);
+			next(c);
+		} else {
+			emit(c, ARITH_VARIABLE, ARITH_OP_NONE, 0, &name);
+		}
+		return true;
+
+	case TOKEN_OPERATOR:
+		if (!is_operator(c, "("))
+			break;
+		next(c);
+		return parse_comma(c) && expect(c, ")");
+
+	case TOKEN_END:
+		return fail(c, "unexpected end of expression");
+
+	default:
+		return fail(c, "invalid number");
+	}
+
+	return fail(c, "syntax error");
+}
+
+static bool parse_unary(struct compiler *c)
+{
+	enum arith_operator op;
+
+	if (is_operator(c, "++") || is_operator(c, "--")) {
+		op = c->token.op->op;
+		next(c);
+		if (c->token.kind != TOKEN_NAME)
+			return fail(c, "syntax error");
+		emit(c, ARITH_STEP, ARITH_OP_NONE, op == ARITH_OP_ADD ? 1 : -1, &c->token);
+		next(c);
+		return true;
+	}
+
+	if (is_operator(c, "!") || is_operator(c, "~") ||
+	    is_operator(c, "-") || is_operator(c, "+")) {
+		op = c->token.op->op;
+		op = op == ARITH_OP_SUB ? ARITH_OP_NEGATE : op == ARITH_OP_ADD ? ARITH_OP_PLUS : op;
+		next(c);
+		if (!parse_unary(c))
+			return false;
+		emit(c, ARITH_UNARY, op, 0, NULL);
+		return true;
+	}
+
+	return parse_primary(c);
+}
+
+/**
+ * The binary operators of precedence min and more, by precedence
+ * climbing; "**" is right associative.
+ */
+static bool parse_binary(struct compiler *c, int min)
+{
+	const struct operator *op;
+	size_t jump;
+
+	if (!parse_unary(c))
+		return false;
+
+	while (c->token.kind == TOKEN_OPERATOR &&
+	       c->token.op->kind == OPERATOR_BINARY &&
+	       c->token.op->precedence >= min) {
+		op = c->token.op;
+		next(c);
+
+		if (op->op == ARITH_OP_LOGICAL_AND || op->op == ARITH_OP_LOGICAL_OR) {
+			jump = emit(c, op->op == ARITH_OP_LOGICAL_AND ? ARITH_AND :
+					ARITH_OR, ARITH_OP_NONE, 0, NULL);
+			if (!parse_binary(c, op->precedence + 1))
+				return false;
+			emit(c, ARITH_BOOL, ARITH_OP_NONE, 0, NULL);
+			c->a->ops[jump].value = c->a->count;
+			continue;
+		}
+
+		if (!parse_binary(c, op->op == ARITH_OP_POW ? op->precedence :
+					op->precedence + 1))
+			return false;
+		emit(c, ARITH_BINARY, op->op, 0, NULL);
+	}
+
+	return true;
+}
+
+static bool parse_conditional(struct compiler *c)
+{
+	size_t otherwise, end;
+
+	if (!parse_binary(c, 1))
+		return false;
+	if (!is_operator(c, "?"))
+		return true;
+	next(c);
+
+	otherwise = emit(c, ARITH_JUMP_ZERO, ARITH_OP_NONE, 0, NULL);
+	if (!parse_comma(c) || !expect(c, ":"))
+		return false;
+	end = emit(c, ARITH_JUMP, ARITH_OP_NONE, 0, NULL);
+	c->a->ops[otherwise].value = c->a->count;
+	if (!parse_conditional(c))
+		return false;
+	c->a->ops[end].value = c->a->count;
+
+	return true;
+}
+
+static bool parse_assign(struct compiler *c)
+{
+	struct token name = c->token;
+	const char *p = c->p;
+	enum arith_operator op;
+
+	if (name.kind == TOKEN_NAME) {
+		next(c);
+		if (c->token.kind == TOKEN_OPERATOR &&
+		    c->token.op->kind == OPERATOR_ASSIGN) {
+			op = c->token.op->op;
+			next(c);
+			if (!parse_assign(c))
+				return false;
+			emit(c, ARITH_ASSIGN, op, 0, &name);
+			return true;
+		}
+
+		/* not an assignment: scan the name again */
+		c->p = p;
+		c->token = name;
+	}
+
+	return parse_conditional(c);
+}
+
+static bool parse_comma(struct compiler *c)
+{
+	if (!parse_assign(c))
+		return false;
+
+	while (is_operator(c, ",")) {
+		emit(c, ARITH_POP, ARITH_OP_NONE, 0, NULL);
+		next(c);
+		if (!parse_assign(c))
+			return false;
+	}
+
+	return true;
+}
+
+static struct arith *arith_compile(const char *text, size_t length,
+		const char **error)
+{
+	struct compiler c = { text, text + length, { 0 }, NULL, NULL };
+
+	c.a = calloc(1, sizeof(*c.a));
+	DIE(c.a == NULL, "Error allocating expression.");
+
+	next(&c);
+	if (c.token.kind == TOKEN_END)
+		emit(&c, ARITH_NUMBER, ARITH_OP_NONE, 0, NULL);
+	else if (parse_comma(&c) && c.token.kind != TOKEN_END)
+		fail(&c, "syntax error");
+
+	if (c.error != NULL) {
+		*error = c.error;
+		arith_free(c.a);
+		return NULL;
+	}
+
+	return c.a;
+}
+
+/*
+ * The parts of the parse trees that keep a compiled expression in their
+ * aux, see arith_release().
+ */
+static void ***arith_slots;
+static size_t arith_slot_count, arith_slot_size;
+
+static void arith_keep(void **slot, struct arith *a)
+{
+	if (arith_slot_count == arith_slot_size) {
+		arith_slot_size = arith_slot_size == 0 ? 16 : 2 * arith_slot_size;
+		arith_slots = realloc(arith_slots,
+				arith_slot_size * sizeof(*arith_slots));
+		DIE(arith_slots == NULL, "Error allocating expression.");
+	}
+
+	arith_slots[arith_slot_count++] = slot;
+	*slot = a;
+}
+
+void arith_release(void)
+{
+	size_t i;
+
+	for (i = 0; i < arith_slot_count; i++) {
+		arith_free(*arith_slots[i]);
+		*arith_slots[i] = NULL;
+	}
+	arith_slot_count = 0;
+}
+
+static bool arith_eval_depth(const char *text, size_t length,
+		long long *value, int depth, void **compiled);
+
+/**
+ * The value of a variable: a number, or an expression.
+ */
+static bool variable_value(const char *name, long long *value, int depth)
+{
+	const char *s = getenv(name), *end;
+	char *stop;
+
+	if (s == NULL)
+		s = "";
+	while (isspace((unsigned char)*s))
+		s++;
+	for (end = s + strlen(s); end > s && isspace((unsigned char)end[-1]); )
+		end--;
+
+	*value = 0;
+	if (s == end)
+		return true;
+
+	*value = strtoll(s, &stop, 0);
+	if (stop == end)
+		return true;
+
+	if (depth == ARITH_MAX_DEPTH) {
+		fprintf(stderr, "%s: expression recursion level exceeded\n",
+				name);
+		return false;
+	}
+	return arith_eval_depth(s, end - s, value, depth + 1, NULL);
+}
+
+static void variable_set(const char *name, long long value)
+{
+	char number[24];
+
+	snprintf(number, sizeof(number), "%lld", value);
+	setenv(name, number, 1);
+}
+
+/**
+ * a op b, in two's complement: the overflows wrap around.
+ */
+static bool binary(enum arith_operator op, long long a, long long b,
+		long long *result, const char **error)
+{
+	unsigned long long x = a, y = b, r = 1;
+
+	switch (op) {
+	case ARITH_OP_ADD:
+		*result = (long long)(x + y);
+		break;
+	case ARITH_OP_SUB:
+		*result = (long long)(x - y);
+		break;
+	case ARITH_OP_MUL:
+		*result = (long long)(x * y);
+		break;
+	case ARITH_OP_DIV:
+	case ARITH_OP_MOD:
+		if (b == 0) {
+			*error = "division by zero";
+			return false;
+		}
+		if (a == LLONG_MIN && b == -1)
+			*result = op == ARITH_OP_DIV ? LLONG_MIN : 0;
+		else
+			*result = op == ARITH_OP_DIV ? a / b : a % b;
+		break;
+	case ARITH_OP_POW:
+		if (b < 0) {
+			*error = "exponent less than 0";
+			return false;
+		}
+		for (; y != 0; y >>= 1, x *= x)
+			if (y & 1)
+				r *= x;
+		*result = (long long)r;
+		break;
+	case ARITH_OP_SHL:
+		*result = (long long)(x << (b & 63));
+		break;
+	case ARITH_OP_SHR:
+		*result = a >> (b & 63);
+		break;
+	case ARITH_OP_LT:
+		*result = a < b;
+		break;
+	case ARITH_OP_LE:
+		*result = a <= b;
+		break;
+	case ARITH_OP_GT:
+		*result = a > b;
+		break;
+	case ARITH_OP_GE:
+		*result = a >= b;
+		break;
+	case ARITH_OP_EQ:
+		*result = a == b;
+		break;
+	case ARITH_OP_NE:
+		*result = a != b;
+		break;
+	case ARITH_OP_AND:
+		*result = a & b;
+		break;
+	case ARITH_OP_XOR:
+		*result = a ^ b;
+		break;
+	case ARITH_OP_OR:
+		*result = a | b;
+		break;
+	default:
+		*result = b;
+		break;
+	}
+
+	return true;
+}
+
+static long long unary(enum arith_operator op, long long a)
+{
+	switch (op) {
+	case ARITH_OP_NOT:
+		return !a;
+	case ARITH_OP_COMPLEMENT:
+		return ~a;
+	case ARITH_OP_NEGATE:
+		return (long long)(0 - (unsigned long long)a);
+	default:
+		return a;
+	}
+}
+
+#define ARITH_STACK_SIZE 64
+
+static bool arith_run(const struct arith *a, long long *value,
+		const char **error, int depth)
+{
+	long long buffer[ARITH_STACK_SIZE], *stack = buffer, old;
+	const struct arith_op *o;
+	bool ok = true;
+	size_t i, top = 0;
+
+	/* no program pushes more than one value per op */
+	if (a->count > ARITH_STACK_SIZE) {
+		stack = malloc(a->count * sizeof(*stack));
+		DIE(stack == NULL, "Error allocating expression.");
+	}
+
+	for (i = 0; ok && i < a->count; i++) {
+		o = &a->ops[i];
+		switch (o->code) {
+		case ARITH_NUMBER:
+			stack[top++] = o->value;
+			break;
+		case ARITH_VARIABLE:
+			ok = variable_value(o->name, &stack[top++], depth);
+			break;
+		case ARITH_UNARY:
+			stack[top - 1] = unary(o->op, stack[top - 1]);
+			break;
+		case ARITH_BINARY:
+			top--;
+			ok = binary(o->op, stack[top - 1], stack[top],
+					&stack[top - 1], error);
+			break;
+		case ARITH_ASSIGN:
+			if (o->op != ARITH_OP_NONE) {
+				ok = variable_value(o->name, &old, depth) &&
+					binary(o->op, old, stack[top - 1],
+					       &stack[top - 1], error);
+			}
+			if (ok)
+				variable_set(o->name, stack[top - 1]);
+			break;
+		case ARITH_STEP:
+		case ARITH_STEP_AFTER:
+			ok = variable_value(o->name, &old, depth);
+			if (ok)
+				variable_set(o->name, old + o->value);
+			stack[top++] = o->code == ARITH_STEP ?
+				old + o->value : old;
+			break;
+		case ARITH_JUMP_ZERO:
+			if (stack[--top] == 0)
+				i = o->value - 1;
+			break;
+		case ARITH_JUMP:
+			i = o->value - 1;
+			break;
+		case ARITH_AND:
+			if (stack[top - 1] == 0)
+				i = o->value - 1;
+			else
+				top--;
+			break;
+		case ARITH_OR:
+			if (stack[top - 1] != 0) {
+				stack[top - 1] = 1;
+				i = o->value - 1;
+			} else {
+				top--;
+			}
+			break;
+		case ARITH_BOOL:
+			stack[top - 1] = stack[top - 1] != 0;
+			break;
+		case ARITH_POP:
+			top--;
+			break;
+		}
+	}
+
+	if (ok)
+		*value = stack[top - 1];
+	if (stack != buffer)
+		free(stack);
+
+	return ok;
+}
+
+static bool arith_eval_depth(const char *text, size_t length,
+		long long *value, int depth, void **compiled)
+{
+	const char *error = NULL;
+	struct arith *a = compiled != NULL ? *compiled : NULL;
+	bool ok;
+
+	if (a == NULL) {
+		a = arith_compile(text, length, &error);
+		if (a != NULL && compiled != NULL)
+			arith_keep(compiled, a);
+	}
+
+	ok = a != NULL && arith_run(a, value, &error, depth);
+	if (compiled == NULL)
+		arith_free(a);
+
+	if (!ok && error != NULL)
+		fprintf(stderr, "%.*s: %s\n", (int)length, text, error);
+	return ok;
+}
+
+bool arith_eval(const char *text, size_t length, long long *value,
+		void **compiled)
+{
+	return arith_eval_depth(text, length, value, 0, compiled);
+}
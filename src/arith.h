@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _ARITH_H
+#define _ARITH_H
+
+#include <stddef.h>
+
+#include "../util/parser/parser.h"
+
+/**
+ * Evaluate the arithmetic expression of "$((expression))", the length
+ * characters at text, in 64 bit integers: numbers (decimal, 0x hex, 0
+ * octal), variables (unset or empty is 0, another value is an expression
+ * itself), the C operators (assignments, "++" and "--" set the variables)
+ * and "**". With compiled (the aux of the word part of the expression),
+ * the expression is compiled once and kept there for the next times.
+ * Return false, with a message on stderr, if it is not valid or divides
+ * by zero.
+ */
+bool arith_eval(const char *text, size_t length, long long *value,
+		void **compiled);
+
+/**
+ * Free the compiled expressions kept in the parts of parse trees, and
+ * clear their aux: call it before freeing a tree that may have some.
+ */
+void arith_release(void);
+
+#endif /* _ARITH_H */
@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+#include "brace.h"
+#include "utils.h"
+
+static struct brace_segment *segment_add(struct brace_word *w,
+		enum brace_kind kind, const char *text, size_t length,
+		int flags)
+{
+	struct brace_segment *seg;
+
+	if (w->count == w->size) {
+		w->size = w->size == 0 ? 8 : 2 * w->size;
+		w->segments = realloc(w->segments,
+				w->size * sizeof(*w->segments));
+		DIE(w->segments == NULL, "Error allocating word.");
+	}
+
+	seg = &w->segments[w->count++];
+	memset(seg, 0, sizeof(*seg));
+	seg->kind = kind;
+	seg->quoted = flags & BRACE_QUOTED;
+	seg->split = flags & BRACE_SPLIT;
+	seg->text = seg->item = text;
+	seg->length = seg->item_length = length;
+
+	return seg;
+}
+
+/**
+ * A number of a range, with an optional sign; a leading zero pads all the
+ * numbers of the range to its width.
+ */
+static bool range_number(const char *s, size_t n, long *value, int *width)
+{
+	size_t i = 0, digits;
+	bool negative = false;
+	long v = 0;
+
+	if (i < n && (s[i] == '-' || s[i] == '+'))
+		negative = s[i++] == '-';
+	if (i == n || n > 20)
+		return false;
+
+	for (digits = i; i < n; i++) {
+		if (!isdigit((unsigned char)s[i]) || v > (LONG_MAX - 9) / 10)
+			return false;
+		v = 10 * v + s[i] - '0';
+	}
+
+	*value = negative ? -v : v;
+	*width = n - digits > 1 && s[digits] == '0' ? (int)n : 0;
+	return true;
+}
+
+static void range_item(struct brace_segment *seg)
+{
+	char *end = seg->number + sizeof(seg->number), *p = end;
+	unsigned long v;
+	int digits;
+
+	if (seg->letters) {
+		seg->number[0] = (char)seg->value;
+		seg->item = seg->number;
+		seg->item_length = 1;
+		return;
+	}
+
+	v = seg->value < 0 ? -(unsigned long)seg->value : seg->value;
+	do {
+		*--p = '0' + v % 10;
+		v /= 10;
+	} while (v != 0);
+
+	digits = seg->width - (seg->value < 0);
+	while (end - p < digits)
+		*--p = '0';
+	if (seg->value < 0)
+		*--p = '-';
+
+	seg->item = p;
+	seg->item_length = end - p;
+}
+
+/**
+ * Parse "first..last" or "first..last..step", where first and last are
+ * numbers, or both letters.
+ */
+static bool range_parse(struct brace_segment *seg, const char *s, size_t n)
+{
+	const char *last, *step;
+	size_t first_length, last_length;
+	int width, last_width;
+	long increment = 1;
+
+	step = memmem(s, n, "..", 2);
+	if (step == NULL)
+		return false;
+	first_length = step - s;
+	last = step + 2;
+
+	step = memmem(last, s + n - last, "..", 2);
+	last_length = (step != NULL ? step : s + n) - last;
+	if (step != NULL && !range_number(step + 2, s + n - step - 2,
+					  &increment, &width))
+		return false;
+
+	if (first_length == 1 && last_length == 1 &&
+	    isalpha((unsigned char)s[0]) && isalpha((unsigned char)last[0])) {
+		seg->letters = true;
+		seg->first = (unsigned char)s[0];
+		seg->last = (unsigned char)last[0];
+	} else if (range_number(s, first_length, &seg->first, &width) &&
+		   range_number(last, last_length, &seg->last, &last_width)) {
+		seg->width = width > last_width ? width : last_width;
+	} else {
+		return false;
+	}
+
+	if (increment == 0)
+		increment = 1;
+	seg->step = increment < 0 ? -increment : increment;
+	if (seg->first > seg->last)
+		seg->step = -seg->step;
+
+	return true;
+}
+
+static void segment_reset(struct brace_segment *seg)
+{
+	const char *comma;
+
+	if (seg->kind == BRACE_LIST) {
+		comma = memchr(seg->text, ',', seg->length);
+		seg->item = seg->text;
+		seg->item_length = comma - seg->text;
+	} else if (seg->kind == BRACE_RANGE) {
+		seg->value = seg->first;
+		range_item(seg);
+	}
+}
+
+static bool segment_next(struct brace_segment *seg)
+{
+	const char *end = seg->text + seg->length, *comma;
+
+	if (seg->kind == BRACE_LIST) {
+		if (seg->item + seg->item_length == end)
+			return false;
+		seg->item += seg->item_length + 1;
+		comma = memchr(seg->item, ',', end - seg->item);
+		seg->item_length = (comma != NULL ? comma : end) - seg->item;
+		return true;
+	}
+
+	if (seg->step > 0 ? seg->last - seg->value < seg->step :
+			    seg->value - seg->last < -seg->step)
+		return false;
+	seg->value += seg->step;
+	range_item(seg);
+	return true;
+}
+
+/**
+ * Parse the "{...}" from open to close as a group: a list or a range.
+ */
+static bool group_parse(struct brace_segment *group, const char *open,
+		const char *close)
+{
+	size_t length = close - open - 1;
+
+	memset(group, 0, sizeof(*group));
+	if (memchr(open + 1, '{', length) != NULL)
+		return false;
+
+	if (memchr(open + 1, ',', length) != NULL)
+		group->kind = BRACE_LIST;
+	else if (range_parse(group, open + 1, length))
+		group->kind = BRACE_RANGE;
+	else
+		return false;
+
+	group->text = open + 1;
+	group->length = length;
+	return true;
+}
+
+void brace_add(struct brace_word *w, const char *text, size_t length,
+		int flags)
+{
+	const char *end = text + length, *start = text, *p = text;
+	const char *open, *close;
+	struct brace_segment group;
+
+	while ((flags & BRACE_GROUPS) && (open = memchr(p, '{', end - p)) != NULL) {
+		close = memchr(open, '}', end - open);
+		if (close == NULL)
+			break;
+
+		p = open + 1;
+		if ((open > text && open[-1] == '\\') ||
+		    !group_parse(&group, open, close))
+			continue;
+
+		if (open > start)
+			segment_add(w, BRACE_TEXT, start, open - start, flags);
+		*segment_add(w, BRACE_TEXT, NULL, 0, 0) = group;
+		w->groups = true;
+		start = p = close + 1;
+	}
+
+	/* an empty quoted text still makes a word */
+	if (end > start || length == 0)
+		segment_add(w, BRACE_TEXT, start, end - start, flags);
+}
+
+void brace_start(struct brace_word *w)
+{
+	size_t i;
+
+	for (i = 0; i < w->count; i++)
+		segment_reset(&w->segments[i]);
+}
+
+bool brace_next(struct brace_word *w)
+{
+	struct brace_segment *seg;
+	size_t i = w->count;
+
+	while (i-- > 0) {
+		seg = &w->segments[i];
+		if (seg->kind == BRACE_TEXT)
+			continue;
+		if (segment_next(seg))
+			return true;
+		segment_reset(seg);
+	}
+
+	return false;
+}
+
+void brace_clear(struct brace_word *w)
+{
+	w->count = 0;
+	w->groups = false;
+}
+
+void brace_free(struct brace_word *w)
+{
+	free(w->segments);
+}
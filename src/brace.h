@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _BRACE_H
+#define _BRACE_H
+
+#include <stddef.h>
+#include "../util/parser/parser.h"
+
+enum brace_kind {
+	BRACE_TEXT,
+	BRACE_LIST,	/* "{a,b,c}" */
+	BRACE_RANGE	/* "{1..10}", "{a..e}", "{0..100..5}" */
+};
+
+/**
+ * A piece of a word: a text, or a brace group, of which the current item
+ * is item.
+ */
+struct brace_segment {
+	enum brace_kind kind;
+	bool quoted;
+	bool split;
+	const char *text;	/* a text, or the items of a list */
+	size_t length;
+	long first;		/* a range */
+	long last;
+	long step;
+	int width;		/* of its numbers, with leading zeros */
+	bool letters;
+	const char *item;
+	size_t item_length;
+	long value;
+	char number[24];
+};
+
+/**
+ * A word with brace groups, generated one word at a time: the groups are
+ * turned like an odometer, the last one fastest, and only the current
+ * item of each group exists. The texts are not copied; they must live as
+ * long as the word.
+ */
+struct brace_word {
+	struct brace_segment *segments;
+	size_t count;
+	size_t size;
+	bool groups;
+};
+
+#define BRACE_WORD_INIT { NULL, 0, 0, false }
+
+/* Flags of brace_add() */
+#define BRACE_QUOTED	0x01	/* the text was quoted */
+#define BRACE_GROUPS	0x02	/* its "{...}" are groups */
+#define BRACE_SPLIT	0x04	/* it is split into fields */
+
+/**
+ * Add a text to the word. The "{...}" that are not a list nor a range stay
+ * text, as "{}" does.
+ */
+void brace_add(struct brace_word *w, const char *text, size_t length,
+		int flags);
+
+/**
+ * Move to the first word, once the segments are added; then to the next
+ * one, false after the last one.
+ */
+void brace_start(struct brace_word *w);
+bool brace_next(struct brace_word *w);
+
+/**
+ * Empty the word, to add the segments of another one.
+ */
+void brace_clear(struct brace_word *w);
+void brace_free(struct brace_word *w);
+
+#endif /* _BRACE_H */
@@ -1,63 +1,434 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
+#define _GNU_SOURCE
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
 
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
+#include <ctype.h>
 
+#include "arith.h"
 #include "cmd.h"
 #include "utils.h"
+#include "param.h"
+#include "input.h"
+#include "job.h"
 
 #define READ		0
 #define WRITE		1
 
+/* Space kept free when argv is split in batches, see argv_room() */
+#define ARGV_MARGIN	2048
+
+/* Interned builtin names, see register_builtins() */
+static const char *builtin_cd;
+static const char *builtin_exit;
+static const char *builtin_quit;
+static const char *builtin_true;
+static const char *builtin_false;
+static const char *builtin_echo;
+static const char *builtin_pwd;
+static const char *builtin_read;
+static const char *builtin_ulimit;
+static const char *builtin_timeout;
+static const char *builtin_set;
+
+/* The options of set -o, see shell_set() */
+static bool option_failfast;
+
+static const struct shell_option {
+	const char *name;
+	bool *value;
+} shell_options[] = {
+	{ "failfast", &option_failfast },
+	{ NULL, NULL }
+};
+
+/* Builtins that only print, and so can also run in a child */
+typedef int (*builtin_fn)(char **argv);
+
+/* Shell functions, see define_function() */
+#define FUNCTION_BUCKETS	64
+
+struct function {
+	struct function *next;
+	command_t *body;	// copy of the parse tree, see parse_copy_tree()
+	command_t *retired;	// bodies replaced while running, linked by aux
+	int running;
+	char name[];
+};
+
+static struct function *functions[FUNCTION_BUCKETS];
+
+/*
+ * Running process substitutions, see run_process_substitution(); those
+ * from process_sub_first on belong to the command being expanded.
+ */
+struct process_substitution {
+	pid_t pid;
+	int fd;		// the shell's end of the pipe, passed as /dev/fd/N
+};
+
+static struct process_substitution *process_subs;
+static int process_sub_count, process_sub_size;
+static int process_sub_first;
+
+/**
+ * Register the builtin names with the parser, so the verb of a command can
+ * be matched by pointer instead of strcmp().
+ */
+void register_builtins(void)
+{
+	builtin_cd = parse_intern("cd");
+	builtin_exit = parse_intern("exit");
+	builtin_quit = parse_intern("quit");
+	builtin_true = parse_intern("true");
+	builtin_false = parse_intern("false");
+	builtin_echo = parse_intern("echo");
+	builtin_pwd = parse_intern("pwd");
+	builtin_read = parse_intern("read");
+	builtin_ulimit = parse_intern("ulimit");
+	builtin_timeout = parse_intern("timeout");
+	builtin_set = parse_intern("set");
+}
+
+/**
+ * Check if the verb of a simple command is the given (interned) builtin.
+ */
+static bool is_builtin(simple_command_t *s, const char *name)
+{
+	return !s->verb->expand && s->verb->string == name;
+}
+
+/**
+ * Terminate a child that runs part of a command line. exit() would make
+ * stdio seek a seekable stdin back to what the child consumed, so the
+ * shell would read the rest of its input again; only flush the output.
+ */
+static void exit_child(int status)
+{
+	fflush(stdout);
+	fflush(stderr);
+	_exit(status);
+}
+
 /**
  * Internal change-directory command.
  */
 static bool shell_cd(word_t *dir)
 {
+	char *path;
+	int res;
+
 	// sanity check
 	if (dir == NULL || dir->string == NULL)
 		return false;
 
-	if (chdir(dir->string) != 0)
+	path = get_word(dir);
+	res = chdir(path);
+	free(path);
+
+	return res == 0;
+}
+
+/**
+ * Print the escape sequence at *s (after the backslash) for echo -e;
+ * return false for \c, which ends the output.
+ */
+static bool echo_escape(const char **s)
+{
+	static const char names[] = "abefnrtv\\";
+	static const char values[] = "\a\b\033\f\n\r\t\v\\";
+	const char *p = *s, *name;
+	int value, digits;
+
+	name = *p != '\0' ? strchr(names, *p) : NULL;
+	if (name != NULL) {
+		putchar(values[name - names]);
+		*s = p + 1;
+		return true;
+	}
+
+	switch (*p++) {
+	case 'c':
 		return false;
+	case '0':
+		for (value = 0, digits = 0; digits < 3 && *p >= '0' && *p <= '7'; digits++)
+			value = value * 8 + *p++ - '0';
+		putchar(value);
+		break;
+	case 'x':
+		for (value = 0, digits = 0; digits < 2 && isxdigit((unsigned char)*p); digits++, p++)
+			value = value * 16 + (isdigit((unsigned char)*p) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+		if (digits == 0) {
+			// not an escape: print it as it is
+			fputs("\\x", stdout);
+			break;
+		}
+		putchar(value);
+		break;
+	default:
+		// not an escape (or a trailing backslash): print it as it is
+		putchar('\\');
+		p = *s;
+		break;
+	}
+
+	*s = p;
 	return true;
 }
 
+/**
+ * Internal echo command: -n (no newline), -e / -E (do / do not interpret
+ * backslash escapes), as the leading arguments.
+ */
+static int shell_echo(char **argv)
+{
+	bool newline = true, escapes = false;
+	const char *s, *o;
+	int i;
+
+	for (i = 1; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+		for (o = argv[i] + 1; *o == 'n' || *o == 'e' || *o == 'E'; o++)
+			;
+		if (*o != '\0')
+			break;
+
+		for (o = argv[i] + 1; *o != '\0'; o++) {
+			if (*o == 'n')
+				newline = false;
+			else
+				escapes = *o == 'e';
+		}
+	}
+
+	for (; argv[i] != NULL; i++) {
+		if (!escapes) {
+			fputs(argv[i], stdout);
+		} else {
+			for (s = argv[i]; *s != '\0'; ) {
+				if (*s != '\\') {
+					putchar(*s++);
+					continue;
+				}
+				s++;
+				if (!echo_escape(&s))
+					return true;
+			}
+		}
+
+		if (argv[i + 1] != NULL)
+			putchar(' ');
+	}
+
+	if (newline)
+		putchar('\n');
+	return true;
+}
+
+/**
+ * Internal pwd command.
+ */
+static int shell_pwd(char **argv)
+{
+	char cwd[PATH_MAX];
+
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+		return false;
+
+	puts(cwd);
+	return true;
+}
+
+/**
+ * The function of an output builtin (echo, pwd); NULL if s is not one.
+ */
+static builtin_fn find_builtin(simple_command_t *s)
+{
+	if (is_builtin(s, builtin_echo))
+		return shell_echo;
+	if (is_builtin(s, builtin_pwd))
+		return shell_pwd;
+
+	return NULL;
+}
+
 /**
  * Internal exit/quit command.
  */
 static int shell_exit(void)
 {
 	/* TODO: Execute exit/quit. */
-	exit(0);
+	// this may be a subshell or a substitution, see exit_child()
+	exit_child(0);
 	return SHELL_EXIT; /* TODO: Replace with actual exit code. */
 }
 
+/**
+ * Find a function by name; NULL if there is none.
+ */
+static struct function **function_slot(const char *name)
+{
+	struct function **f;
+	unsigned int hash = 2166136261u;
+	const char *p;
+
+	for (p = name; *p != '\0'; p++)
+		hash = (hash ^ (unsigned char)*p) * 16777619u;
+
+	f = &functions[hash % FUNCTION_BUCKETS];
+	while (*f != NULL && strcmp((*f)->name, name) != 0)
+		f = &(*f)->next;
+
+	return f;
+}
+
+static struct function *find_function(simple_command_t *s)
+{
+	if (s->verb->expand || s->verb->next_part != NULL)
+		return NULL;
+
+	return *function_slot(s->verb->string);
+}
+
+/**
+ * Define (or redefine) a function: its body is copied out of the parser's
+ * memory once, and each call runs that copy, without parsing it again.
+ */
+static bool define_function(command_t *c)
+{
+	const char *name = c->scmd->verb->string;
+	struct function **slot = function_slot(name);
+	struct function *f = *slot;
+	command_t *body = parse_copy_tree(c->cmd1);
+
+	if (f == NULL) {
+		f = calloc(1, sizeof(*f) + strlen(name) + 1);
+		DIE(f == NULL, "Error allocating function.");
+		strcpy(f->name, name);
+		*slot = f;
+	} else if (f->running != 0) {
+		// the old body is still running, free it when it returns
+		f->body->aux = f->retired;
+		f->retired = f->body;
+	} else {
+		arith_release();
+		free(f->body);
+	}
+
+	f->body = body;
+	return true;
+}
+
+/**
+ * The path of a redirection: the whole word, expanded; for cd, relative
+ * to the directory cd was called from.
+ */
+static void redirect_path(word_t *w, int execute_cd, char *cwd, char *path,
+		size_t size)
+{
+	char *word = get_word(w);
+
+	if (execute_cd && word[0] != '/')
+		snprintf(path, size, "%s/%s", cwd, word);
+	else
+		snprintf(path, size, "%s", word);
+	free(word);
+}
+
+/**
+ * Write all of buf, or die.
+ */
+static void write_all(int fd, const char *buf, size_t length)
+{
+	ssize_t n;
+
+	for (; length > 0; buf += n, length -= n) {
+		n = write(fd, buf, length);
+		DIE(n < 0, "write");
+	}
+}
+
+/**
+ * Make the text of a here-document or here-string stdin. Text that fits
+ * in the buffer of a pipe is written to one, which cannot block; larger
+ * text goes to a memfd, sealed so nobody can change it. Nothing is
+ * written to the filesystem.
+ */
+static void here_stdin(const char *text, size_t length)
+{
+	int fd[2];
+	int size;
+
+	DIE(pipe2(fd, O_CLOEXEC) < 0, "error on pipe");
+	size = fcntl(fd[WRITE], F_GETPIPE_SZ);
+	if (size > 0 && length <= (size_t)size) {
+		write_all(fd[WRITE], text, length);
+		close(fd[WRITE]);
+		dup2(fd[READ], STDIN_FILENO);
+		close(fd[READ]);
+		return;
+	}
+	close(fd[READ]);
+	close(fd[WRITE]);
+
+	fd[READ] = memfd_create("here-document", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	DIE(fd[READ] < 0, "memfd_create");
+	write_all(fd[READ], text, length);
+	fcntl(fd[READ], F_ADD_SEALS,
+		F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+	lseek(fd[READ], 0, SEEK_SET);
+	dup2(fd[READ], STDIN_FILENO);
+	close(fd[READ]);
+}
+
+/**
+ * The text of the here-document or here-string (the last word of in):
+ * a here-document is taken as is, a here-string is expanded and ends
+ * with a newline.
+ */
+static void redirect_here(simple_command_t *s)
+{
+	word_t *w = s->in;
+	char *text;
+	size_t length;
+
+	while (w->next_word != NULL)
+		w = w->next_word;
+
+	text = get_word(w);
+	length = strlen(text);
+	if (s->io_flags & IO_IN_HERESTRING) {
+		text = realloc(text, length + 2);
+		DIE(text == NULL, "Error allocating here-string.");
+		text[length++] = '\n';
+		text[length] = '\0';
+	}
+
+	here_stdin(text, length);
+	free(text);
+}
+
 /**
  * Perform redirections, for cd or for rest of commands
  */
 
 static void doRedirection(simple_command_t *s, int execute_cd, char *cwd)
 {
-	// < : redirection to stdin
-	if (s->in != NULL) {
+	// <<, <<< : here-document or here-string on stdin
+	if (s->in != NULL && (s->io_flags & IO_IN_HERE)) {
+		redirect_here(s);
+	} else if (s->in != NULL) { // < : redirection to stdin
 		int fd = -1;
 		char input_path[1026];
 
-		// if cd, path should be the path from where cd was called
-		if (execute_cd)
-			snprintf(input_path, sizeof(input_path), "%s/%s", cwd, s->in->string);
-		else
-			strcpy(input_path, s->in->string);
-
-		// if there are environment variables, expand them and add to path
-		if (s->in->next_part != NULL)
-			strcat(input_path, get_word(s->in->next_part));
+		redirect_path(s->in, execute_cd, cwd, input_path, sizeof(input_path));
 
 		fd = open(input_path, O_RDONLY);
 
@@ -71,21 +442,8 @@ static void doRedirection(simple_command_t *s, int execute_cd, char *cwd)
 		char output_path[1026];
 		char error_path[1026];
 
-		// if cd, path should be the path from where cd was called
-		if (execute_cd) {
-			snprintf(output_path, sizeof(output_path), "%s/%s", cwd, s->out->string);
-			snprintf(error_path, sizeof(error_path), "%s/%s", cwd, s->err->string);
-		} else {
-			strcpy(output_path, s->out->string);
-			strcpy(error_path, s->err->string);
-		}
-
-		// if there are any variables, expand them and add to paths
-		if (s->out->next_part != NULL)
-			strcat(output_path, get_word(s->out->next_part));
-
-		if (s->err->next_part != NULL)
-			strcat(error_path, get_word(s->err->next_part));
+		redirect_path(s->out, execute_cd, cwd, output_path, sizeof(output_path));
+		redirect_path(s->err, execute_cd, cwd, error_path, sizeof(error_path));
 
 
 		int f_out = open(output_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
@@ -105,18 +463,12 @@ static void doRedirection(simple_command_t *s, int execute_cd, char *cwd)
 			int fd = -1;
 			char output_path[1026];
 
-			if (execute_cd)
-				snprintf(output_path, sizeof(output_path), "%s/%s", cwd, s->out->string);
-			else
-				strcpy(output_path, s->out->string);
-
-			if (s->out->next_part != NULL)
-				strcat(output_path, get_word(s->out->next_part));
+			redirect_path(s->out, execute_cd, cwd, output_path, sizeof(output_path));
 
 
-			if (s->io_flags == IO_REGULAR) // no append
+			if (!(s->io_flags & IO_OUT_APPEND)) // no append
 				fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-			else if (s->io_flags == IO_OUT_APPEND) // append
+			else // append
 				fd = open(output_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
 
 
@@ -129,18 +481,12 @@ static void doRedirection(simple_command_t *s, int execute_cd, char *cwd)
 			int fd = -1;
 			char error_path[1026];
 
-			if (execute_cd)
-				snprintf(error_path, sizeof(error_path), "%s/%s", cwd, s->err->string);
-			else
-				strcpy(error_path, s->err->string);
-
-			if (s->err->next_part != NULL)
-				strcat(error_path, get_word(s->err->next_part));
+			redirect_path(s->err, execute_cd, cwd, error_path, sizeof(error_path));
 
 
-			if (s->io_flags == IO_REGULAR) // no append
+			if (!(s->io_flags & IO_ERR_APPEND)) // no append
 				fd = open(error_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-			else if (s->io_flags == IO_ERR_APPEND) // append
+			else // append
 				fd = open(error_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
 
 			DIE(fd < 0, "open");
@@ -151,11 +497,538 @@ static void doRedirection(simple_command_t *s, int execute_cd, char *cwd)
 }
 
 /**
- * Parse a simple command (internal, environment variable assignment,
- * external command).
+ * Do the redirections of a builtin that runs in the shell; saved keeps
+ * the shell's stdin, stdout and stderr for redirect_restore().
+ */
+static void redirect_save(simple_command_t *s, int saved[3])
+{
+	saved[STDIN_FILENO] = saved[STDOUT_FILENO] = saved[STDERR_FILENO] = -1;
+	if (s->in == NULL && s->out == NULL && s->err == NULL)
+		return;
+
+	saved[STDIN_FILENO] = dup(STDIN_FILENO);
+	saved[STDOUT_FILENO] = dup(STDOUT_FILENO);
+	saved[STDERR_FILENO] = dup(STDERR_FILENO);
+	doRedirection(s, false, NULL);
+}
+
+static void redirect_restore(int saved[3])
+{
+	int fd;
+
+	fflush(stdout);
+	for (fd = STDIN_FILENO; fd <= STDERR_FILENO; fd++) {
+		if (saved[fd] < 0)
+			continue;
+		dup2(saved[fd], fd);
+		close(saved[fd]);
+	}
+}
+
+/**
+ * Internal read command: read [-r] [name...]. It sets variables, so it
+ * runs in the shell, with its redirections; it reads no more of stdin
+ * than the line, see input_line().
  */
+static bool shell_read(simple_command_t *s)
+{
+	bool raw = false, result = false;
+	char **argv, **name;
+	int argc, saved[3];
+
+	argv = get_argv(s, &argc);
+	for (name = argv + 1; *name != NULL && strcmp(*name, "-r") == 0; name++)
+		raw = true;
+
+	for (argc = 0; name[argc] != NULL; argc++) {
+		if (!param_is_name(name[argc]) || name[argc][0] == '\0' ||
+		    isdigit((unsigned char)name[argc][0])) {
+			fprintf(stderr, "read: `%s': not a valid identifier\n",
+				name[argc]);
+			goto out;
+		}
+	}
+
+	redirect_save(s, saved);
+	result = input_read(name, raw);
+	redirect_restore(saved);
+
+out:
+	argv_free(argv);
+	return result;
+}
 
+/**
+ * Internal set command: "set -o name" turns an option on, "set +o name"
+ * turns it off, and "set -o" alone prints them all.
+ */
+static bool shell_set(simple_command_t *s)
+{
+	const struct shell_option *option;
+	bool result = false;
+	int argc, i, saved[3];
+	char **argv = get_argv(s, &argc);
+
+	if (argc == 2 && (strcmp(argv[1], "-o") == 0 ||
+			  strcmp(argv[1], "+o") == 0)) {
+		redirect_save(s, saved);
+		for (option = shell_options; option->name != NULL; option++)
+			printf("%-15s\t%s\n", option->name,
+			       *option->value ? "on" : "off");
+		redirect_restore(saved);
+		result = true;
+		goto out;
+	}
+
+	for (i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "-o") != 0 && strcmp(argv[i], "+o") != 0)
+			break;
+		for (option = shell_options; option->name != NULL; option++)
+			if (strcmp(option->name, argv[i + 1]) == 0)
+				break;
+		if (option->name == NULL) {
+			fprintf(stderr, "set: %s: invalid option name\n",
+				argv[i + 1]);
+			goto out;
+		}
+		*option->value = argv[i][0] == '-';
+	}
+
+	if (i != argc || argc == 1) {
+		fprintf(stderr, "Usage: set [-o|+o] [name]...\n");
+		goto out;
+	}
+	result = true;
+
+out:
+	argv_free(argv);
+	return result;
+}
+
+/**
+ * Call a function in the shell, with the redirections of the call.
+ */
+static int call_function(struct function *f, simple_command_t *s, int level)
+{
+	bool redirect = s->in != NULL || s->out != NULL || s->err != NULL;
+	int orig_stdout = -1, orig_stdin = -1, orig_stderr = -1;
+	command_t *retired;
+	int result;
+
+	if (redirect) {
+		orig_stdout = dup(STDOUT_FILENO);
+		orig_stdin = dup(STDIN_FILENO);
+		orig_stderr = dup(STDERR_FILENO);
+		doRedirection(s, false, NULL);
+	}
+
+	f->running++;
+	result = parse_command(f->body, level + 1, NULL);
+	f->running--;
+
+	if (f->running == 0 && f->retired != NULL)
+		arith_release();
+	while (f->running == 0 && f->retired != NULL) {
+		retired = f->retired;
+		f->retired = retired->aux;
+		free(retired);
+	}
+
+	if (redirect) {
+		// restore original file descriptors
+		dup2(orig_stdout, STDOUT_FILENO);
+		dup2(orig_stdin, STDIN_FILENO);
+		dup2(orig_stderr, STDERR_FILENO);
+
+		// close auxiliary file descriptors
+		close(orig_stdout);
+		close(orig_stdin);
+		close(orig_stderr);
+	}
+
+	return result;
+}
+
+/**
+ * Run an output builtin in the shell, without forking.
+ */
+static int run_builtin(builtin_fn builtin, simple_command_t *s)
+{
+	int argc, result;
+	char **argv = get_argv(s, &argc);
+
+	result = builtin(argv);
+	fflush(stdout);
+	argv_free(argv);
+
+	return result;
+}
+
+/**
+ * Start collecting the process substitutions of a command; returns what
+ * process_substitutions_end() needs to restore the outer command's.
+ */
+static int process_substitutions_begin(void)
+{
+	int outer = process_sub_first;
+
+	process_sub_first = process_sub_count;
+	return outer;
+}
+
+/**
+ * Let the program of the current command inherit the ends of its process
+ * substitutions, which are CLOEXEC until then, so no other child gets
+ * them.
+ */
+static void process_substitutions_inherit(void)
+{
+	int i;
+
+	for (i = process_sub_first; i < process_sub_count; i++)
+		fcntl(process_subs[i].fd, F_SETFD, 0);
+}
+
+/**
+ * The current command is done: close the shell's ends of its process
+ * substitutions (so a ">(command)" sees the end of its input) and wait
+ * for them.
+ */
+static void process_substitutions_end(int outer)
+{
+	int i;
+
+	for (i = process_sub_first; i < process_sub_count; i++)
+		close(process_subs[i].fd);
+	for (i = process_sub_first; i < process_sub_count; i++)
+		waitpid(process_subs[i].pid, NULL, 0);
+
+	process_sub_count = process_sub_first;
+	process_sub_first = outer;
+}
+
+char *run_process_substitution(command_t *c, bool write)
+{
+	int fd[2], shell_end, i;
+	char *path;
+	pid_t pid;
+
+	fflush(stdout);
+	DIE(pipe2(fd, O_CLOEXEC) < 0, "error on pipe");
+
+	pid = fork();
+	DIE(pid < 0, "fork");
+	if (pid == 0) { // child
+		// the other substitutions are not its own
+		for (i = 0; i < process_sub_count; i++)
+			close(process_subs[i].fd);
+		process_sub_count = process_sub_first = 0;
+
+		if (write)
+			dup2(fd[READ], STDIN_FILENO);
+		else
+			dup2(fd[WRITE], STDOUT_FILENO);
+		close(fd[READ]);
+		close(fd[WRITE]);
+
+		exit_child(parse_command(c, 0, NULL));
+	}
+
+	shell_end = write ? fd[WRITE] : fd[READ];
+	close(write ? fd[READ] : fd[WRITE]);
+
+	if (process_sub_count == process_sub_size) {
+		process_sub_size = process_sub_size == 0 ? 4 : 2 * process_sub_size;
+		process_subs = realloc(process_subs,
+				process_sub_size * sizeof(*process_subs));
+		DIE(process_subs == NULL, "Error allocating substitutions.");
+	}
+	process_subs[process_sub_count].pid = pid;
+	process_subs[process_sub_count].fd = shell_end;
+	process_sub_count++;
+
+	path = malloc(sizeof("/dev/fd/") + 10);
+	DIE(path == NULL, "Error allocating substitution.");
+	sprintf(path, "/dev/fd/%d", shell_end);
+
+	return path;
+}
+
+static int run_simple(simple_command_t *s, int level, command_t *father);
+
+/**
+ * Parse a simple command (internal, environment variable assignment,
+ * external command); the process substitutions in its words end with it.
+ */
 static int parse_simple(simple_command_t *s, int level, command_t *father)
+{
+	int outer = process_substitutions_begin();
+	int result = run_simple(s, level, father);
+
+	process_substitutions_end(outer);
+	return result;
+}
+
+/**
+ * Fork the child of a simple command, in its job: it does the
+ * redirections, then runs the builtin (if not NULL) or execs argv. Return
+ * its pid, -1 on error.
+ */
+static pid_t spawn_simple(simple_command_t *s, builtin_fn builtin, char **argv,
+		struct job *job)
+{
+	pid_t pid = job_fork(job);
+
+	if (pid != 0)
+		return pid;
+
+	// auxiliary file descriptors used for restoring, not for the program
+	int orig_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+	int orig_stdin = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+	int orig_stderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+
+	doRedirection(s, false, NULL); // perform redirections
+	process_substitutions_inherit();
+
+	if (job->limits != NULL && !limit_apply(job->limits))
+		exit_child(EXIT_FAILURE);
+
+	if (builtin != NULL)
+		exit_child(builtin(argv) == true ? EXIT_SUCCESS : EXIT_FAILURE);
+
+	// execute command
+	if (execvp(argv[0], argv) == -1) {
+		fprintf(stderr, "Execution failed for '%s'\n", argv[0]);
+		exit_child(EXIT_FAILURE);
+	}
+
+	// restore original file descriptors
+	dup2(orig_stdout, STDOUT_FILENO);
+	dup2(orig_stdin, STDIN_FILENO);
+	dup2(orig_stderr, STDERR_FILENO);
+
+	// close auxiliary file descriptors
+	close(orig_stdout);
+	close(orig_stdin);
+	close(orig_stderr);
+
+	return 0;
+}
+
+/**
+ * Wait for the child of a simple command; true unless it exited with 1,
+ * or its job timed out.
+ */
+static bool wait_simple(struct job *job, pid_t pid)
+{
+	int status;
+
+	job_wait(job, pid, &status);
+	if (WEXITSTATUS(status) == 1 || job_timed_out(job))
+		return false;
+	else
+		return true;
+}
+
+/**
+ * How many batches of a command too long for execve() may run at a time
+ * (MINISHELL_ARGV_BATCH=N); 0 if the command is not split.
+ */
+static int argv_batch_jobs(void)
+{
+	const char *env = getenv("MINISHELL_ARGV_BATCH");
+
+	if (env == NULL || atoi(env) <= 0)
+		return 0;
+	return atoi(env);
+}
+
+/**
+ * The space that argv[first] to argv[last - 1] take in execve(): the
+ * strings and the pointers to them.
+ */
+static size_t argv_size(char **argv, int first, int last)
+{
+	size_t size = 0;
+
+	for (; first < last; first++)
+		size += strlen(argv[first]) + 1 + sizeof(char *);
+
+	return size;
+}
+
+/**
+ * The space left for the arguments: ARG_MAX, less the environment and a
+ * margin, as xargs does.
+ */
+static size_t argv_room(void)
+{
+	size_t used = ARGV_MARGIN;
+	long max = sysconf(_SC_ARG_MAX);
+	char **env;
+
+	for (env = environ; *env != NULL; env++)
+		used += strlen(*env) + 1 + sizeof(char *);
+
+	return max > 0 && (size_t)max > used ? max - used : 0;
+}
+
+/**
+ * Run a command whose argv is too long for execve() as several commands,
+ * as xargs does: the arguments from expansions are split in batches that
+ * fit, and each batch is run with the arguments before and after them.
+ * Up to jobs batches run at a time; when all the slots are taken, the
+ * oldest batch is waited for. True if all of them succeed.
+ */
+static int run_batches(simple_command_t *s, char **argv, int argc,
+		struct argv_span *span, int jobs, struct job *job)
+{
+	int fixed_count = argc - (span->last - span->first);
+	size_t fixed = argv_size(argv, 0, span->first) +
+		argv_size(argv, span->last, argc);
+	size_t room = argv_room(), size;
+	int first, last, oldest = 0, running = 0;
+	bool result = true;
+	char **batch;
+	pid_t *pids;
+
+	batch = malloc((argc + 1) * sizeof(char *));
+	pids = malloc(jobs * sizeof(pid_t));
+	DIE(batch == NULL || pids == NULL, "Error allocating batches.");
+
+	// the arguments before the batch are the same for all of them
+	memcpy(batch, argv, span->first * sizeof(char *));
+
+	for (first = span->first; first < span->last; first = last) {
+		size = fixed;
+		for (last = first; last < span->last; last++) {
+			size += argv_size(argv, last, last + 1);
+			if (size > room && last > first)
+				break;
+		}
+
+		memcpy(batch + span->first, argv + first,
+				(last - first) * sizeof(char *));
+		memcpy(batch + span->first + last - first, argv + span->last,
+				(argc - span->last) * sizeof(char *));
+		batch[fixed_count + last - first] = NULL;
+
+		if (running == jobs) {
+			result &= wait_simple(job, pids[oldest]);
+			oldest = (oldest + 1) % jobs;
+			running--;
+		}
+
+		// the timeout of the command is over for the batches left too
+		if (job_timed_out(job)) {
+			result = false;
+			break;
+		}
+
+		pids[(oldest + running) % jobs] = spawn_simple(s, NULL, batch,
+				job);
+		if (pids[(oldest + running) % jobs] == -1) {
+			result = false;
+			break;
+		}
+		running++;
+	}
+
+	for (; running > 0; running--) {
+		result &= wait_simple(job, pids[oldest]);
+		oldest = (oldest + 1) % jobs;
+	}
+
+	free(batch);
+	free(pids);
+
+	return result;
+}
+
+/**
+ * Internal ulimit command: without a command, it sets (or prints) the
+ * limits of the shell, which its children inherit; "ulimit -t 60 -v
+ * 4194304 command" runs the command with these limits instead, applied
+ * in its child before it execs.
+ */
+static bool shell_ulimit(simple_command_t *s)
+{
+	struct limits limits;
+	bool result = false;
+	int argc, first, saved[3];
+	char **argv = get_argv(s, &argc);
+	struct job job;
+	pid_t pid;
+
+	first = limit_parse(argv, argc, &limits);
+	if (first < 0)
+		goto out;
+
+	if (first == argc) {
+		redirect_save(s, saved);
+		result = limit_apply(&limits);
+		if (result)
+			limit_print(&limits);
+		redirect_restore(saved);
+		goto out;
+	}
+
+	job_begin(&job);
+	job_limits(&job, &limits);
+	pid = spawn_simple(s, NULL, argv + first, &job);
+	result = pid != -1 && wait_simple(&job, pid);
+	job_end(&job, argv[first]);
+
+out:
+	argv_free(argv);
+	return result;
+}
+
+/**
+ * Internal timeout command: timeout [-k grace] duration command. The
+ * command is a job whose timeout is duration: it gets a SIGTERM when it
+ * expires, and a SIGKILL after the grace period (JOB_GRACE without -k,
+ * none with -k 0).
+ */
+static bool shell_timeout(simple_command_t *s)
+{
+	long long timeout, grace = JOB_GRACE;
+	bool result = false;
+	int argc, first = 1;
+	char **argv = get_argv(s, &argc);
+	struct job job;
+	pid_t pid;
+
+	if (argc > 2 && strcmp(argv[1], "-k") == 0) {
+		if (!job_parse_duration(argv[2], &grace)) {
+			fprintf(stderr, "timeout: %s: invalid duration\n",
+				argv[2]);
+			goto out;
+		}
+		first = 3;
+	}
+
+	if (first + 1 >= argc) {
+		fprintf(stderr, "Usage: timeout [-k grace] duration command\n");
+		goto out;
+	}
+	if (!job_parse_duration(argv[first], &timeout)) {
+		fprintf(stderr, "timeout: %s: invalid duration\n", argv[first]);
+		goto out;
+	}
+
+	job_begin(&job);
+	job_timeout(&job, timeout, grace);
+	pid = spawn_simple(s, NULL, argv + first + 1, &job);
+	result = pid != -1 && wait_simple(&job, pid);
+	job_end(&job, argv[first + 1]);
+
+out:
+	argv_free(argv);
+	return result;
+}
+
+static int run_simple(simple_command_t *s, int level, command_t *father)
 {
 	bool execute_cd = false;
 	int result = false;
@@ -166,18 +1039,17 @@ static int parse_simple(simple_command_t *s, int level, command_t *father)
 		return false;
 
 
-	// get current working directory
-	if (getcwd(cwd, sizeof(cwd)) == NULL)
-		return false;
-
-
 	/* TODO: If builtin command, execute the command. */
-	if (strcmp(s->verb->string, "cd") == 0) {
+	if (is_builtin(s, builtin_cd)) {
 
 		// there are no params or more than one
 		if (s->params == NULL || s->params->next_part != NULL)
 			return false;
 
+		// get current working directory, for the redirections
+		if (getcwd(cwd, sizeof(cwd)) == NULL)
+			return false;
+
 		execute_cd = true;
 		// auxiliary file descriptors used for restoring
 		int orig_stdout = dup(STDOUT_FILENO);
@@ -199,71 +1071,121 @@ static int parse_simple(simple_command_t *s, int level, command_t *father)
 		return shell_cd(s->params);
 	}
 
-	if (strcmp(s->verb->string, "exit") == 0 || strcmp(s->verb->string, "quit") == 0)
+	if (is_builtin(s, builtin_exit) || is_builtin(s, builtin_quit))
 		return shell_exit();
 
 
-	if (strcmp(s->verb->string, "false") == 0)
+	if (is_builtin(s, builtin_false))
 		return false;
 
 
-	if (strcmp(s->verb->string, "true") == 0)
+	if (is_builtin(s, builtin_true))
 		return true;
 
+	if (is_builtin(s, builtin_read))
+		return shell_read(s);
+
+	if (is_builtin(s, builtin_ulimit))
+		return shell_ulimit(s);
+
+	if (is_builtin(s, builtin_timeout))
+		return shell_timeout(s);
+
+	if (is_builtin(s, builtin_set))
+		return shell_set(s);
+
 	// check if is environment variable
 	if (s->verb->next_part != NULL) {
 		char *varvalue = get_word(s->verb->next_part->next_part); // get value
 
-		setenv(s->verb->string, varvalue, 1); // set variable
+		// "name=" has no value part: the value is empty
+		setenv(s->verb->string, varvalue != NULL ? varvalue : "", 1);
 		free(varvalue);
 		return true;
 	}
 
-	pid_t pid = fork();
+	struct function *f = find_function(s);
 
-	if (pid == -1)
-		return false;
-	else if (pid == 0) { // child
+	if (f != NULL)
+		return call_function(f, s, level);
 
-		// auxiliary file descriptors used for restoring
-		int orig_stdout = dup(STDOUT_FILENO);
-		int orig_stdin = dup(STDIN_FILENO);
-		int orig_stderr = dup(STDERR_FILENO);
+	builtin_fn builtin = find_builtin(s);
 
-		int argc;
-		char **argv = get_argv(s, &argc); // command arguments
+	// redirections are done in a child, as for other commands
+	if (builtin != NULL && s->in == NULL && s->out == NULL && s->err == NULL)
+		return run_builtin(builtin, s);
 
-		doRedirection(s, execute_cd, cwd); // perform redirections
+	// expanded in the shell, so it runs (and waits for) the substitutions
+	struct argv_span span;
+	int argc;
+	char **argv = get_argv_span(s, &argc, &span); // command arguments
+	int jobs = argv_batch_jobs();
+	struct job job;
 
-		// execute command
-		if (execvp(argv[0], argv) == -1)
-			exit(0);
+	// all the batches of a command are one job
+	job_begin(&job);
+	if (builtin == NULL && jobs > 0 && span.first != span.last &&
+	    argv_size(argv, 0, argc) > argv_room()) {
+		result = run_batches(s, argv, argc, &span, jobs, &job);
+	} else {
+		pid_t pid = spawn_simple(s, builtin, argv, &job);
 
-		for (int i = 0; i <= argc; ++i)
-			free(argv[i]);
-		free(argv);
+		result = pid != -1 && wait_simple(&job, pid);
+	}
 
-		// restore original file descriptors
-		dup2(orig_stdout, STDOUT_FILENO);
-		dup2(orig_stdin, STDIN_FILENO);
-		dup2(orig_stderr, STDERR_FILENO);
+	job_end(&job, argv[0]);
+	argv_free(argv);
 
-		// close auxiliary file descriptors
-		close(orig_stdout);
-		close(orig_stdin);
-		close(orig_stderr);
+	return result;
+}
 
-	} else {
-		int status;
+/**
+ * The name of a command in the report of its job: the verb of its first
+ * simple command.
+ */
+static const char *command_name(command_t *c)
+{
+	while (c->op != OP_NONE && c->cmd1 != NULL)
+		c = c->cmd1;
 
-		waitpid(pid, &status, 0);
-		if (WEXITSTATUS(status) == 1)
-			return false;
-		else
-			return true;
-	}
+	return c->scmd != NULL ? c->scmd->verb->string : "";
+}
+
+/**
+ * Whether a side of a parallel command failed: it exits with the result
+ * of parse_command(), false on failure, or was killed.
+ */
+static bool side_failed(int status)
+{
+	return !WIFEXITED(status) || WEXITSTATUS(status) == false;
+}
 
-	return result; /* TODO: Replace with actual exit status. */
+/**
+ * Wait for the sides of a parallel command with set -o failfast: as soon
+ * as one of them fails, the other is killed, by process group, and the
+ * command fails. A parallel command inside another job (another parallel
+ * command, a pipeline or a subshell) has no group of its own: only the
+ * process of the other side is killed then, not the rest of that job.
+ */
+static bool wait_fail_fast(command_t *cmd1, command_t *cmd2, struct job *job1,
+		struct job *job2, pid_t pid1, pid_t pid2)
+{
+	struct job *jobs[2] = { job1, job2 };
+	pid_t pids[2] = { pid1, pid2 };
+	int status, other;
+	bool failed;
+
+	other = job_wait_either(jobs, pids, &status) == pid1;
+	failed = side_failed(status);
+	if (failed)
+		job_cancel(jobs[other]);
+
+	job_wait(jobs[other], pids[other], &status);
+	failed |= side_failed(status);
+	job_end(job2, command_name(cmd2));
+	job_end(job1, command_name(cmd1));
+
+	return !failed;
 }
 
 /**
@@ -275,29 +1197,45 @@ static bool run_in_parallel(command_t *cmd1, command_t *cmd2, int level,
 	/* TODO: Execute cmd1 and cmd2 simultaneously. */
 	pid_t pidFirst, pidSecond;
 	int status1, status2;
+	struct job job1, job2; // each side is a job
 
-	pidFirst = fork(); // create first child
+	job_begin(&job1);
+	pidFirst = job_fork(&job1); // create first child
 
-	if (pidFirst < 0)
+	if (pidFirst < 0) {
+		job_end(&job1, command_name(cmd1));
 		return false;
+	}
 	else if (pidFirst == 0) { // first child
 		int status = parse_command(cmd1, level + 1, father);
 
-		exit(status);
+		exit_child(status);
 	}
 
-	pidSecond = fork(); // create second child
-	if (pidSecond < 0)
+	job_begin(&job2);
+	job_join(&job2, &job1); // one process group for both sides
+	pidSecond = job_fork(&job2); // create second child
+	if (pidSecond < 0) {
+		waitpid(pidFirst, &status1, 0);
+		job_end(&job2, command_name(cmd2));
+		job_end(&job1, command_name(cmd1));
 		return false;
-	else if (pidSecond == 0) { // second child
+	} else if (pidSecond == 0) { // second child
 		int status = parse_command(cmd2, level + 1, father);
 
-		exit(status);
+		exit_child(status);
 	}
 
 	// wait for children to finish
-	waitpid(pidFirst, &status1, 0);
-	waitpid(pidSecond, &status2, 0);
+	if (option_failfast)
+		return wait_fail_fast(cmd1, cmd2, &job1, &job2, pidFirst,
+				      pidSecond);
+
+	job_wait(&job1, pidFirst, &status1);
+	job_wait(&job2, pidSecond, &status2);
+	// the first side has the group: the terminal goes back to the shell
+	job_end(&job2, command_name(cmd2));
+	job_end(&job1, command_name(cmd1));
 
 	// if both exited with succes, return success
 	if (WIFEXITED(status1) && WIFEXITED(status2))
@@ -319,15 +1257,20 @@ static bool run_on_pipe(command_t *cmd1, command_t *cmd2, int level,
 	int fd[2]; // fd[0] - read, fd[1] - write
 	pid_t pidFirst, pidSecond;
 	int status1, status2;
+	struct job job; // the whole pipeline is one job
+	bool timed_out;
 
 	int res = pipe(fd); // create file descriptors from pipe
 
 	DIE(res < 0, "error on pipe");
 
 	// do something similar to run_in_parallel
-	pidFirst = fork();
-	if (pidFirst < 0)
+	job_begin(&job);
+	pidFirst = job_fork(&job);
+	if (pidFirst < 0) {
+		job_end(&job, command_name(cmd1));
 		return false;
+	}
 	else if (pidFirst == 0) { // first process child
 		close(fd[0]); // close read head
 		dup2(fd[1], STDOUT_FILENO); // point stdout to write head
@@ -335,26 +1278,32 @@ static bool run_on_pipe(command_t *cmd1, command_t *cmd2, int level,
 
 		int status = parse_command(cmd1, level + 1, father);
 
-		exit(status);
+		exit_child(status);
 	}
 
-	pidSecond = fork();
-	if (pidSecond < 0)
+	pidSecond = job_fork(&job);
+	if (pidSecond < 0) {
+		close(fd[0]);
+		close(fd[1]);
+		waitpid(pidFirst, &status1, 0);
+		job_end(&job, command_name(cmd1));
 		return false;
-	else if (pidSecond == 0) { // second process child
+	} else if (pidSecond == 0) { // second process child
 		close(fd[1]); // close write head
 		dup2(fd[0], STDIN_FILENO); // point stdin to read head
 		close(fd[0]); // close read head
 
 		int status = parse_command(cmd2, level + 1, father);
 
-		exit(status);
+		exit_child(status);
 	}
 
 	close(fd[0]);
 	close(fd[1]);
-	waitpid(pidFirst, &status1, 0);
-	waitpid(pidSecond, &status2, 0);
+	job_wait(&job, pidFirst, &status1);
+	job_wait(&job, pidSecond, &status2);
+	timed_out = job_timed_out(&job);
+	job_end(&job, command_name(cmd1));
 
 
 	// restore original file descriptors
@@ -367,9 +1316,290 @@ static bool run_on_pipe(command_t *cmd1, command_t *cmd2, int level,
 	close(orig_stdin);
 	close(orig_stderr);
 
+	if (timed_out)
+		return false;
 	return WEXITSTATUS(status2); /* TODO: Replace with actual exit status. */
 }
 
+/**
+ * Run the body of a for loop once for each word. The words are expanded
+ * once, into a single block of "name=word" strings that are put in the
+ * environment in turn, so iterations do not parse anything, nor allocate
+ * the variable; the argv of the commands of the body is reused from one
+ * iteration to the next (see argv_free()).
+ */
+static int run_for(command_t *c, int level)
+{
+	char **words, **entries, *dest;
+	size_t name_length, length;
+	const char *value;
+	int result = true;
+	int count, i;
+
+	words = get_argv(c->scmd, &count); // the name, then the words
+	name_length = strlen(words[0]);
+
+	length = 0;
+	for (i = 1; i < count; i++)
+		length += name_length + strlen(words[i]) + 2;
+
+	entries = malloc(count * sizeof(char *) + length);
+	DIE(entries == NULL, "Error allocating loop words.");
+
+	dest = (char *)(entries + count);
+	for (i = 1; i < count; i++) {
+		entries[i] = dest;
+		dest += sprintf(dest, "%s=%s", words[0], words[i]) + 1;
+	}
+
+	for (i = 1; i < count; i++) {
+		putenv(entries[i]);
+		result = parse_command(c->cmd1, level + 1, c);
+	}
+
+	// the environment must not point to entries once they are freed
+	value = getenv(words[0]);
+	if (count > 1 && value == entries[count - 1] + name_length + 1)
+		setenv(words[0], value, 1);
+
+	free(entries);
+	argv_free(words);
+
+	return result;
+}
+
+/**
+ * Run the body of a while loop as long as the condition succeeds.
+ */
+static int run_while(command_t *c, int level)
+{
+	int result = true;
+
+	while (parse_command(c->cmd1, level + 1, c) == true)
+		result = parse_command(c->cmd2, level + 1, c);
+
+	return result;
+}
+
+/**
+ * Run a group ({ list; }) or a loop in the shell: the redirections are
+ * done once, for the whole list, so a builtin like cd still changes the
+ * shell.
+ */
+static int run_group(command_t *c, int level)
+{
+	// auxiliary file descriptors used for restoring
+	int orig_stdout = dup(STDOUT_FILENO);
+	int orig_stdin = dup(STDIN_FILENO);
+	int orig_stderr = dup(STDERR_FILENO);
+	int outer = process_substitutions_begin();
+	int result;
+
+	doRedirection(c->scmd, false, NULL);
+	if (c->op == OP_FOR)
+		result = run_for(c, level);
+	else if (c->op == OP_WHILE)
+		result = run_while(c, level);
+	else
+		result = parse_command(c->cmd1, level + 1, c);
+
+	// restore original file descriptors
+	dup2(orig_stdout, STDOUT_FILENO);
+	dup2(orig_stdin, STDIN_FILENO);
+	dup2(orig_stderr, STDERR_FILENO);
+
+	// close auxiliary file descriptors
+	close(orig_stdout);
+	close(orig_stdin);
+	close(orig_stderr);
+
+	// after the restore, the redirections no longer hold the pipes
+	process_substitutions_end(outer);
+
+	return result;
+}
+
+/**
+ * Run a subshell (( list )) in a single child, which does the
+ * redirections and then runs the whole list.
+ */
+static int run_subshell(command_t *c, int level)
+{
+	struct job job;
+	pid_t pid;
+	int status;
+
+	job_begin(&job);
+	pid = job_fork(&job);
+	if (pid < 0) {
+		job_end(&job, command_name(c));
+		return false;
+	} else if (pid == 0) { // child
+		doRedirection(c->scmd, false, NULL);
+		exit_child(parse_command(c->cmd1, level + 1, c));
+	}
+
+	job_wait(&job, pid, &status);
+	job_end(&job, command_name(c));
+	return WIFEXITED(status) ? WEXITSTATUS(status) : false;
+}
+
+/**
+ * Check if a substitution can run in the shell itself: nothing in it may
+ * change the shell (variables, including "${name:=word}" and read,
+ * directory, functions, exit, limits, options). Subshells,
+ * pipes and parallel commands run in children anyway.
+ */
+static bool substitution_in_shell(command_t *c)
+{
+	simple_command_t *s;
+
+	if (c == NULL)
+		return true;
+
+	switch (c->op) {
+	case OP_NONE:
+		s = c->scmd;
+		return s->verb->next_part == NULL &&
+			!param_word_assigns(s->verb) &&
+			!param_word_assigns(s->params) &&
+			!param_word_assigns(s->in) &&
+			!param_word_assigns(s->out) &&
+			!param_word_assigns(s->err) &&
+			!is_builtin(s, builtin_cd) &&
+			!is_builtin(s, builtin_exit) &&
+			!is_builtin(s, builtin_quit) &&
+			!is_builtin(s, builtin_read) &&
+			!is_builtin(s, builtin_ulimit) &&
+			!is_builtin(s, builtin_set) &&
+			find_function(s) == NULL;
+
+	case OP_SUBSHELL:
+	case OP_PIPE:
+	case OP_PARALLEL:
+		return true;
+
+	case OP_FOR:
+	case OP_FUNCTION:
+		return false;
+
+	default:
+		return substitution_in_shell(c->cmd1) &&
+			substitution_in_shell(c->cmd2);
+	}
+}
+
+/**
+ * Run a substitution in the shell, with stdout in a memfd, and read the
+ * output back; NULL if there is no memfd.
+ */
+static char *substitution_in_memfd(command_t *c, size_t *length)
+{
+	int orig_stdout, fd;
+	struct stat st;
+	char *output;
+	ssize_t n;
+	size_t done;
+
+	fd = memfd_create("substitution", MFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	orig_stdout = dup(STDOUT_FILENO);
+	dup2(fd, STDOUT_FILENO);
+
+	parse_command(c, 0, NULL);
+	fflush(stdout);
+
+	dup2(orig_stdout, STDOUT_FILENO);
+	close(orig_stdout);
+
+	DIE(fstat(fd, &st) < 0, "fstat");
+	output = malloc(st.st_size + 1);
+	DIE(output == NULL, "Error allocating substitution.");
+
+	for (done = 0; done < (size_t)st.st_size; done += n) {
+		n = pread(fd, output + done, st.st_size - done, done);
+		if (n <= 0)
+			break;
+	}
+	close(fd);
+
+	*length = done;
+	return output;
+}
+
+/**
+ * Run a substitution in a child, reading its output from a pipe.
+ */
+static char *substitution_in_child(command_t *c, size_t *length)
+{
+	size_t size = 4096, done = 0;
+	char *output;
+	int fd[2];
+	pid_t pid;
+	ssize_t n;
+
+	DIE(pipe2(fd, O_CLOEXEC) < 0, "error on pipe");
+
+	pid = fork();
+	DIE(pid < 0, "fork");
+	if (pid == 0) { // child
+		close(fd[READ]);
+		dup2(fd[WRITE], STDOUT_FILENO);
+		close(fd[WRITE]);
+		exit_child(parse_command(c, 0, NULL));
+	}
+	close(fd[WRITE]);
+
+	output = malloc(size + 1);
+	DIE(output == NULL, "Error allocating substitution.");
+
+	for (;;) {
+		if (done == size) {
+			size *= 2;
+			output = realloc(output, size + 1);
+			DIE(output == NULL, "Error allocating substitution.");
+		}
+
+		n = read(fd[READ], output + done, size - done);
+		if (n <= 0)
+			break;
+		done += n;
+	}
+	close(fd[READ]);
+
+	waitpid(pid, NULL, 0);
+
+	*length = done;
+	return output;
+}
+
+/**
+ * Run the command of a "$(command)" part and return its output, without
+ * the trailing newlines. A command that cannot change the shell runs in
+ * it, so e.g. $(pwd) or $(echo ...) does not fork at all.
+ */
+char *run_substitution(command_t *c)
+{
+	char *output = NULL;
+	size_t length;
+
+	// what the shell printed must not end up in the output
+	fflush(stdout);
+
+	if (substitution_in_shell(c))
+		output = substitution_in_memfd(c, &length);
+	if (output == NULL)
+		output = substitution_in_child(c, &length);
+
+	while (length > 0 && output[length - 1] == '\n')
+		length--;
+	output[length] = '\0';
+
+	return output;
+}
+
 /**
  * Parse and execute a command.
  */
@@ -390,7 +1620,8 @@ int parse_command(command_t *c, int level, command_t *father)
 	case OP_SEQUENTIAL:
 		/* TODO: Execute the commands one after the other. */
 		parse_command(c->cmd1, level, c);
-		parse_command(c->cmd2, level, c);
+		// the status of a list (e.g. in a group) is the last one's
+		result = parse_command(c->cmd2, level, c);
 		break;
 
 	case OP_PARALLEL:
@@ -423,6 +1654,20 @@ int parse_command(command_t *c, int level, command_t *father)
 		result = run_on_pipe(c->cmd1, c->cmd2, level, c);
 		break;
 
+	case OP_GROUP:
+	case OP_FOR:
+	case OP_WHILE:
+		result = run_group(c, level);
+		break;
+
+	case OP_SUBSHELL:
+		result = run_subshell(c, level);
+		break;
+
+	case OP_FUNCTION:
+		result = define_function(c);
+		break;
+
 	default:
 		return SHELL_EXIT;
 	}
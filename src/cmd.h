@@ -12,4 +12,22 @@
  */
 int parse_command(command_t *cmd, int level, command_t *father);
 
+/**
+ * Register the builtin command names with the parser.
+ */
+void register_builtins(void);
+
+/**
+ * Run the command of a "$(command)" part and return its output, without
+ * the trailing newlines; free() releases it.
+ */
+char *run_substitution(command_t *c);
+
+/**
+ * Start the command of a "<(command)" (or ">(command)", if write) part, on
+ * a pipe, and return the /dev/fd path of the shell's end of it; free()
+ * releases it. The command is waited for with the command using the path.
+ */
+char *run_process_substitution(command_t *c, bool write);
+
 #endif /* _CMD_H */
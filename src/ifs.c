@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "ifs.h"
+
+static void set_add(uint64_t *set, unsigned char c)
+{
+	set[c / 64] |= (uint64_t)1 << (c % 64);
+}
+
+void ifs_load(struct ifs *ifs)
+{
+	const char *value = getenv("IFS");
+
+	memset(ifs, 0, sizeof(*ifs));
+	if (value == NULL)
+		value = " \t\n";
+
+	ifs->standard = strcmp(value, " \t\n") == 0;
+	ifs->empty = value[0] == '\0';
+
+	for (; *value != '\0'; value++) {
+		set_add(ifs->separators, *value);
+		if (*value == ' ' || *value == '\t' || *value == '\n')
+			set_add(ifs->spaces, *value);
+	}
+}
+
+/*
+ * The standard IFS, a vector at a time: a mask of the ' ', '\t' and '\n'
+ * in the (unaligned) block at p.
+ */
+
+#if defined(__AVX2__)
+
+#define IFS_VECTOR_SIZE		32
+
+static inline uint32_t standard_mask(const char *p)
+{
+	__m256i x = _mm256_loadu_si256((const __m256i *)p);
+	__m256i m;
+
+	m = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+			    _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t')));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+	return (uint32_t)_mm256_movemask_epi8(m);
+}
+
+#elif defined(__SSE2__)
+
+#define IFS_VECTOR_SIZE		16
+
+static inline uint32_t standard_mask(const char *p)
+{
+	__m128i x = _mm_loadu_si128((const __m128i *)p);
+	__m128i m;
+
+	m = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+			 _mm_cmpeq_epi8(x, _mm_set1_epi8('\t')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+	return (uint32_t)_mm_movemask_epi8(m);
+}
+
+#endif
+
+const char *ifs_find(const struct ifs *ifs, const char *s, const char *end)
+{
+#ifdef IFS_VECTOR_SIZE
+	uint32_t mask;
+
+	if (ifs->standard) {
+		for (; end - s >= IFS_VECTOR_SIZE; s += IFS_VECTOR_SIZE) {
+			mask = standard_mask(s);
+			if (mask != 0)
+				return s + __builtin_ctz(mask);
+		}
+	}
+#endif
+
+	while (s < end && !ifs_is_separator(ifs, *s))
+		s++;
+	return s;
+}
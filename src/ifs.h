@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _IFS_H
+#define _IFS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../util/parser/parser.h"
+
+/**
+ * The field separators of $IFS, as sets of bytes: all of them, and the
+ * white space ones (' ', '\t' and '\n'), which are merged with the
+ * separators around them. IFS unset is " \t\n", and an empty IFS does
+ * not split.
+ */
+struct ifs {
+	uint64_t separators[4];
+	uint64_t spaces[4];
+	bool standard;	/* " \t\n", which has a vector scan */
+	bool empty;
+};
+
+void ifs_load(struct ifs *ifs);
+
+static inline bool ifs_is_separator(const struct ifs *ifs, unsigned char c)
+{
+	return ifs->separators[c / 64] >> (c % 64) & 1;
+}
+
+static inline bool ifs_is_space(const struct ifs *ifs, unsigned char c)
+{
+	return ifs->spaces[c / 64] >> (c % 64) & 1;
+}
+
+/**
+ * The first separator from s on, or end if there is none.
+ */
+const char *ifs_find(const struct ifs *ifs, const char *s, const char *end);
+
+#endif /* _IFS_H */
@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ifs.h"
+#include "input.h"
+#include "utils.h"
+
+/* The most read at once from stdin */
+#define INPUT_CHUNK	4096
+
+/* What input_peek() copies a pipe stdin to, and the shell it is of */
+static int peek_pipe[2] = { -1, -1 };
+static pid_t peek_pid;
+
+/**
+ * Read what the pipe of stdin holds, at most size bytes, into buf without
+ * consuming it: tee() copies it to a pipe of the shell, which is read
+ * instead. Return the length, 0 at the end of the input, -1 if stdin is
+ * not a pipe.
+ */
+static ssize_t input_peek(char *buf, size_t size)
+{
+	ssize_t n, done, m;
+
+	// a subshell gets its own, not to read what its parent copied
+	if (peek_pid != getpid()) {
+		if (peek_pipe[0] >= 0) {
+			close(peek_pipe[0]);
+			close(peek_pipe[1]);
+		}
+		if (pipe2(peek_pipe, O_CLOEXEC) < 0)
+			peek_pipe[0] = peek_pipe[1] = -1;
+		peek_pid = getpid();
+	}
+	if (peek_pipe[0] < 0)
+		return -1;
+
+	do {
+		n = tee(STDIN_FILENO, peek_pipe[1], size, 0);
+	} while (n < 0 && errno == EINTR);
+
+	for (done = 0; done < n; done += m) {
+		m = read(peek_pipe[0], buf + done, n - done);
+		DIE(m <= 0, "read");
+	}
+
+	return n;
+}
+
+/**
+ * Read a line from a stdin that cannot seek: the data of a pipe is peeked
+ * at, and only the line is consumed; a terminal returns no more than a
+ * line anyway. Anything else is read one byte at a time.
+ */
+static size_t input_line_unseekable(char *buf, size_t size)
+{
+	const char *newline;
+	size_t length = 0;
+	ssize_t n;
+
+	if (size > INPUT_CHUNK)
+		size = INPUT_CHUNK;
+
+	n = input_peek(buf, size);
+	if (n == 0)
+		return 0;
+	if (n > 0) {
+		newline = memchr(buf, '\n', n);
+		size = newline != NULL ? newline + 1 - buf : n;
+	}
+
+	if (n > 0 || isatty(STDIN_FILENO)) {
+		do {
+			n = read(STDIN_FILENO, buf, size);
+		} while (n < 0 && errno == EINTR);
+		return n < 0 ? 0 : n;
+	}
+
+	while (length < size) {
+		n = read(STDIN_FILENO, buf + length, 1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0 || buf[length++] == '\n')
+			break;
+	}
+	return length;
+}
+
+size_t input_line(char *buf, size_t size)
+{
+	const char *newline;
+	ssize_t n;
+
+	if (lseek(STDIN_FILENO, 0, SEEK_CUR) < 0)
+		return input_line_unseekable(buf, size);
+
+	do {
+		n = read(STDIN_FILENO, buf, size < INPUT_CHUNK ? size : INPUT_CHUNK);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0)
+		return 0;
+
+	newline = memchr(buf, '\n', n);
+	if (newline != NULL && newline + 1 < buf + n) {
+		lseek(STDIN_FILENO, newline + 1 - (buf + n), SEEK_CUR);
+		n = newline + 1 - buf;
+	}
+
+	return n;
+}
+
+/**
+ * A line read by read: its characters, and which of them were quoted by
+ * a backslash, and so do not separate fields.
+ */
+struct line {
+	char *data;
+	bool *literal;
+	size_t length;
+	size_t size;
+};
+
+static void line_add(struct line *line, char c, bool literal)
+{
+	if (line->length + 1 >= line->size) {
+		line->size = line->size == 0 ? 128 : 2 * line->size;
+		line->data = realloc(line->data, line->size);
+		line->literal = realloc(line->literal,
+				line->size * sizeof(*line->literal));
+		DIE(line->data == NULL || line->literal == NULL,
+			"Error allocating line.");
+	}
+
+	line->literal[line->length] = literal;
+	line->data[line->length++] = c;
+	line->data[line->length] = '\0';
+}
+
+/**
+ * Read a line into line, without its '\n'; return false if the input
+ * ended first.
+ */
+static bool line_read(struct line *line, bool raw)
+{
+	char chunk[INPUT_CHUNK];
+	bool escape = false;
+	size_t i, n;
+
+	line_add(line, '\0', false);
+	line->length = 0;
+
+	while ((n = input_line(chunk, sizeof(chunk))) != 0) {
+		for (i = 0; i < n; i++) {
+			if (escape) {
+				// a backslash-newline continues the line
+				if (chunk[i] != '\n')
+					line_add(line, chunk[i], true);
+				escape = false;
+			} else if (chunk[i] == '\\' && !raw) {
+				escape = true;
+			} else if (chunk[i] != '\n') {
+				line_add(line, chunk[i], false);
+			} else {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+static void set_field(const char *name, const char *value, size_t length)
+{
+	char *copy = strndup(value, length);
+
+	DIE(copy == NULL, "Error allocating field.");
+	setenv(name, copy, 1);
+	free(copy);
+}
+
+bool input_read(char **names, bool raw)
+{
+	struct line line = { NULL, NULL, 0, 0 };
+	size_t start, end, i;
+	struct ifs ifs;
+	bool result;
+
+#define SEPARATOR(i)	(!line.literal[i] && \
+			 ifs_is_separator(&ifs, line.data[i]))
+#define SPACE(i)	(!line.literal[i] && ifs_is_space(&ifs, line.data[i]))
+
+	result = line_read(&line, raw);
+	if (*names == NULL) {
+		setenv("REPLY", line.data, 1);
+		goto out;
+	}
+
+	ifs_load(&ifs);
+	for (i = 0; i < line.length && SPACE(i); i++)
+		;
+
+	for (; names[1] != NULL; names++) {
+		for (start = i; i < line.length && !SEPARATOR(i); i++)
+			;
+		set_field(*names, line.data + start, i - start);
+
+		// white space around a separator is part of it
+		while (i < line.length && SPACE(i))
+			i++;
+		if (i < line.length && SEPARATOR(i)) {
+			for (i++; i < line.length && SPACE(i); i++)
+				;
+		}
+	}
+
+	// the last one takes the rest, without the white space at its end
+	for (end = line.length; end > i && SPACE(end - 1); end--)
+		;
+	// and without a separator that ends its only field
+	if (end > i && SEPARATOR(end - 1)) {
+		for (start = i; start < end - 1 && !SEPARATOR(start); start++)
+			;
+		end -= start == end - 1;
+	}
+	set_field(*names, line.data + i, end - i);
+
+#undef SEPARATOR
+#undef SPACE
+
+out:
+	free(line.data);
+	free(line.literal);
+	return result;
+}
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _INPUT_H
+#define _INPUT_H
+
+#include <stddef.h>
+
+#include "../util/parser/parser.h"
+
+/**
+ * Read a line of stdin (fd 0) into buf: at most size bytes, up to and with
+ * the '\n' (no '\0' is added). Nothing after the line is consumed, so the
+ * commands the shell runs find the rest of the input where it was: what
+ * was read past the line is given back with lseek() if fd 0 can seek,
+ * a pipe is peeked at with tee() first, and a terminal reads no more than
+ * a line (anything else is read one byte at a time). Return the length, 0
+ * at the end of the input.
+ */
+size_t input_line(char *buf, size_t size);
+
+/**
+ * The read builtin: read a line of stdin, and set the variables of names
+ * (a NULL terminated list) to its fields, split on IFS, the last one to
+ * the rest of the line; REPLY to the whole line if there are none. Unless
+ * raw, a backslash quotes the next character, and a backslash-newline
+ * continues the line. Return false at the end of the input.
+ */
+bool input_read(char **names, bool raw);
+
+#endif /* _INPUT_H */
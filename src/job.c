@@ -0,0 +1,791 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+
+#include <sys/pidfd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <linux/sched.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "job.h"
+#include "utils.h"
+
+#define NSEC_PER_SEC	1000000000LL
+
+#ifndef PIDFD_SIGNAL_PROCESS_GROUP
+#define PIDFD_SIGNAL_PROCESS_GROUP	(1UL << 2)
+#endif
+
+/*
+ * The shell is a process of a job: its children go in the job's leaf,
+ * and the job's timeout covers them.
+ */
+static bool in_job;
+
+static unsigned int job_count;
+
+/* The shell reads commands from a terminal, and so goes on after a SIGINT */
+static bool interactive;
+
+/* The controlling terminal of the shell, -1 if it has none */
+static int tty = -1;
+
+/* The jobs get the terminal while they run, see job_init() */
+static bool terminal;
+
+/* The jobs get process groups of their own, see job_init() */
+static bool groups;
+
+/* The process group of the job running, and a signal forwarded to it */
+static volatile sig_atomic_t foreground;
+static volatile sig_atomic_t pending;
+
+/* The subtree whose controllers were enabled, see enable_controllers() */
+static char *enabled_root;
+
+/**
+ * Report a cgroup error once, with the directory of MINISHELL_CGROUP that
+ * causes it; the jobs then run without their leaves.
+ */
+static void job_warn(void)
+{
+	static bool warned;
+
+	if (!warned)
+		fprintf(stderr, "mini-shell: cgroup %s: %s\n",
+			getenv("MINISHELL_CGROUP"), strerror(errno));
+	warned = true;
+}
+
+/**
+ * Enable the memory, cpu and io controllers for the leaves of root, once;
+ * those that cannot be are left out of the limits and the reports.
+ */
+static void enable_controllers(const char *root)
+{
+	static const char *const controllers[] = {
+		"+memory", "+cpu", "+io", NULL
+	};
+	const char *const *c;
+	char path[PATH_MAX];
+	int fd;
+
+	if (enabled_root != NULL && strcmp(enabled_root, root) == 0)
+		return;
+	free(enabled_root);
+	enabled_root = strdup(root);
+	DIE(enabled_root == NULL, "Error allocating cgroup.");
+
+	snprintf(path, sizeof(path), "%s/cgroup.subtree_control", root);
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+	// one at a time: one the subtree does not have fails alone
+	for (c = controllers; *c != NULL; c++)
+		write(fd, *c, strlen(*c));
+	close(fd);
+}
+
+/**
+ * Write a limit to a file of the leaf.
+ */
+static void write_value(struct job *job, const char *file, const char *value)
+{
+	int fd;
+
+	fd = openat(job->cgroup, file, O_WRONLY | O_CLOEXEC);
+	if (fd < 0 || write(fd, value, strlen(value)) < 0)
+		fprintf(stderr, "mini-shell: %s/%s: %s\n", job->path, file,
+			strerror(errno));
+	if (fd >= 0)
+		close(fd);
+}
+
+/**
+ * Write a limit of the environment (if it is set) to a file of the leaf.
+ */
+static void write_limit(struct job *job, const char *file, const char *env)
+{
+	const char *value = getenv(env);
+
+	if (value != NULL && value[0] != '\0')
+		write_value(job, file, value);
+}
+
+/**
+ * Write the resident set size limit (ulimit -m, which the kernel does not
+ * enforce itself) to the memory.max of the leaf, unless it is unlimited.
+ */
+static void write_rss(struct job *job, rlim_t rss)
+{
+	char value[24];
+
+	if (rss == RLIM_INFINITY)
+		return;
+
+	snprintf(value, sizeof(value), "%llu", (unsigned long long)rss);
+	write_value(job, "memory.max", value);
+}
+
+/**
+ * Create the leaf of a job under root.
+ */
+static void job_cgroup(struct job *job, const char *root)
+{
+	struct rlimit rlim;
+
+	enable_controllers(root);
+
+	DIE(asprintf(&job->path, "%s/job-%d-%u", root, getpid(),
+		     ++job_count) < 0, "Error allocating cgroup.");
+	if (mkdir(job->path, 0755) < 0) {
+		job_warn();
+		goto fail;
+	}
+
+	job->cgroup = open(job->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (job->cgroup < 0) {
+		job_warn();
+		rmdir(job->path);
+		goto fail;
+	}
+
+	write_limit(job, "memory.max", "MINISHELL_CGROUP_MEMORY_MAX");
+	write_limit(job, "cpu.max", "MINISHELL_CGROUP_CPU_MAX");
+	if (getrlimit(RLIMIT_RSS, &rlim) == 0)
+		write_rss(job, rlim.rlim_cur);
+	return;
+
+fail:
+	free(job->path);
+	job->path = NULL;
+}
+
+bool job_parse_duration(const char *s, long long *duration)
+{
+	static const char units[] = "smhd";
+	static const int seconds[] = { 1, 60, 3600, 86400 };
+	const char *unit;
+	double value;
+	char *end;
+
+	// strtod() would also take a sign, blanks, "inf" or hexadecimal
+	if (!isdigit((unsigned char)s[0]) && s[0] != '.')
+		return false;
+
+	value = strtod(s, &end);
+	if (end == s)
+		return false;
+	if (*end != '\0') {
+		unit = strchr(units, *end);
+		if (unit == NULL || end[1] != '\0')
+			return false;
+		value *= seconds[unit - units];
+	}
+
+	if (value > (double)INT32_MAX)
+		value = INT32_MAX;
+	*duration = value * NSEC_PER_SEC;
+	return true;
+}
+
+/**
+ * The handler of SIGINT and SIGTERM: the job running gets the signal
+ * instead, as a whole, and the shell itself ends once the job has (right
+ * away if there is none), unless it is interactive.
+ */
+static void job_forward(int sig)
+{
+	if (foreground != 0) {
+		kill(-foreground, sig);
+		pending = sig;
+	} else if (!interactive) {
+		signal(sig, SIG_DFL);
+		raise(sig);
+	}
+}
+
+/**
+ * The handler of SIGCHLD, which only has to interrupt poll().
+ */
+static void job_sigchld(int sig)
+{
+	(void)sig;
+}
+
+void job_init(bool is_interactive)
+{
+	static const int signals[] = { SIGINT, SIGTERM, 0 };
+	struct sigaction action, old;
+	const int *sig;
+
+	interactive = is_interactive;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = job_forward;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	for (sig = signals; *sig != 0; sig++) {
+		// a signal the shell was started ignoring stays ignored
+		if (sigaction(*sig, NULL, &old) == 0 &&
+		    old.sa_handler != SIG_IGN)
+			sigaction(*sig, &action, NULL);
+	}
+
+	// a stop of a child interrupts the polls of job_wait_poll()
+	action.sa_handler = job_sigchld;
+	sigaction(SIGCHLD, &action, NULL);
+
+	/*
+	 * With the terminal, the jobs get the keys (^C, ^Z) and can read it;
+	 * the shell then takes it back from the background, which would stop
+	 * it with SIGTTOU. It is the controlling terminal, whatever stdin is.
+	 * Without it (the shell is in the background), a job out of the group
+	 * of the shell would be stopped by SIGTTIN once it reads the terminal,
+	 * so the jobs stay in the group of the shell then.
+	 */
+	tty = open("/dev/tty", O_RDWR | O_CLOEXEC);
+	terminal = tty >= 0 && tcgetpgrp(tty) == getpgrp();
+	groups = tty < 0 || terminal;
+	if (terminal)
+		signal(SIGTTOU, SIG_IGN);
+}
+
+/**
+ * In a child: the signals of the shell are back to their defaults, for
+ * the command it execs or the shell it goes on as.
+ */
+static void job_child(void)
+{
+	static const int signals[] = { SIGINT, SIGTERM, 0 };
+	struct sigaction old;
+	const int *sig;
+
+	in_job = true;
+	foreground = pending = 0;
+
+	for (sig = signals; *sig != 0; sig++)
+		if (sigaction(*sig, NULL, &old) == 0 &&
+		    old.sa_handler == job_forward)
+			signal(*sig, SIG_DFL);
+	if (terminal)
+		signal(SIGTTOU, SIG_DFL);
+}
+
+/**
+ * The duration of an environment variable: fallback if it is not set, 0
+ * if it is not valid (which is reported once).
+ */
+static long long env_duration(const char *name, long long fallback)
+{
+	const char *value = getenv(name);
+	static bool warned;
+	long long duration;
+
+	if (value == NULL || value[0] == '\0')
+		return fallback;
+	if (job_parse_duration(value, &duration))
+		return duration;
+
+	if (!warned)
+		fprintf(stderr, "mini-shell: %s: invalid duration\n", name);
+	warned = true;
+	return 0;
+}
+
+void job_begin(struct job *job)
+{
+	const char *root = getenv("MINISHELL_CGROUP");
+	long long timeout;
+
+	job->cgroup = -1;
+	job->path = NULL;
+	job->limits = NULL;
+	job->timer = -1;
+	job->timeout = job->grace = 0;
+	job->signal = 0;
+	job->pgid = 0;
+	job->group = !in_job && groups;
+	job->leader = false;
+	job->pids = NULL;
+	job->pidfds = NULL;
+	job->count = job->size = 0;
+	if (in_job)
+		return;
+
+	timeout = env_duration("MINISHELL_CMD_TIMEOUT", 0);
+	if (timeout > 0)
+		job_timeout(job, timeout,
+			    env_duration("MINISHELL_CMD_TIMEOUT_GRACE",
+					 JOB_GRACE));
+
+	if (root != NULL && root[0] != '\0')
+		job_cgroup(job, root);
+}
+
+/**
+ * Arm the timer of the job to expire in duration nanoseconds.
+ */
+static void job_arm(struct job *job, long long duration)
+{
+	struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+
+	spec.it_value.tv_sec = duration / NSEC_PER_SEC;
+	spec.it_value.tv_nsec = duration % NSEC_PER_SEC;
+	if (duration <= 0)
+		spec.it_value.tv_nsec = 1;	// 0 would disarm it
+
+	DIE(timerfd_settime(job->timer, 0, &spec, NULL) < 0, "timerfd_settime");
+}
+
+void job_limits(struct job *job, const struct limits *limits)
+{
+	job->limits = limits;
+	if (job->cgroup >= 0)
+		write_rss(job, limit_value(limits, RLIMIT_RSS));
+}
+
+void job_timeout(struct job *job, long long timeout, long long grace)
+{
+	if (job->timer < 0) {
+		job->timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		DIE(job->timer < 0, "timerfd_create");
+	}
+
+	job->timeout = timeout;
+	job->grace = grace;
+	job_arm(job, timeout);
+}
+
+pid_t job_fork(struct job *job)
+{
+	pid_t pid;
+
+#if defined(CLONE_INTO_CGROUP) && defined(SYS_clone3)
+	struct clone_args args;
+
+	/*
+	 * Like fork(), without glibc's bookkeeping: the child only runs the
+	 * shell's code, single threaded, and then execs or exits.
+	 */
+	if (job->cgroup >= 0) {
+		memset(&args, 0, sizeof(args));
+		args.flags = CLONE_INTO_CGROUP;
+		args.exit_signal = SIGCHLD;
+		args.cgroup = job->cgroup;
+
+		pid = syscall(SYS_clone3, &args, sizeof(args));
+		if (pid >= 0)
+			goto forked;
+		job_warn();
+	}
+#endif
+
+	pid = fork();
+
+#if defined(CLONE_INTO_CGROUP) && defined(SYS_clone3)
+forked:
+#endif
+	// both sides set the group, so it is set before either goes on
+	if (pid >= 0 && job->group) {
+		setpgid(pid == 0 ? 0 : pid, job->pgid);
+		if (job->pgid == 0 && terminal)
+			tcsetpgrp(tty, pid == 0 ? getpid() : pid);
+	}
+	if (pid > 0 && job->group && job->pgid == 0) {
+		job->pgid = foreground = pid;
+		job->leader = true;
+	}
+
+	if (pid == 0) {
+		job_child();
+	} else if (pid > 0 && (job->timer >= 0 || job->pgid == 0)) {
+		if (job->count == job->size) {
+			job->size = job->size == 0 ? 2 : 2 * job->size;
+			job->pids = realloc(job->pids,
+					job->size * sizeof(*job->pids));
+			job->pidfds = realloc(job->pidfds,
+					job->size * sizeof(*job->pidfds));
+			DIE(job->pids == NULL || job->pidfds == NULL,
+				"Error allocating job.");
+		}
+		// what job_signal() reaches, even once the pid is reused
+		job->pidfds[job->count] = pidfd_open(pid, 0);
+		DIE(job->pidfds[job->count] < 0, "pidfd_open");
+		job->pids[job->count++] = pid;
+	}
+
+	return pid;
+}
+
+void job_join(struct job *job, const struct job *leader)
+{
+	job->group = leader->group;
+	job->pgid = leader->pgid;
+}
+
+/**
+ * The index of a process of the job in pids and pidfds, -1 if the job
+ * does not have its pidfd.
+ */
+static int job_find(const struct job *job, pid_t pid)
+{
+	int i;
+
+	for (i = 0; i < job->count; i++)
+		if (job->pids[i] == pid)
+			return i;
+
+	return -1;
+}
+
+/**
+ * A process of the job was waited for: close its pidfd, and free its
+ * slot for the next one (the batches of a command may be many).
+ */
+static void job_forget(struct job *job, pid_t pid)
+{
+	int i = job_find(job, pid);
+
+	if (i < 0)
+		return;
+
+	close(job->pidfds[i]);
+	job->count--;
+	job->pids[i] = job->pids[job->count];
+	job->pidfds[i] = job->pidfds[job->count];
+}
+
+/**
+ * Send a signal to the processes of the job. With a process group, it
+ * goes to the whole group at once, through the pidfd of its leader if
+ * there is one, or with kill() once the leader has been waited for.
+ */
+static void job_signal(struct job *job, int sig)
+{
+	int i;
+
+	if (job->pgid != 0) {
+		i = job->leader ? job_find(job, job->pgid) : -1;
+		if (i < 0 || pidfd_send_signal(job->pidfds[i], sig, NULL,
+					       PIDFD_SIGNAL_PROCESS_GROUP) < 0)
+			kill(-job->pgid, sig);
+		return;
+	}
+
+	for (i = 0; i < job->count; i++)
+		pidfd_send_signal(job->pidfds[i], sig, NULL, 0);
+}
+
+/**
+ * The timer of the job expired: send the processes of the job a SIGTERM,
+ * and then, if there is a grace period, a SIGKILL once it is over.
+ */
+static void job_expire(struct job *job)
+{
+	uint64_t expirations;
+
+	if (read(job->timer, &expirations, sizeof(expirations)) < 0)
+		return;
+
+	job->signal = job->signal == 0 ? SIGTERM : SIGKILL;
+	if (job->signal == SIGTERM && job->grace > 0)
+		job_arm(job, job->grace);
+
+	job_signal(job, job->signal);
+	// a stopped process only gets the SIGTERM once it goes on
+	if (job->signal == SIGTERM)
+		job_signal(job, SIGCONT);
+}
+
+/**
+ * A process of the job stopped (^Z, or SIGTTIN as it read the terminal it
+ * did not have): the shell cannot resume it later, and would wait for it
+ * forever, so the group of the job gets the terminal and goes on. A job
+ * in the group of the shell goes on with the shell instead.
+ */
+static void job_continue(struct job *job)
+{
+	if (job->pgid == 0)
+		return;
+
+	if (terminal)
+		tcsetpgrp(tty, job->pgid);
+	kill(-job->pgid, SIGCONT);
+}
+
+/**
+ * waitpid() for a process of the job until it ends, even if it stops.
+ */
+static pid_t job_waitpid(struct job *job, pid_t pid, int *status)
+{
+	pid_t ret;
+
+	while ((ret = waitpid(pid, status, WUNTRACED)) > 0 &&
+	       WIFSTOPPED(*status))
+		job_continue(job);
+
+	return ret;
+}
+
+/**
+ * poll() the pidfds and the timers of the jobs of n processes, the jobs
+ * of those that are stopped going on first. SIGCHLD is blocked up to
+ * ppoll(), so a process that stops after the check interrupts it.
+ */
+static int job_poll(struct job *const jobs[], const pid_t pids[], int n,
+		    struct pollfd *fds, nfds_t nfds)
+{
+	sigset_t chld, mask;
+	siginfo_t info;
+	int i, ret;
+
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &chld, &mask);
+
+	for (i = 0; i < n; i++) {
+		info.si_pid = 0;
+		if (waitid(P_PID, pids[i], &info, WSTOPPED | WNOHANG) == 0 &&
+		    info.si_pid != 0)
+			job_continue(jobs[i]);
+	}
+	ret = ppoll(fds, nfds, NULL, &mask);
+
+	sigprocmask(SIG_SETMASK, &mask, NULL);
+	return ret;
+}
+
+pid_t job_wait(struct job *job, pid_t pid, int *status)
+{
+	struct pollfd fds[2];
+	int i = job_find(job, pid);
+
+	if (job->timer < 0 || i < 0) {
+		job_forget(job, pid);
+		return job_waitpid(job, pid, status);
+	}
+
+	fds[0].fd = job->pidfds[i];
+	fds[0].events = POLLIN;
+	fds[1].fd = job->timer;
+	fds[1].events = POLLIN;
+
+	for (;;) {
+		if (job_poll(&job, &pid, 1, fds, 2) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		// the pidfd is readable once the process has exited
+		if (fds[0].revents != 0)
+			break;
+		if (fds[1].revents & POLLIN)
+			job_expire(job);
+	}
+
+	job_forget(job, pid);
+	return waitpid(pid, status, 0);
+}
+
+pid_t job_wait_either(struct job *jobs[2], const pid_t pids[2], int *status)
+{
+	struct pollfd fds[4];
+	int i, done = -1;
+
+	for (i = 0; i < 2; i++) {
+		fds[i].fd = pidfd_open(pids[i], 0);
+		DIE(fds[i].fd < 0, "pidfd_open");
+		fds[i].events = POLLIN;
+		fds[2 + i].fd = jobs[i]->timer;	// ignored by poll() if -1
+		fds[2 + i].events = POLLIN;
+	}
+
+	while (done < 0) {
+		if (job_poll(jobs, pids, 2, fds, 4) < 0) {
+			if (errno == EINTR)
+				continue;
+			done = 0;
+			break;
+		}
+		for (i = 0; i < 2 && done < 0; i++)
+			if (fds[i].revents != 0)
+				done = i;
+		for (i = 0; i < 2 && done < 0; i++)
+			if (fds[2 + i].revents & POLLIN)
+				job_expire(jobs[i]);
+	}
+
+	close(fds[0].fd);
+	close(fds[1].fd);
+	job_forget(jobs[done], pids[done]);
+	return waitpid(pids[done], status, 0);
+}
+
+void job_cancel(struct job *job)
+{
+	job_signal(job, SIGKILL);
+}
+
+/**
+ * Read a file of the leaf into buf, '\0' terminated; false if it is not
+ * there (its controller is not enabled).
+ */
+static bool read_stat(const struct job *job, const char *file, char *buf,
+		size_t size)
+{
+	ssize_t n;
+	int fd;
+
+	fd = openat(job->cgroup, file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	n = read(fd, buf, size - 1);
+	close(fd);
+	if (n < 0)
+		return false;
+
+	buf[n] = '\0';
+	return true;
+}
+
+/**
+ * The sum of the values of key in a stat file, as "key value" lines
+ * (cpu.stat) or as "key=value" fields (io.stat, one line per device).
+ */
+static unsigned long long stat_sum(const char *text, const char *key)
+{
+	size_t length = strlen(key);
+	unsigned long long sum = 0;
+	const char *p = text;
+
+	while ((p = strstr(p, key)) != NULL) {
+		if ((p == text || p[-1] == ' ' || p[-1] == '\n') &&
+		    (p[length] == ' ' || p[length] == '='))
+			sum += strtoull(p + length + 1, NULL, 10);
+		p += length;
+	}
+
+	return sum;
+}
+
+/**
+ * Start a field of the report: the name of the job before the first one,
+ * a comma before the others.
+ */
+static void report_field(const char *name, const char **separator)
+{
+	if (*separator == NULL)
+		fprintf(stderr, "%s:", name);
+	else
+		fputs(*separator, stderr);
+	*separator = ",";
+}
+
+/**
+ * Print what the job used, from the files of its cgroup; nothing if it
+ * has none of them (e.g. the directory is not a cgroup).
+ */
+static void job_report(const struct job *job, const char *name)
+{
+	unsigned long long usage, user, system;
+	const char *separator = NULL;
+	char buf[4096];
+
+	if (read_stat(job, "memory.peak", buf, sizeof(buf))) {
+		report_field(name, &separator);
+		fprintf(stderr, " memory.peak %llu kB",
+			strtoull(buf, NULL, 10) / 1024);
+	}
+
+	if (read_stat(job, "cpu.stat", buf, sizeof(buf))) {
+		usage = stat_sum(buf, "usage_usec");
+		user = stat_sum(buf, "user_usec");
+		system = stat_sum(buf, "system_usec");
+		report_field(name, &separator);
+		fprintf(stderr, " cpu %llu.%03llu s (user %llu.%03llu s, system %llu.%03llu s)",
+			usage / 1000000, usage / 1000 % 1000,
+			user / 1000000, user / 1000 % 1000,
+			system / 1000000, system / 1000 % 1000);
+	}
+
+	if (read_stat(job, "io.stat", buf, sizeof(buf))) {
+		report_field(name, &separator);
+		fprintf(stderr, " io %llu kB read, %llu kB written",
+			stat_sum(buf, "rbytes") / 1024,
+			stat_sum(buf, "wbytes") / 1024);
+	}
+
+	if (separator != NULL)
+		fputc('\n', stderr);
+}
+
+/**
+ * The job that had the process group ended: the shell takes the terminal
+ * back, and ends with the signal that was forwarded to the job, if any.
+ */
+static void job_background(void)
+{
+	int sig = pending;
+
+	foreground = pending = 0;
+	if (terminal)
+		tcsetpgrp(tty, getpgrp());
+
+	if (sig != 0 && !interactive) {
+		signal(sig, SIG_DFL);
+		raise(sig);
+	}
+}
+
+void job_end(struct job *job, const char *name)
+{
+	int i;
+
+	if (job_timed_out(job))
+		fprintf(stderr, "%s: timed out after %lld.%03lld s\n", name,
+			job->timeout / NSEC_PER_SEC,
+			job->timeout / 1000000 % 1000);
+
+	for (i = 0; i < job->count; i++)
+		close(job->pidfds[i]);
+	free(job->pids);
+	free(job->pidfds);
+	job->pids = NULL;
+	job->pidfds = NULL;
+	if (job->timer >= 0)
+		close(job->timer);
+	job->timer = -1;
+	job->count = job->size = 0;
+
+	if (job->cgroup >= 0) {
+		if (getenv("MINISHELL_CGROUP_REPORT") != NULL)
+			job_report(job, name);
+
+		// a process the job left running keeps its leaf
+		close(job->cgroup);
+		rmdir(job->path);
+		free(job->path);
+		job->cgroup = -1;
+		job->path = NULL;
+	}
+
+	if (job->leader)
+		job_background();
+	job->leader = false;
+}
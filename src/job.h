@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _JOB_H
+#define _JOB_H
+
+#include <sys/types.h>
+
+#include "../util/parser/parser.h"
+#include "limit.h"
+
+/* The grace period of a timeout, unless it is set */
+#define JOB_GRACE	5000000000LL
+
+/**
+ * A job of the shell: a simple command, a pipeline or a side of a
+ * parallel command, with its own cgroup v2 leaf when MINISHELL_CGROUP is
+ * the path of a delegated subtree. The processes of a job are created
+ * in the leaf, so they never run outside of it, and those they start
+ * stay in it. The child of a simple command applies limits before it
+ * execs.
+ *
+ * A job has its own process group (unless the shell is itself part of a
+ * job: its processes are in the group of the outer job then), which the
+ * sides of a parallel command share, so a signal reaches the processes
+ * its processes start too, at once. SIGINT and SIGTERM are forwarded to
+ * the group of the job running, which has the terminal, if the shell
+ * has it.
+ *
+ * A job may have a timeout: when it expires, the processes of the job
+ * get a SIGTERM, and a SIGKILL once the grace period (if any) is over.
+ * The grace period is JOB_GRACE unless it is set.
+ */
+struct job {
+	int cgroup;	/* the leaf, -1 if the job has none */
+	char *path;
+	const struct limits *limits;	/* of "ulimit ... command", or NULL */
+
+	int timer;	/* a timerfd, -1 if there is no timeout */
+	long long timeout, grace;	/* in nanoseconds */
+	int signal;	/* the last one the timeout sent, 0 if none */
+	pid_t pgid;	/* the process group, 0 if it has none */
+	bool group;	/* its processes go in a process group */
+	bool leader;	/* it created the group, which has the terminal */
+	pid_t *pids;	/* those it signals (with a timeout or no group) */
+	int *pidfds;
+	int count, size;
+};
+
+/**
+ * Set the signals of the shell up for its jobs: SIGINT and SIGTERM are
+ * forwarded to the job running, and end the shell after it (and right
+ * away between jobs) unless it is interactive. The jobs get the terminal
+ * if the shell is in the foreground of its controlling terminal, whatever
+ * stdin is; if it is in the background, they stay in its process group.
+ */
+void job_init(bool interactive);
+
+/**
+ * Create the leaf of a job, unless the cgroups are off or the shell is
+ * itself part of a job (the children of a job share its leaf). The
+ * limits of MINISHELL_CGROUP_MEMORY_MAX and MINISHELL_CGROUP_CPU_MAX are
+ * written to its memory.max and cpu.max, and then the resident set size
+ * limit of the shell (ulimit -m) to memory.max. The timeout of the job is
+ * MINISHELL_CMD_TIMEOUT (with a grace period of
+ * MINISHELL_CMD_TIMEOUT_GRACE, 5 seconds if unset), and counts from now.
+ */
+void job_begin(struct job *job);
+
+/**
+ * Set the limits that the child of a simple command applies before it
+ * execs ("ulimit ... command"). Their resident set size limit (-m) is
+ * also written to the memory.max of the job's leaf, if it has one.
+ */
+void job_limits(struct job *job, const struct limits *limits);
+
+/**
+ * Set the timeout of a job (and its grace period), from now.
+ */
+void job_timeout(struct job *job, long long timeout, long long grace);
+
+/**
+ * Parse a duration, a number of seconds with an optional fraction and an
+ * optional unit ("s", "m", "h" or "d"), in nanoseconds; false if s is not
+ * one.
+ */
+bool job_parse_duration(const char *s, long long *duration);
+
+/**
+ * Put the processes of job in the process group of leader, which has
+ * forked one already: both are the same job for the signals.
+ */
+void job_join(struct job *job, const struct job *leader);
+
+/**
+ * fork() a process of the job, straight into its leaf if it has one.
+ */
+pid_t job_fork(struct job *job);
+
+/**
+ * waitpid() for a process of the job; with a timeout, the job is
+ * signaled if it expires first. A job that stops goes on.
+ */
+pid_t job_wait(struct job *job, pid_t pid, int *status);
+
+/**
+ * waitpid() for whichever of two processes exits first, each in its job
+ * (the sides of a parallel command), with the timeouts of the jobs; return
+ * its pid.
+ */
+pid_t job_wait_either(struct job *jobs[2], const pid_t pids[2], int *status);
+
+/**
+ * Kill the processes of the job's group at once, with SIGKILL. A job
+ * without its own group (part of the job the shell is in) has the
+ * processes it forked killed instead, and only those.
+ */
+void job_cancel(struct job *job);
+
+/**
+ * Whether the timeout of the job expired.
+ */
+static inline bool job_timed_out(const struct job *job)
+{
+	return job->signal != 0;
+}
+
+/**
+ * The processes of the job were waited for: print what they used (its
+ * memory.peak, cpu.stat and io.stat) on stderr if MINISHELL_CGROUP_REPORT
+ * is set, and remove the leaf. A job that timed out is reported too.
+ */
+void job_end(struct job *job, const char *name);
+
+#endif /* _JOB_H */
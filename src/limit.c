@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+
+#include <sys/resource.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "limit.h"
+
+/* The width of the name and unit of a limit, as bash prints them */
+#define LIMIT_LABEL_WIDTH	40
+
+static const struct limit_info {
+	char option;
+	int resource;
+	rlim_t unit;
+	const char *name;
+	const char *unit_name;
+} limit_infos[] = {
+	{ 'c', RLIMIT_CORE, 1024, "core file size", "blocks" },
+	{ 'd', RLIMIT_DATA, 1024, "data seg size", "kbytes" },
+	{ 'f', RLIMIT_FSIZE, 1024, "file size", "blocks" },
+	{ 'l', RLIMIT_MEMLOCK, 1024, "max locked memory", "kbytes" },
+	{ 'm', RLIMIT_RSS, 1024, "max memory size", "kbytes" },
+	{ 'n', RLIMIT_NOFILE, 1, "open files", NULL },
+	{ 's', RLIMIT_STACK, 1024, "stack size", "kbytes" },
+	{ 't', RLIMIT_CPU, 1, "cpu time", "seconds" },
+	{ 'u', RLIMIT_NPROC, 1, "max user processes", NULL },
+	{ 'v', RLIMIT_AS, 1024, "virtual memory", "kbytes" },
+	{ 0 }
+};
+
+static const struct limit_info *info_by_option(char option)
+{
+	const struct limit_info *info;
+
+	for (info = limit_infos; info->option != 0; info++)
+		if (info->option == option)
+			break;
+
+	return info->option != 0 ? info : NULL;
+}
+
+static const struct limit_info *info_by_resource(int resource)
+{
+	const struct limit_info *info;
+
+	for (info = limit_infos; info->resource != resource; info++)
+		;
+
+	return info;
+}
+
+/**
+ * Parse the value of a limit into item; false if it is not one.
+ */
+static bool parse_value(const char *s, const struct limit_info *info,
+		struct limit *item)
+{
+	unsigned long long value;
+	char *end;
+
+	if (strcmp(s, "unlimited") == 0) {
+		item->kind = LIMIT_VALUE;
+		item->value = RLIM_INFINITY;
+		return true;
+	}
+	if (strcmp(s, "soft") == 0 || strcmp(s, "hard") == 0) {
+		item->kind = s[0] == 's' ? LIMIT_SOFT : LIMIT_HARD;
+		return true;
+	}
+	if (!isdigit((unsigned char)s[0]))
+		return false;
+
+	errno = 0;
+	value = strtoull(s, &end, 10);
+	if (*end != '\0' || errno != 0 || value > RLIM_INFINITY / info->unit)
+		return false;
+
+	item->kind = LIMIT_VALUE;
+	item->value = value * info->unit;
+	return true;
+}
+
+int limit_parse(char **argv, int argc, struct limits *limits)
+{
+	const struct limit_info *info;
+	struct limit *item;
+	const char *p;
+	int i;
+
+	memset(limits, 0, sizeof(*limits));
+
+	for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+		if (strcmp(argv[i], "--") == 0) {
+			i++;
+			break;
+		}
+
+		for (p = argv[i] + 1; *p != '\0'; p++) {
+			if (*p == 'S' || *p == 'H') {
+				limits->soft |= *p == 'S';
+				limits->hard |= *p == 'H';
+				continue;
+			}
+			if (*p == 'a') {
+				limits->all = true;
+				continue;
+			}
+
+			info = info_by_option(*p);
+			if (info == NULL) {
+				fprintf(stderr, "ulimit: -%c: invalid option\n", *p);
+				return -1;
+			}
+			if (limits->count == LIMIT_MAX) {
+				fprintf(stderr, "ulimit: too many limits\n");
+				return -1;
+			}
+
+			item = &limits->items[limits->count++];
+			item->resource = info->resource;
+			item->kind = LIMIT_PRINT;
+
+			// the value, if any, is the next word; one that starts
+			// with a digit is not a command
+			if (p[1] != '\0' || i + 1 == argc)
+				continue;
+			if (parse_value(argv[i + 1], info, item)) {
+				i++;
+			} else if (isdigit((unsigned char)argv[i + 1][0])) {
+				fprintf(stderr, "ulimit: %s: invalid number\n",
+					argv[i + 1]);
+				return -1;
+			}
+		}
+	}
+
+	// "ulimit value" sets the file size, "ulimit" prints it
+	if (limits->count == 0 && !limits->all) {
+		info = info_by_option('f');
+		item = &limits->items[limits->count++];
+		item->resource = info->resource;
+		item->kind = LIMIT_PRINT;
+		if (i < argc && isdigit((unsigned char)argv[i][0])) {
+			if (!parse_value(argv[i], info, item)) {
+				fprintf(stderr, "ulimit: %s: invalid number\n",
+					argv[i]);
+				return -1;
+			}
+			i++;
+		}
+	}
+
+	if (!limits->soft && !limits->hard)
+		limits->soft = limits->hard = true;
+
+	return i;
+}
+
+bool limit_apply(const struct limits *limits)
+{
+	const struct limit *item;
+	struct rlimit old, new;
+
+	for (item = limits->items; item < limits->items + limits->count;
+	     item++) {
+		if (item->kind == LIMIT_PRINT)
+			continue;
+
+		if (prlimit(0, item->resource, NULL, &old) < 0)
+			goto fail;
+
+		new = old;
+		if (item->kind == LIMIT_SOFT)
+			new.rlim_max = new.rlim_cur = old.rlim_cur;
+		else if (item->kind == LIMIT_HARD)
+			new.rlim_max = new.rlim_cur = old.rlim_max;
+		else
+			new.rlim_max = new.rlim_cur = item->value;
+		if (!limits->soft)
+			new.rlim_cur = old.rlim_cur;
+		if (!limits->hard)
+			new.rlim_max = old.rlim_max;
+
+		if (prlimit(0, item->resource, &new, NULL) < 0)
+			goto fail;
+	}
+
+	return true;
+
+fail:
+	fprintf(stderr, "ulimit: %s: cannot modify limit: %s\n",
+		info_by_resource(item->resource)->name, strerror(errno));
+	return false;
+}
+
+rlim_t limit_value(const struct limits *limits, int resource)
+{
+	const struct limit *item;
+	rlim_t value = RLIM_INFINITY;
+
+	for (item = limits->items; item < limits->items + limits->count;
+	     item++)
+		if (item->resource == resource && item->kind == LIMIT_VALUE)
+			value = item->value;
+
+	return value;
+}
+
+static void print_limit(const struct limit_info *info, bool hard, bool label)
+{
+	char unit[32];
+	struct rlimit rlim;
+	rlim_t value;
+
+	if (prlimit(0, info->resource, NULL, &rlim) < 0)
+		return;
+	value = hard ? rlim.rlim_max : rlim.rlim_cur;
+
+	if (label) {
+		snprintf(unit, sizeof(unit), "(%s%s-%c)",
+			 info->unit_name != NULL ? info->unit_name : "",
+			 info->unit_name != NULL ? ", " : "", info->option);
+		printf("%-*s%s ", LIMIT_LABEL_WIDTH - (int)strlen(unit),
+		       info->name, unit);
+	}
+
+	if (value == RLIM_INFINITY)
+		printf("unlimited\n");
+	else
+		printf("%llu\n", (unsigned long long)(value / info->unit));
+}
+
+void limit_print(const struct limits *limits)
+{
+	bool hard = limits->hard && !limits->soft;
+	const struct limit_info *info;
+	const struct limit *item;
+	int count = 0;
+
+	for (item = limits->items; item < limits->items + limits->count;
+	     item++)
+		count += item->kind == LIMIT_PRINT;
+
+	if (limits->all) {
+		for (info = limit_infos; info->option != 0; info++)
+			print_limit(info, hard, true);
+		return;
+	}
+
+	for (item = limits->items; item < limits->items + limits->count;
+	     item++)
+		if (item->kind == LIMIT_PRINT)
+			print_limit(info_by_resource(item->resource), hard,
+				    count > 1);
+}
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _LIMIT_H
+#define _LIMIT_H
+
+#include <sys/resource.h>
+
+#include "../util/parser/parser.h"
+
+#define LIMIT_MAX	16
+
+/**
+ * The options of a ulimit command: the limits it sets, and those it
+ * prints.
+ */
+struct limits {
+	struct limit {
+		int resource;
+		enum { LIMIT_PRINT, LIMIT_VALUE, LIMIT_SOFT, LIMIT_HARD } kind;
+		rlim_t value;	/* in bytes (or seconds, files, processes) */
+	} items[LIMIT_MAX];
+	int count;
+	bool all;	/* -a */
+	bool soft;	/* -S, or neither -S nor -H */
+	bool hard;	/* -H, or neither: a set changes both */
+};
+
+/**
+ * Parse the options of "ulimit [-HSa] [-cdflmnstuv [value]]... [command]",
+ * argv[0] being "ulimit": a value is a number (in the unit of its limit),
+ * "unlimited", "soft" or "hard"; an option without one prints the limit,
+ * as does no option at all (-f). Return the index of the command in argv,
+ * which has argc words if there is none, or -1 (with a message on
+ * stderr) if the options are not valid.
+ */
+int limit_parse(char **argv, int argc, struct limits *limits);
+
+/**
+ * Apply the limits to the calling process (prlimit() on itself): the
+ * shell, or the child of a command before it execs. Return false, with a
+ * message on stderr, if one of them cannot be set.
+ */
+bool limit_apply(const struct limits *limits);
+
+/**
+ * The value that the options set for resource (a number or "unlimited"),
+ * RLIM_INFINITY if they set none.
+ */
+rlim_t limit_value(const struct limits *limits, int resource);
+
+/**
+ * Print the limits the options ask for on stdout.
+ */
+void limit_print(const struct limits *limits);
+
+#endif /* _LIMIT_H */
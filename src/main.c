@@ -3,9 +3,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "../util/parser/parser.h"
+#include "arith.h"
 #include "cmd.h"
+#include "input.h"
+#include "job.h"
+#include "pattern.h"
+#include "script.h"
 #include "utils.h"
 
 #define PROMPT             "> "
@@ -18,50 +24,54 @@ void parse_error(const char *str, const int where)
 }
 
 /**
- * Readline from mini-shell.
+ * State of the command line being read by read_chunk().
  */
-static char *read_line(void)
-{
-	char *line = NULL;
-	int line_length = 0;
-
-	char chunk[CHUNK_SIZE];
-	int chunk_length;
-
-	char *rc;
-
-	int endline = 0;
+struct line_reader {
+	bool started;	/* something was read */
+	bool eol;	/* the end of the line (or of the input) was reached */
+	bool eof;	/* the end of the input was reached */
+	bool ended;	/* 0 was returned for the end of the line */
+};
 
-	while (!endline) {
-		rc = fgets(chunk, CHUNK_SIZE, stdin);
-		if (rc == NULL)
-			break;
-
-		chunk_length = strlen(chunk);
-		if (chunk[chunk_length - 1] == '\n') {
-			if (chunk_length > 1 && chunk[chunk_length - 2] == '\r')
-				/* Windows */
-				chunk[chunk_length - 2] = 0;
-			else
-				chunk[chunk_length - 1] = 0;
-			endline = 1;
-		}
+/**
+ * parse_stream() callback: read the next chunk of the command line,
+ * without ever holding the whole line in memory. Being called again after
+ * returning 0 means that the command continues on the next line.
+ */
+static size_t read_chunk(void *opaque, char *buf, size_t size)
+{
+	struct line_reader *reader = opaque;
+	size_t length;
 
-		line = realloc(line, line_length + CHUNK_SIZE);
-		DIE(line == NULL, "Error allocating command line");
+	if (reader->eol && !reader->eof && reader->ended) {
+		printf(PROMPT);
+		fflush(stdout);
+		reader->eol = reader->ended = false;
+	}
 
-		line[line_length] = '\0';
-		strcat(line, chunk);
+	if (reader->eol || size == 0) {
+		reader->ended = reader->eol;
+		return 0;
+	}
 
-		line_length += CHUNK_SIZE;
+	/* the commands of the line may read the rest of stdin */
+	length = input_line(buf, size);
+	if (length == 0) {
+		reader->eol = reader->eof = true;
+		return 0;
 	}
 
-	return line;
+	reader->started = true;
+	if (buf[length - 1] == '\n')
+		reader->eol = true;
+
+	return length;
 }
 
 static void start_shell(void)
 {
-	char *line;
+	struct line_reader reader;
+	char rest[CHUNK_SIZE];
 	command_t *root;
 
 	int ret;
@@ -72,24 +82,60 @@ static void start_shell(void)
 		ret = 0;
 
 		root = NULL;
-		line = read_line();
-		if (line == NULL)
+		memset(&reader, 0, sizeof(reader));
+		parse_stream(read_chunk, &reader, &root);
+
+		/* the parser stops early on errors */
+		while (!reader.eol && read_chunk(&reader, rest, sizeof(rest)) != 0)
+			;
+
+		if (!reader.started) {
+			free_parse_memory();
 			return;
-		parse_line(line, &root);
+		}
 
 		if (root != NULL)
 			ret = parse_command(root, 0, NULL);
 
+		arith_release();
 		free_parse_memory();
-		free(line);
+		pathname_cache_clear();
 
 		if (ret == SHELL_EXIT)
 			break;
 	}
 }
 
-int main(void)
+/**
+ * mini-shell [-n] [script]
+ *
+ * Without a script, commands are read from stdin, one line at a time;
+ * -n only checks the syntax of the script (read from stdin if missing).
+ */
+int main(int argc, char *argv[])
 {
+	bool check_only = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n")) != -1) {
+		switch (opt) {
+		case 'n':
+			check_only = true;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n] [script]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* argv is built from the flat parse tree */
+	parse_set_flat(true);
+	register_builtins();
+	job_init(optind == argc && !check_only && isatty(STDIN_FILENO));
+
+	if (optind < argc || check_only)
+		return run_script(optind < argc ? argv[optind] : NULL, check_only);
+
 	start_shell();
 
 	return EXIT_SUCCESS;
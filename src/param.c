@@ -0,0 +1,394 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "arith.h"
+#include "param.h"
+#include "pattern.h"
+#include "utils.h"
+
+/**
+ * A growing string, in which an expansion is built.
+ */
+struct text {
+	char *data;
+	size_t length;
+	size_t size;
+};
+
+static void text_append(struct text *t, const char *s, size_t n)
+{
+	if (t->length + n + 1 > t->size) {
+		while (t->length + n + 1 > t->size)
+			t->size = t->size == 0 ? 64 : 2 * t->size;
+		t->data = realloc(t->data, t->size);
+		DIE(t->data == NULL, "Error allocating expansion.");
+	}
+
+	memcpy(t->data + t->length, s, n);
+	t->length += n;
+	t->data[t->length] = '\0';
+}
+
+/**
+ * Append n characters to t; in a pattern, the quoted ones have their
+ * pattern characters escaped.
+ */
+static void text_emit(struct text *t, const char *s, size_t n, bool escape)
+{
+	size_t i, k;
+
+	if (!escape) {
+		text_append(t, s, n);
+		return;
+	}
+
+	for (i = 0; i < n; i = k) {
+		for (k = i; k < n && strchr("\\*?[", s[k]) == NULL; k++)
+			;
+		text_append(t, s + i, k - i);
+		if (k < n) {
+			text_append(t, "\\", 1);
+			text_append(t, s + k++, 1);
+		}
+	}
+}
+
+static bool is_name_char(char c)
+{
+	return c == '_' || isalnum((unsigned char)c);
+}
+
+bool param_is_name(const char *string)
+{
+	while (is_name_char(*string))
+		string++;
+	return *string == '\0';
+}
+
+/**
+ * The value of the variable whose name is the length characters at name,
+ * or NULL if it is not set.
+ */
+static const char *lookup(const char *name, size_t length)
+{
+	char buffer[256], *copy = buffer;
+	const char *value;
+
+	if (length >= sizeof(buffer)) {
+		copy = malloc(length + 1);
+		DIE(copy == NULL, "Error allocating name.");
+	}
+	memcpy(copy, name, length);
+	copy[length] = '\0';
+
+	value = getenv(copy);
+	if (copy != buffer)
+		free(copy);
+
+	return value;
+}
+
+/**
+ * The '}' that closes the "${" whose text starts at s (the lexer checked
+ * that there is one).
+ */
+static const char *closing_brace(const char *s, const char *end)
+{
+	int depth = 0;
+	char quote;
+
+	for (; s < end; s++) {
+		if (*s == '\\') {
+			s++;
+		} else if (*s == '\'' || *s == '"') {
+			quote = *s++;
+			while (s < end && *s != quote)
+				s += quote == '"' && *s == '\\' ? 2 : 1;
+		} else if (*s == '{') {
+			depth++;
+		} else if (*s == '}' && depth-- == 0) {
+			break;
+		}
+	}
+
+	return s < end ? s : end;
+}
+
+/**
+ * The first ')' of the "))" that closes the "$((" whose expression starts
+ * at s, or NULL if there is none.
+ */
+static const char *closing_parens(const char *s, const char *end)
+{
+	int depth = 0;
+
+	for (; s < end; s++) {
+		if (*s == '(')
+			depth++;
+		else if (*s == ')' && depth-- == 0)
+			return end - s > 1 && s[1] == ')' ? s : NULL;
+	}
+
+	return NULL;
+}
+
+static void param_eval(struct text *t, const char *s, size_t n, bool quoted,
+		bool pattern);
+
+/**
+ * Expand the word of an operator, from s to end, into t: its quotes and
+ * backslashes are removed, and its "$name" and "${...}" expanded. In a
+ * pattern, the quoted characters are escaped. quoted is set if the word
+ * is inside double quotes, where a single quote is an ordinary character.
+ */
+static void word_eval(struct text *t, const char *s, const char *end,
+		bool quoted, bool pattern)
+{
+	bool double_quoted = quoted;
+	const char *start, *close;
+	char c;
+
+	while (s < end) {
+		c = *s;
+		close = NULL;
+		if (c == '$' && end - s > 2 && s[1] == '(' && s[2] == '(')
+			close = closing_parens(s + 3, end);
+
+		if (close != NULL) {
+			param_eval(t, s + 1, close + 2 - s - 1, double_quoted,
+					pattern);
+			s = close + 2;
+		} else if (c == '\\' && s + 1 < end &&
+		    (!double_quoted || strchr("$\"\\}", s[1]) != NULL)) {
+			text_emit(t, s + 1, 1, pattern);
+			s += 2;
+		} else if (c == '\'' && !double_quoted) {
+			start = ++s;
+			while (s < end && *s != '\'')
+				s++;
+			text_emit(t, start, s - start, pattern);
+			s += s < end;
+		} else if (c == '"') {
+			double_quoted = !double_quoted;
+			s++;
+		} else if (c == '$' && s + 1 < end && s[1] == '{') {
+			close = closing_brace(s + 2, end);
+			param_eval(t, s + 2, close - s - 2, double_quoted,
+					pattern);
+			s = close + (close < end);
+		} else if (c == '$' && s + 1 < end &&
+			   (s[1] == '_' || isalpha((unsigned char)s[1]))) {
+			for (start = ++s; s < end && is_name_char(*s); s++)
+				;
+			param_eval(t, start, s - start, double_quoted, pattern);
+		} else {
+			text_emit(t, s++, 1, pattern && double_quoted);
+		}
+	}
+}
+
+/*
+ * The patterns of "${name#pattern}" and the like, by text: a pattern is
+ * compiled once, and then matched at each expansion (e.g. at each
+ * iteration of a loop). A pattern replaces the one in its slot.
+ */
+#define PATTERN_CACHE_SIZE 64
+
+static struct {
+	char *text;
+	struct pattern *pattern;
+} pattern_cache[PATTERN_CACHE_SIZE];
+
+static const struct pattern *pattern_get(const char *text, size_t length)
+{
+	size_t hash = 5381, i;
+
+	for (i = 0; i < length; i++)
+		hash = hash * 33 + (unsigned char)text[i];
+	i = hash % PATTERN_CACHE_SIZE;
+
+	if (pattern_cache[i].text == NULL ||
+	    strcmp(pattern_cache[i].text, text) != 0) {
+		free(pattern_cache[i].text);
+		if (pattern_cache[i].pattern != NULL)
+			pattern_free(pattern_cache[i].pattern);
+
+		pattern_cache[i].text = strdup(text);
+		DIE(pattern_cache[i].text == NULL, "Error allocating pattern.");
+		pattern_cache[i].pattern = pattern_compile(text, length);
+	}
+
+	return pattern_cache[i].pattern;
+}
+
+/**
+ * Remove the shortest (or longest) prefix ('#') or suffix ('%') of value
+ * that the pattern from word to end matches, and append the rest to t.
+ */
+static void remove_affix(struct text *t, const char *value, char kind,
+		bool longest, const char *word, const char *end, bool quoted,
+		bool pattern)
+{
+	struct text text = { NULL, 0, 0 };
+	size_t length = strlen(value);
+	ssize_t n;
+
+	/* the pattern is not quoted by double quotes around the "${...}" */
+	text_append(&text, "", 0);
+	word_eval(&text, word, end, false, true);
+	n = pattern_affix(pattern_get(text.data, text.length), value, length,
+			kind == '%', longest);
+	free(text.data);
+
+	if (n < 0)
+		n = 0;
+	text_emit(t, kind == '#' ? value + n : value, length - n,
+			quoted && pattern);
+}
+
+/**
+ * Append the value of "$((expression))" to t, where s is "((expression))":
+ * its "$name" and "${...}" are expanded first. Nothing is appended if it
+ * is not valid. An expression without expansions is compiled into
+ * *compiled, unless it is NULL (see arith_eval()).
+ */
+static void arith_expand(struct text *t, const char *s, size_t n,
+		void **compiled)
+{
+	struct text expression = { NULL, 0, 0 };
+	const char *text = s + 2;
+	char number[24];
+	long long value;
+	size_t length = n - 4;
+
+	if (memchr(text, '$', length) != NULL) {
+		text_append(&expression, "", 0);
+		word_eval(&expression, text, text + length, true, false);
+		text = expression.data;
+		length = expression.length;
+		compiled = NULL;	// its text changes with the variables
+	}
+
+	if (arith_eval(text, length, &value, compiled)) {
+		n = snprintf(number, sizeof(number), "%lld", value);
+		text_append(t, number, n);
+	}
+	free(expression.data);
+}
+
+/**
+ * Append the value of the expansion whose text is the n characters at s
+ * to t: a name, a name and an operator, or an arithmetic expression.
+ */
+static void param_eval(struct text *t, const char *s, size_t n, bool quoted,
+		bool pattern)
+{
+	const char *end = s + n, *name_end, *op, *value;
+	struct text word = { NULL, 0, 0 };
+	char number[24], kind, *name;
+	bool colon, longest = false, set;
+
+	if (s[0] == '(') {
+		arith_expand(t, s, n, NULL);
+		return;
+	}
+
+	if (s[0] == '#') {
+		value = lookup(s + 1, n - 1);
+		n = snprintf(number, sizeof(number), "%zu",
+				value != NULL ? strlen(value) : 0);
+		text_append(t, number, n);
+		return;
+	}
+
+	for (name_end = s; name_end < end && is_name_char(*name_end); name_end++)
+		;
+	value = lookup(s, name_end - s);
+	op = name_end;
+	if (op == end) {
+		if (value != NULL)
+			text_emit(t, value, strlen(value), quoted && pattern);
+		return;
+	}
+
+	colon = *op == ':';
+	op += colon;
+	kind = *op++;
+	if ((kind == '#' || kind == '%') && op < end && *op == kind) {
+		longest = true;
+		op++;
+	}
+
+	/* with ':', an empty value counts as unset */
+	set = value != NULL && (!colon || value[0] != '\0');
+
+	switch (kind) {
+	case '-':
+		if (set)
+			text_emit(t, value, strlen(value), quoted && pattern);
+		else
+			word_eval(t, op, end, quoted, pattern);
+		break;
+
+	case '=':
+		if (!set) {
+			text_append(&word, "", 0);
+			word_eval(&word, op, end, quoted, false);
+			name = strndup(s, name_end - s);
+			DIE(name == NULL, "Error allocating name.");
+			setenv(name, word.data, 1);
+			free(name);
+			value = word.data;
+		}
+		text_emit(t, value, strlen(value), quoted && pattern);
+		free(word.data);
+		break;
+
+	case '+':
+		if (set)
+			word_eval(t, op, end, quoted, pattern);
+		break;
+
+	default:
+		remove_affix(t, value != NULL ? value : "", kind, longest,
+				op, end, quoted, pattern);
+		break;
+	}
+}
+
+char *param_expand(word_t *part)
+{
+	struct text t = { NULL, 0, 0 };
+	size_t length = strlen(part->string);
+
+	text_append(&t, "", 0);
+	if (part->string[0] == '(')
+		arith_expand(&t, part->string, length, &part->aux);
+	else
+		param_eval(&t, part->string, length, part->quoted, false);
+
+	return t.data;
+}
+
+bool param_assigns(const char *string)
+{
+	return !param_is_name(string) &&
+		(strchr(string, '=') != NULL || strstr(string, "++") != NULL ||
+		 strstr(string, "--") != NULL);
+}
+
+bool param_word_assigns(word_t *word)
+{
+	word_t *part;
+
+	for (; word != NULL; word = word->next_word)
+		for (part = word; part != NULL; part = part->next_part)
+			if (part->expand && param_assigns(part->string))
+				return true;
+
+	return false;
+}
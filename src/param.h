@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _PARAM_H
+#define _PARAM_H
+
+#include "../util/parser/parser.h"
+
+/**
+ * Whether the string of an expansion part is just a variable name ("$name"
+ * or "${name}"), whose value is getenv(string); otherwise, it is the text
+ * of a "${...}" with an operator, which param_expand() evaluates.
+ */
+bool param_is_name(const char *string);
+
+/**
+ * The value of a "${...}" expansion part, whose text (between the braces)
+ * is its string: "#name", "name:-word", "name##pattern"... (see
+ * util/parser/parser.param.c), or of a "$((...))", whose string is
+ * "((...))" and whose compiled expression is kept in its aux (see
+ * arith_release()). A "name=word" or "name:=word" sets the variable, as
+ * the assignments of an arithmetic expression do. free() releases the
+ * value.
+ */
+char *param_expand(word_t *part);
+
+/**
+ * Whether the string of an expansion part may assign a variable, with
+ * "${name=word}", "${name:=word}" or an arithmetic assignment.
+ */
+bool param_assigns(const char *string);
+
+/**
+ * Whether a word of a command (any of its parts) may assign a variable.
+ */
+bool param_word_assigns(word_t *word);
+
+#endif /* _PARAM_H */
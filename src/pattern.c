@@ -0,0 +1,684 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "pattern.h"
+
+enum pattern_kind {
+	PATTERN_LITERAL,
+	PATTERN_ANY,
+	PATTERN_STAR,
+	PATTERN_SET
+};
+
+struct pattern_op {
+	enum pattern_kind kind;
+	uint32_t offset;	/* in text for a literal, in sets for a set */
+	uint32_t length;	/* of a literal */
+};
+
+/**
+ * The compiled form: a list of operations, with the literals unescaped in
+ * text and each "[...]" as a 256 bit set. Consecutive '*' are merged.
+ */
+struct pattern {
+	struct pattern_op *ops;
+	size_t count;
+	uint64_t (*sets)[4];
+	char *text;
+	size_t min_length;	/* the length that literals, '?' and sets take */
+	bool star;
+	bool magic;		/* not just a literal */
+};
+
+static void set_add(uint64_t *set, unsigned int c)
+{
+	set[c / 64] |= (uint64_t)1 << (c % 64);
+}
+
+static bool set_has(const uint64_t *set, unsigned char c)
+{
+	return set[c / 64] >> (c % 64) & 1;
+}
+
+/**
+ * Parse the "[...]" at s into set; return its length, or 0 if it is not
+ * closed (the '[' is then a literal).
+ */
+static size_t set_parse(const char *s, size_t n, uint64_t *set)
+{
+	unsigned int c, last;
+	bool negate = false;
+	size_t i = 1, start;
+
+	memset(set, 0, 4 * sizeof(*set));
+	if (i < n && (s[i] == '!' || s[i] == '^')) {
+		negate = true;
+		i++;
+	}
+
+	/* a ']' right after the '[' is in the set */
+	for (start = i; i < n && (s[i] != ']' || i == start); ) {
+		if (s[i] == '\\' && i + 1 < n)
+			i++;
+		c = last = (unsigned char)s[i++];
+
+		if (i + 1 < n && s[i] == '-' && s[i + 1] != ']') {
+			i++;
+			if (s[i] == '\\' && i + 1 < n)
+				i++;
+			last = (unsigned char)s[i++];
+		}
+		for (; c <= last; c++)
+			set_add(set, c);
+	}
+
+	if (i >= n)
+		return 0;
+
+	if (negate)
+		for (c = 0; c < 4; c++)
+			set[c] = ~set[c];
+
+	return i + 1;
+}
+
+static struct pattern_op *pattern_add(struct pattern *p,
+		enum pattern_kind kind, uint32_t offset)
+{
+	struct pattern_op *op = &p->ops[p->count++];
+
+	op->kind = kind;
+	op->offset = offset;
+	op->length = 0;
+	if (kind != PATTERN_LITERAL)
+		p->magic = true;
+	if (kind != PATTERN_STAR)
+		p->min_length++;
+
+	return op;
+}
+
+struct pattern *pattern_compile(const char *text, size_t length)
+{
+	/* each set takes 3 characters at least */
+	size_t set_count = length / 3 + 1;
+	struct pattern_op *last = NULL;
+	size_t i, set_length, text_length = 0;
+	struct pattern *p;
+	char c;
+
+	p = malloc(sizeof(*p) + set_count * sizeof(*p->sets) +
+			(length + 1) * sizeof(*p->ops) + length + 1);
+	DIE(p == NULL, "Error allocating pattern.");
+
+	p->sets = (void *)(p + 1);
+	p->ops = (void *)(p->sets + set_count);
+	p->text = (char *)(p->ops + length + 1);
+	p->count = 0;
+	p->min_length = 0;
+	p->star = p->magic = false;
+
+	set_count = 0;
+	for (i = 0; i < length; ) {
+		c = text[i];
+		set_length = c != '[' ? 0 :
+			set_parse(text + i, length - i, p->sets[set_count]);
+
+		if (c == '*') {
+			if (last == NULL || last->kind != PATTERN_STAR)
+				last = pattern_add(p, PATTERN_STAR, 0);
+			p->star = true;
+			i++;
+		} else if (c == '?') {
+			last = pattern_add(p, PATTERN_ANY, 0);
+			i++;
+		} else if (set_length != 0) {
+			i += set_length;
+			last = pattern_add(p, PATTERN_SET, set_count++);
+		} else {
+			if (c == '\\' && i + 1 < length)
+				c = text[++i];
+			i++;
+
+			if (last == NULL || last->kind != PATTERN_LITERAL)
+				last = pattern_add(p, PATTERN_LITERAL, text_length);
+			else
+				p->min_length++;
+			p->text[text_length++] = c;
+			last->length++;
+		}
+	}
+	p->text[text_length] = '\0';
+
+	return p;
+}
+
+void pattern_free(struct pattern *p)
+{
+	free(p);
+}
+
+/**
+ * Match ops [first, last) against the n characters at s: a '*' first
+ * takes nothing, then one more character each time the rest fails. When
+ * a literal follows the '*', it only stops where that literal is.
+ */
+static bool pattern_match_ops(const struct pattern *p, size_t first,
+		size_t last, const char *s, size_t n)
+{
+	const struct pattern_op *op, *star = NULL;
+	size_t i = first, j = 0, star_j = 0;
+	const char *found;
+
+	for (;;) {
+		if (i < last) {
+			op = &p->ops[i];
+
+			switch (op->kind) {
+			case PATTERN_STAR:
+				star = op;
+				star_j = j;
+				if (++i == last)
+					return true;
+				goto literal;
+			case PATTERN_ANY:
+				if (j < n) {
+					i++;
+					j++;
+					continue;
+				}
+				break;
+			case PATTERN_SET:
+				if (j < n && set_has(p->sets[op->offset], s[j])) {
+					i++;
+					j++;
+					continue;
+				}
+				break;
+			case PATTERN_LITERAL:
+				if (n - j >= op->length &&
+				    memcmp(s + j, p->text + op->offset,
+					   op->length) == 0) {
+					i++;
+					j += op->length;
+					continue;
+				}
+				break;
+			}
+		} else if (j == n) {
+			return true;
+		}
+
+		if (star == NULL || star_j >= n)
+			return false;
+		i = star - p->ops + 1;
+		star_j++;
+
+literal:
+		if (i < last && p->ops[i].kind == PATTERN_LITERAL) {
+			op = &p->ops[i];
+			found = memmem(s + star_j, n - star_j,
+					p->text + op->offset, op->length);
+			if (found == NULL)
+				return false;
+			star_j = found - s;
+		}
+		j = star_j;
+	}
+}
+
+bool pattern_match(const struct pattern *p, const char *s, size_t length)
+{
+	const struct pattern_op *op;
+	size_t first = 0, last = p->count;
+
+	if (length < p->min_length || (!p->star && length != p->min_length))
+		return false;
+
+	/* a literal prefix and suffix are compared in place */
+	op = &p->ops[first];
+	if (last > first && op->kind == PATTERN_LITERAL) {
+		if (memcmp(s, p->text + op->offset, op->length) != 0)
+			return false;
+		s += op->length;
+		length -= op->length;
+		first++;
+	}
+
+	op = &p->ops[last > first ? last - 1 : first];
+	if (last > first && op->kind == PATTERN_LITERAL) {
+		if (memcmp(s + length - op->length, p->text + op->offset,
+			   op->length) != 0)
+			return false;
+		length -= op->length;
+		last--;
+	}
+
+	return pattern_match_ops(p, first, last, s, length);
+}
+
+ssize_t pattern_affix(const struct pattern *p, const char *s, size_t length,
+		bool suffix, bool longest)
+{
+	/* only the lengths that the pattern may take are tried */
+	size_t min = p->min_length, max = p->star ? length : p->min_length;
+	size_t i, n;
+
+	if (min > length)
+		return -1;
+	if (max > length)
+		max = length;
+
+	for (i = 0; i <= max - min; i++) {
+		n = longest ? max - i : min + i;
+		if (pattern_match(p, suffix ? s + length - n : s, n))
+			return n;
+	}
+
+	return -1;
+}
+
+/*
+ * Directory listings
+ */
+
+#define GETDENTS_BUFFER_SIZE (256 * 1024)
+#define CACHE_BUCKETS 64
+
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+/**
+ * The entries of a directory but "." and "..": the names, '\0'
+ * terminated, are in a single buffer.
+ */
+struct directory {
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	struct timespec listed;
+	char *names;
+	size_t names_length;
+	size_t names_size;
+	size_t *offsets;
+	unsigned char *types;
+	size_t count;
+	size_t slots;
+	struct directory *next;
+};
+
+static struct directory *cache[CACHE_BUCKETS];
+static char *getdents_buffer;
+
+static size_t path_hash(const char *path)
+{
+	size_t hash = 2166136261u;
+
+	for (; *path != '\0'; path++)
+		hash = (hash ^ (unsigned char)*path) * 16777619u;
+
+	return hash % CACHE_BUCKETS;
+}
+
+static bool timespec_before(const struct timespec *a,
+		const struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec ||
+		(a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static void directory_add(struct directory *d, const char *name,
+		unsigned char type)
+{
+	size_t length = strlen(name) + 1;
+
+	if (d->count == d->slots) {
+		d->slots = d->slots == 0 ? 64 : 2 * d->slots;
+		d->offsets = realloc(d->offsets, d->slots * sizeof(size_t));
+		d->types = realloc(d->types, d->slots);
+		DIE(d->offsets == NULL || d->types == NULL,
+		    "Error allocating directory.");
+	}
+	if (d->names_length + length > d->names_size) {
+		while (d->names_length + length > d->names_size)
+			d->names_size = d->names_size == 0 ?
+				4096 : 2 * d->names_size;
+		d->names = realloc(d->names, d->names_size);
+		DIE(d->names == NULL, "Error allocating directory.");
+	}
+
+	memcpy(d->names + d->names_length, name, length);
+	d->offsets[d->count] = d->names_length;
+	d->types[d->count++] = type;
+	d->names_length += length;
+}
+
+/**
+ * (Re)read d from the file system, with getdents64() into a large buffer:
+ * a few system calls for a whole directory, and the types of the entries
+ * come with the names.
+ */
+static bool directory_read(struct directory *d)
+{
+	struct linux_dirent64 *entry;
+	struct stat st;
+	long n, i;
+	int fd;
+
+	if (getdents_buffer == NULL) {
+		getdents_buffer = malloc(GETDENTS_BUFFER_SIZE);
+		DIE(getdents_buffer == NULL, "Error allocating directory.");
+	}
+
+	fd = open(d->path[0] != '\0' ? d->path : ".",
+			O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	clock_gettime(CLOCK_REALTIME_COARSE, &d->listed);
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return false;
+	}
+	d->dev = st.st_dev;
+	d->ino = st.st_ino;
+	d->mtime = st.st_mtim;
+	d->names_length = 0;
+	d->count = 0;
+
+	while ((n = syscall(SYS_getdents64, fd, getdents_buffer,
+			    GETDENTS_BUFFER_SIZE)) > 0) {
+		for (i = 0; i < n; i += entry->d_reclen) {
+			entry = (void *)(getdents_buffer + i);
+			if (entry->d_name[0] == '.' &&
+			    (entry->d_name[1] == '\0' ||
+			     (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+				continue;
+			directory_add(d, entry->d_name, entry->d_type);
+		}
+	}
+	close(fd);
+
+	return n == 0;
+}
+
+static void directory_free(struct directory *d)
+{
+	free(d->path);
+	free(d->names);
+	free(d->offsets);
+	free(d->types);
+	free(d);
+}
+
+/**
+ * The listing of the directory at path ("" for the current one), read
+ * once per command line. A cached listing is used again while the
+ * directory is the same, with the same mtime; and only if that mtime is
+ * before the listing was taken, as a change in the same clock tick would
+ * not move it.
+ */
+static struct directory *directory_get(const char *path)
+{
+	size_t bucket = path_hash(path);
+	struct directory *d;
+	struct stat st;
+
+	for (d = cache[bucket]; d != NULL; d = d->next)
+		if (strcmp(d->path, path) == 0)
+			break;
+
+	if (d != NULL) {
+		if (stat(path[0] != '\0' ? path : ".", &st) == 0 &&
+		    st.st_dev == d->dev && st.st_ino == d->ino &&
+		    st.st_mtim.tv_sec == d->mtime.tv_sec &&
+		    st.st_mtim.tv_nsec == d->mtime.tv_nsec &&
+		    timespec_before(&d->mtime, &d->listed))
+			return d;
+	} else {
+		d = calloc(1, sizeof(*d));
+		DIE(d == NULL, "Error allocating directory.");
+		d->path = strdup(path);
+		DIE(d->path == NULL, "Error allocating directory.");
+		d->next = cache[bucket];
+		cache[bucket] = d;
+	}
+
+	if (!directory_read(d))
+		d->count = 0;
+
+	return d;
+}
+
+void pathname_cache_clear(void)
+{
+	struct directory *d, *next;
+	size_t i;
+
+	for (i = 0; i < CACHE_BUCKETS; i++) {
+		for (d = cache[i]; d != NULL; d = next) {
+			next = d->next;
+			directory_free(d);
+		}
+		cache[i] = NULL;
+	}
+}
+
+/*
+ * Pathname expansion
+ */
+
+/**
+ * A pattern split at the '/': the components, compiled, with the '/' that
+ * follow them; and the path matched so far, which ends with a '/' (or is
+ * "" in the current directory). A trailing '/' is a last component with
+ * no pattern.
+ */
+struct component {
+	struct pattern *pattern;
+	const char *slashes;
+	size_t slash_count;
+};
+
+struct expansion {
+	struct component *components;
+	size_t count;
+	struct strlist matches;
+	char *path;
+	size_t length;
+	size_t size;
+};
+
+static void path_add(struct expansion *e, const char *s, size_t length)
+{
+	if (e->length + length + 1 > e->size) {
+		while (e->length + length + 1 > e->size)
+			e->size = e->size == 0 ? 256 : 2 * e->size;
+		e->path = realloc(e->path, e->size);
+		DIE(e->path == NULL, "Error allocating path.");
+	}
+
+	memcpy(e->path + e->length, s, length);
+	e->length += length;
+	e->path[e->length] = '\0';
+}
+
+static bool is_directory(const char *path, unsigned char type)
+{
+	struct stat st;
+
+	if (type == DT_DIR)
+		return true;
+	if (type != DT_UNKNOWN && type != DT_LNK)
+		return false;
+
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void expand(struct expansion *e, size_t i);
+
+/**
+ * The path matches component i: it is a result if that is the last one
+ * (the pattern may end with a '/', and then only directories match);
+ * otherwise the expansion goes on in it, if it is a directory.
+ */
+static void expand_match(struct expansion *e, size_t i, unsigned char type)
+{
+	if (i + 1 == e->count) {
+		strlist_add(&e->matches, e->path, e->length);
+	} else if (is_directory(e->path, type)) {
+		path_add(e, e->components[i].slashes,
+				e->components[i].slash_count);
+		if (i + 2 == e->count && e->components[i + 1].pattern == NULL)
+			strlist_add(&e->matches, e->path, e->length);
+		else
+			expand(e, i + 1);
+	}
+}
+
+static void expand(struct expansion *e, size_t i)
+{
+	const struct pattern *p = e->components[i].pattern;
+	size_t length = e->length;
+	struct directory *d;
+	struct stat st;
+	const char *name;
+	bool dot;
+	size_t k;
+
+	if (!p->magic) {
+		path_add(e, p->text, p->ops[0].length);
+		if (i + 1 < e->count || lstat(e->path, &st) == 0)
+			expand_match(e, i, DT_UNKNOWN);
+		e->length = length;
+		return;
+	}
+
+	/* a leading '.' is only matched by a '.' */
+	dot = p->count > 0 && p->ops[0].kind == PATTERN_LITERAL &&
+		p->text[p->ops[0].offset] == '.';
+
+	d = directory_get(e->path);
+	for (k = 0; k < d->count; k++) {
+		name = d->names + d->offsets[k];
+		if ((name[0] == '.' && !dot) ||
+		    !pattern_match(p, name, strlen(name)))
+			continue;
+
+		path_add(e, name, strlen(name));
+		expand_match(e, i, d->types[k]);
+		e->length = length;
+	}
+}
+
+/**
+ * The sort key: the first 8 bytes, in order, then the rest of the path
+ * when they are equal; this is strcmp() order, the C locale.
+ */
+struct sorted {
+	uint64_t key;
+	const char *path;
+	size_t length;
+};
+
+static int sorted_compare(const void *a, const void *b)
+{
+	const struct sorted *x = a, *y = b;
+
+	if (x->key != y->key)
+		return x->key < y->key ? -1 : 1;
+	/* the same key, with a '\0' in it: the same path */
+	if (x->length < 8 || y->length < 8)
+		return 0;
+
+	return strcmp(x->path + 8, y->path + 8);
+}
+
+static void matches_sort(const struct strlist *matches, struct strlist *list)
+{
+	struct sorted *sorted;
+	const char *path;
+	size_t i, k;
+
+	sorted = malloc(matches->count * sizeof(*sorted));
+	DIE(sorted == NULL, "Error allocating matches.");
+
+	for (i = 0; i < matches->count; i++) {
+		path = strlist_get(matches, i);
+		sorted[i].path = path;
+		sorted[i].length = strlen(path);
+		sorted[i].key = 0;
+		for (k = 0; k < 8 && path[k] != '\0'; k++)
+			sorted[i].key |= (uint64_t)(unsigned char)path[k] << (56 - 8 * k);
+	}
+
+	qsort(sorted, matches->count, sizeof(*sorted), sorted_compare);
+	for (i = 0; i < matches->count; i++)
+		strlist_add(list, sorted[i].path, sorted[i].length);
+
+	free(sorted);
+}
+
+size_t pathname_expand(const char *pattern, struct strlist *list)
+{
+	struct expansion e = { NULL, 0, STRLIST_INIT, NULL, 0, 0 };
+	const char *component, *end;
+	bool magic = false;
+	size_t i, count;
+
+	/* one component per '/' at most, the trailing one included */
+	for (end = pattern; *end != '\0'; end++)
+		e.count += *end == '/';
+	e.components = calloc(e.count + 1, sizeof(*e.components));
+	DIE(e.components == NULL, "Error allocating pattern.");
+
+	path_add(&e, "", 0);
+	while (*pattern == '/')
+		path_add(&e, pattern++, 1);
+
+	for (e.count = 0, component = pattern; *component != '\0'; ) {
+		end = strchrnul(component, '/');
+		e.components[e.count].pattern = pattern_compile(component,
+				end - component);
+		magic |= e.components[e.count].pattern->magic;
+
+		for (component = end; *component == '/'; component++)
+			;
+		e.components[e.count].slashes = end;
+		e.components[e.count++].slash_count = component - end;
+		if (*end != '\0' && *component == '\0')
+			e.count++;
+	}
+
+	if (magic)
+		expand(&e, 0);
+
+	count = e.matches.count;
+	if (count > 0)
+		matches_sort(&e.matches, list);
+
+	for (i = 0; i < e.count; i++)
+		if (e.components[i].pattern != NULL)
+			pattern_free(e.components[i].pattern);
+	free(e.components);
+	free(e.path);
+	strlist_free(&e.matches);
+
+	return count;
+}
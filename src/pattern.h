@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _PATTERN_H
+#define _PATTERN_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "utils.h"
+
+/**
+ * A shell pattern, compiled once and then matched against any number of
+ * strings: '*' matches any string, '?' any character, "[...]" one of a
+ * set of characters ("[!...]" or "[^...]" one that is not in it, "a-z" a
+ * range); a backslash makes the next character literal.
+ */
+struct pattern;
+
+struct pattern *pattern_compile(const char *text, size_t length);
+bool pattern_match(const struct pattern *p, const char *s, size_t length);
+void pattern_free(struct pattern *p);
+
+/**
+ * The length of the shortest (or longest) prefix of the length characters
+ * at s that p matches, or of their suffix if suffix is set; -1 if none
+ * does.
+ */
+ssize_t pattern_affix(const struct pattern *p, const char *s, size_t length,
+		bool suffix, bool longest);
+
+/**
+ * Pathname expansion: add the paths that match pattern to list, sorted
+ * byte by byte, and return their number (0 if there is none, or if the
+ * pattern has no '*', '?' nor "[...]").
+ */
+size_t pathname_expand(const char *pattern, struct strlist *list);
+
+/**
+ * Forget the directories read by pathname_expand(): each one is read
+ * once per command line, however many patterns use it.
+ */
+void pathname_cache_clear(void);
+
+#endif /* _PATTERN_H */
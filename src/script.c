@@ -0,0 +1,303 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arith.h"
+#include "cmd.h"
+#include "pattern.h"
+#include "script.h"
+#include "utils.h"
+
+/* Lines parsed by a worker at a time, into one parse context */
+#define BLOCK_LINES		1024
+#define MAX_WORKERS		64
+#define READ_CHUNK		(64 * 1024)
+
+#define EXIT_SYNTAX_ERROR	2
+
+struct script_line {
+	char *text;
+	size_t number;		/* of its first line in the file */
+	command_t *root;
+	const char *error;
+	int where;
+};
+
+struct script_block {
+	parse_context_t *ctx;
+	size_t first;
+	size_t count;
+};
+
+struct script {
+	char *data;
+	struct script_line *lines;
+	size_t line_count;
+	struct script_block *blocks;
+	size_t block_count;
+	size_t next_block;	/* shared by the workers */
+	bool check_only;
+};
+
+/**
+ * Read the whole file (or stdin) in memory, NUL-terminated.
+ */
+static char *read_script(const char *path, size_t *size)
+{
+	size_t capacity = READ_CHUNK, length = 0;
+	struct stat st;
+	char *data;
+	ssize_t n;
+	int fd;
+
+	fd = path != NULL ? open(path, O_RDONLY) : STDIN_FILENO;
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+		capacity = st.st_size + 1;
+
+	data = malloc(capacity);
+	DIE(data == NULL, "malloc");
+
+	for (;;) {
+		if (length + 1 == capacity) {
+			capacity *= 2;
+			data = realloc(data, capacity);
+			DIE(data == NULL, "realloc");
+		}
+
+		n = read(fd, data + length, capacity - 1 - length);
+		DIE(n < 0, "read");
+		if (n == 0)
+			break;
+		length += n;
+	}
+
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	data[length] = '\0';
+	*size = length;
+
+	return data;
+}
+
+/**
+ * Split the script in NUL-terminated command lines (without the final
+ * "\n" or "\r\n"), which may span several lines of the file (see
+ * parse_scan()), and group them in blocks.
+ */
+static void split_script(struct script *script, size_t size)
+{
+	char *p, *end = script->data + size, *eol, *start;
+	size_t count = 0, number = 0, first = 1, i;
+	struct script_line *line;
+	parse_scan_t scan;
+
+	for (p = script->data; p < end; p = eol + 1) {
+		eol = memchr(p, '\n', end - p);
+		count++;
+		if (eol == NULL)
+			break;
+	}
+
+	script->lines = calloc(count + 1, sizeof(*script->lines));
+	DIE(script->lines == NULL, "calloc");
+
+	memset(&scan, 0, sizeof(scan));
+	for (start = p = script->data; p < end; p = eol + 1) {
+		eol = memchr(p, '\n', end - p);
+		if (eol == NULL)
+			eol = end;
+		number++;
+
+		/* the command goes on in the next line */
+		if (eol != end && parse_scan(&scan, p, eol + 1 - p))
+			continue;
+
+		if (eol > start && eol[-1] == '\r')
+			eol[-1] = '\0';
+		*eol = '\0';
+
+		line = &script->lines[script->line_count++];
+		line->text = start;
+		line->number = first;
+		start = eol + 1;
+		first = number + 1;
+	}
+
+	/* the file ends in the middle of a command, the parser tells */
+	if (start < end) {
+		line = &script->lines[script->line_count++];
+		line->text = start;
+		line->number = first;
+	}
+
+	script->block_count = (script->line_count + BLOCK_LINES - 1) / BLOCK_LINES;
+	script->blocks = calloc(script->block_count + 1, sizeof(*script->blocks));
+	DIE(script->blocks == NULL, "calloc");
+
+	for (i = 0; i < script->block_count; i++) {
+		script->blocks[i].first = i * BLOCK_LINES;
+		script->blocks[i].count = BLOCK_LINES;
+	}
+	if (script->block_count != 0)
+		script->blocks[script->block_count - 1].count =
+			script->line_count - (script->block_count - 1) * BLOCK_LINES;
+}
+
+static void parse_block(struct script *script, struct script_block *block)
+{
+	struct script_line *line;
+	size_t i;
+
+	block->ctx = parse_context_new();
+
+	for (i = 0; i < block->count; i++) {
+		line = &script->lines[block->first + i];
+		if (!parse_context_line(block->ctx, line->text, &line->root))
+			line->error = parse_context_error(block->ctx, &line->where);
+	}
+
+	/* the trees are not needed */
+	if (script->check_only) {
+		parse_context_free(block->ctx);
+		block->ctx = NULL;
+	}
+}
+
+/**
+ * Worker: parse the next block nobody took yet, until there is none.
+ */
+static void *parse_blocks(void *arg)
+{
+	struct script *script = arg;
+	size_t i;
+
+	for (;;) {
+		i = __atomic_fetch_add(&script->next_block, 1, __ATOMIC_RELAXED);
+		if (i >= script->block_count)
+			break;
+		parse_block(script, &script->blocks[i]);
+	}
+
+	return NULL;
+}
+
+static void parse_script(struct script *script)
+{
+	const char *env = getenv("MINISHELL_PARSE_THREADS");
+	pthread_t workers[MAX_WORKERS];
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	long i;
+	int rc;
+
+	if (env != NULL && atol(env) > 0)
+		count = atol(env);
+	if (count > MAX_WORKERS)
+		count = MAX_WORKERS;
+	if (count > (long)script->block_count)
+		count = script->block_count;
+
+	/* the calling thread is one of the workers */
+	for (i = 1; i < count; i++) {
+		rc = pthread_create(&workers[i], NULL, parse_blocks, script);
+		DIE(rc != 0, "pthread_create");
+	}
+
+	parse_blocks(script);
+
+	for (i = 1; i < count; i++)
+		pthread_join(workers[i], NULL);
+}
+
+/**
+ * Report all the syntax errors, in order.
+ */
+static bool check_script(struct script *script, const char *name)
+{
+	bool ok = true;
+	size_t i;
+
+	for (i = 0; i < script->line_count; i++) {
+		if (script->lines[i].error == NULL)
+			continue;
+
+		fprintf(stderr, "%s: line %zu: Parse error near %d: %s\n", name,
+			script->lines[i].number, script->lines[i].where,
+			script->lines[i].error);
+		ok = false;
+	}
+
+	return ok;
+}
+
+static int execute_script(struct script *script)
+{
+	struct script_block *block;
+	command_t *root;
+	size_t b, i;
+	int ret;
+
+	for (b = 0; b < script->block_count; b++) {
+		block = &script->blocks[b];
+
+		for (i = 0; i < block->count; i++) {
+			root = script->lines[block->first + i].root;
+			if (root == NULL)
+				continue;
+
+			ret = parse_command(root, 0, NULL);
+			pathname_cache_clear();
+			if (ret == SHELL_EXIT)
+				return EXIT_SUCCESS;
+		}
+
+		arith_release();
+		parse_context_free(block->ctx);
+		block->ctx = NULL;
+	}
+
+	/* as for the interactive shell */
+	return EXIT_SUCCESS;
+}
+
+int run_script(const char *path, bool check_only)
+{
+	struct script script;
+	size_t size, i;
+	int ret;
+
+	memset(&script, 0, sizeof(script));
+	script.check_only = check_only;
+
+	script.data = read_script(path, &size);
+	if (script.data == NULL) {
+		perror(path);
+		return EXIT_FAILURE;
+	}
+
+	split_script(&script, size);
+	parse_script(&script);
+
+	if (!check_script(&script, path != NULL ? path : "stdin"))
+		ret = EXIT_SYNTAX_ERROR;
+	else if (check_only)
+		ret = EXIT_SUCCESS;
+	else
+		ret = execute_script(&script);
+
+	for (i = 0; i < script.block_count; i++)
+		parse_context_free(script.blocks[i].ctx);
+	free(script.blocks);
+	free(script.lines);
+	free(script.data);
+
+	return ret;
+}
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _SCRIPT_H
+#define _SCRIPT_H
+
+#include <stdbool.h>
+
+/**
+ * Run a script file (stdin if path is NULL). All its lines are parsed up
+ * front, in parallel, and nothing runs if one of them has a syntax error;
+ * with check_only, the script is only parsed.
+ * Returns the exit status of the shell.
+ */
+int run_script(const char *path, bool check_only);
+
+#endif /* _SCRIPT_H */
@@ -1,10 +1,73 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "utils.h"
+#include "brace.h"
+#include "cmd.h"
+#include "ifs.h"
+#include "param.h"
+#include "pattern.h"
+
+/**
+ * Add the n characters at s to the string at the end of the buffer, which
+ * strlist_close() adds to the list; the buffer is a growing string too.
+ */
+static void strlist_append(struct strlist *list, const char *s, size_t n)
+{
+	if (list->length + n + 1 > list->size) {
+		while (list->length + n + 1 > list->size)
+			list->size = list->size == 0 ? 256 : 2 * list->size;
+		list->buffer = realloc(list->buffer, list->size);
+		DIE(list->buffer == NULL, "Error allocating list.");
+	}
+
+	memcpy(list->buffer + list->length, s, n);
+	list->length += n;
+	list->buffer[list->length] = '\0';
+}
+
+static void strlist_close(struct strlist *list, size_t start)
+{
+	if (list->count == list->slots) {
+		list->slots = list->slots == 0 ? 16 : 2 * list->slots;
+		list->offsets = realloc(list->offsets,
+				list->slots * sizeof(size_t));
+		DIE(list->offsets == NULL, "Error allocating list.");
+	}
+
+	list->offsets[list->count++] = start;
+	list->length++;
+}
+
+void strlist_add(struct strlist *list, const char *s, size_t length)
+{
+	size_t start = list->length;
+
+	strlist_append(list, s, length);
+	strlist_close(list, start);
+}
+
+void strlist_free(struct strlist *list)
+{
+	free(list->buffer);
+	free(list->offsets);
+}
+
+/**
+ * Run the command of a substitution part: the value is its output for
+ * "$(command)" (kind ""), a /dev/fd path for "<(command)" and ">(command)".
+ */
+static char *substitute(command_t *c, const char *kind)
+{
+	if (kind[0] == '\0')
+		return run_substitution(c);
+
+	return run_process_substitution(c, kind[0] == '>');
+}
 
 /**
  * Concatenate parts of the word to obtain the command.
@@ -16,9 +79,16 @@ char *get_word(word_t *s)
 
 	const char *substring = NULL;
 	int substring_length = 0;
+	char *output = NULL;
 
 	while (s != NULL) {
-		if (s->expand == true) {
+		if (s->command != NULL) {
+			output = substitute(s->command, s->string);
+			substring = output;
+		} else if (s->expand && !param_is_name(s->string)) {
+			output = param_expand(s);
+			substring = output;
+		} else if (s->expand == true) {
 			substring = getenv(s->string);
 
 			/* Prevents strlen from failing. */
@@ -38,49 +108,593 @@ char *get_word(word_t *s)
 
 		string_length += substring_length;
 
+		free(output);
+		output = NULL;
+
 		s = s->next_part;
 	}
 
 	return string;
 }
 
+static const char *part_value(const char *string, bool expand)
+{
+	const char *value;
+
+	if (!expand)
+		return string;
+
+	value = getenv(string);
+	return value != NULL ? value : "";
+}
+
+/**
+ * The values of the substitution parts of a command, and of its "${...}"
+ * with an operator and "$((...))": they are evaluated while sizing argv,
+ * in order, and the copy takes the outputs in the same order. Once an
+ * expansion may have assigned a variable, the values of the variables
+ * are outputs too, so that each one is read where it is, as in
+ * "$((i++)) $i".
+ */
+struct outputs {
+	char **values;
+	int count;
+	int size;
+	int next;
+	bool variables;	/* in the pass, reset by each one */
+};
+
+#define OUTPUTS_INIT { NULL, 0, 0, 0, false }
+
+/**
+ * Whether the value of a part is one of the outputs, rather than a text
+ * or the value of a variable. Each pass asks for each part, in order.
+ */
+static bool part_has_output(struct outputs *o, const char *string,
+		bool expand, bool command)
+{
+	if (command)
+		return true;
+	if (!expand)
+		return false;
+	if (param_is_name(string))
+		return o->variables;
+
+	o->variables |= param_assigns(string);
+	return true;
+}
+
+/**
+ * The value of an expansion part that is an output.
+ */
+static char *output_expand(word_t *part)
+{
+	char *value;
+
+	if (!param_is_name(part->string))
+		return param_expand(part);
+
+	value = strdup(part_value(part->string, true));
+	DIE(value == NULL, "Error allocating substitutions.");
+	return value;
+}
+
+static const char *output_add(struct outputs *o, char *value)
+{
+	if (o->count == o->size) {
+		o->size = o->size == 0 ? 4 : 2 * o->size;
+		o->values = realloc(o->values, o->size * sizeof(char *));
+		DIE(o->values == NULL, "Error allocating substitutions.");
+	}
+
+	o->values[o->count] = value;
+	return o->values[o->count++];
+}
+
+/**
+ * The value of a part in the sizing pass: its substitution is run, or its
+ * "${...}" evaluated.
+ */
+static const char *part_run_value(word_t *part, struct outputs *o)
+{
+	if (part->command != NULL)
+		return output_add(o, substitute(part->command, part->string));
+	if (part_has_output(o, part->string, part->expand, false))
+		return output_add(o, output_expand(part));
+
+	return part_value(part->string, part->expand);
+}
+
+static const char *output_next(struct outputs *o)
+{
+	return o->values[o->next++];
+}
+
+/**
+ * Whether the value of a part may need to be expanded: it has pattern
+ * characters that are not quoted, or brace groups if it is a literal; or
+ * it is split into fields (none, if it is empty).
+ */
+static bool part_needs_expansion(const char *value, size_t length,
+		bool quoted, bool literal, bool split, const struct ifs *ifs)
+{
+	if (quoted)
+		return false;
+	if (strpbrk(value, literal ? "*?[{" : "*?[") != NULL)
+		return true;
+
+	return split &&
+		(length == 0 || ifs_find(ifs, value, value + length) != value + length);
+}
+
+/**
+ * Whether a part is split into fields: an expansion that is not quoted
+ * ("<(...)" and ">(...)" are paths).
+ */
+static bool part_is_split(bool quoted, bool expand, bool command,
+		const char *string)
+{
+	if (quoted)
+		return false;
+	return command ? string[0] == '\0' : expand;
+}
+
+/**
+ * The field being expanded: its value is written at the end of the
+ * argument list, from start, and it is also built as a pattern, where
+ * the quoted characters are escaped.
+ */
+struct field {
+	struct strlist *args;
+	size_t start;
+	struct strlist pattern;
+	bool exists;	/* a field, even if empty (e.g. "") */
+	bool magic;
+};
+
+/* The characters that are escaped in the pattern when they are quoted */
+static bool is_pattern_char(char c)
+{
+	return c == '\\' || c == '*' || c == '?' || c == '[';
+}
+
+static void field_add(struct field *f, const char *s, size_t n, bool quoted)
+{
+	size_t i, k;
+
+	strlist_append(f->args, s, n);
+	f->exists |= quoted || n > 0;
+
+	for (i = 0; i < n; i = k) {
+		k = i + 1;
+		if (!is_pattern_char(s[i])) {
+			/* the run of ordinary characters */
+			while (k < n && !is_pattern_char(s[k]))
+				k++;
+		} else if (quoted) {
+			strlist_append(&f->pattern, "\\", 1);
+		} else {
+			f->magic |= s[i] != '\\';
+		}
+		strlist_append(&f->pattern, s + i, k - i);
+	}
+}
+
+/**
+ * End the field: it becomes an argument, or the pathnames it matches if
+ * it is a pattern; return whether it did. A field that does not exist
+ * (e.g. an empty variable) is dropped.
+ */
+static bool field_end(struct field *f)
+{
+	size_t length = f->args->length;
+	bool expanded = false;
+
+	if (!f->exists) {
+		f->args->length = f->start;
+	} else if (f->magic) {
+		/* the matches replace the value; none leaves it as it is */
+		f->args->length = f->start;
+		expanded = pathname_expand(f->pattern.buffer, f->args) != 0;
+		if (!expanded) {
+			f->args->length = length;
+			strlist_close(f->args, f->start);
+		}
+	} else {
+		strlist_close(f->args, f->start);
+	}
+
+	f->start = f->args->length;
+	f->pattern.length = 0;
+	strlist_append(&f->pattern, "", 0);
+	f->exists = f->magic = false;
+
+	return expanded;
+}
+
+/**
+ * Add the value of an expansion to the field, split on IFS: each run of
+ * IFS white space, with at most one other IFS character in it, ends the
+ * field. White space only ends a field that has begun, but the other
+ * characters also end empty ones ("a::b" is 3 fields with IFS=":").
+ * Return whether a field was expanded to pathnames.
+ */
+static bool field_split(struct field *f, const struct ifs *ifs,
+		const char *s, size_t n)
+{
+	const char *end = s + n, *separator;
+	bool expanded = false, hard;
+
+	if (ifs->empty) {
+		field_add(f, s, n, false);
+		return false;
+	}
+
+	while (s < end) {
+		separator = ifs_find(ifs, s, end);
+		field_add(f, s, separator - s, false);
+		if (separator == end)
+			break;
+
+		hard = false;
+		for (s = separator; s < end && ifs_is_separator(ifs, *s); s++) {
+			if (!ifs_is_space(ifs, *s)) {
+				if (hard)
+					break;
+				hard = true;
+			}
+		}
+
+		f->exists |= hard;
+		expanded |= field_end(f);
+	}
+
+	return expanded;
+}
+
+/**
+ * Add the fields of a word, made of the current items of w, to the
+ * argument list. Return whether the word was expanded to pathnames.
+ */
+static bool word_expand(struct field *f, const struct brace_word *w,
+		const struct ifs *ifs)
+{
+	const struct brace_segment *seg;
+	bool expanded = false;
+
+	for (seg = w->segments; seg != w->segments + w->count; seg++) {
+		if (seg->split)
+			expanded |= field_split(f, ifs, seg->item,
+					seg->item_length);
+		else
+			field_add(f, seg->item, seg->item_length, seg->quoted);
+	}
+
+	return field_end(f) || expanded;
+}
+
+/* An argv and the size of its allocation, see argv_alloc() */
+struct argv_block {
+	size_t size;
+	char *argv[];
+};
+
+/* The largest argv released, kept for the next one */
+static struct argv_block *spare_argv;
+
+/**
+ * Allocate an argv of count pointers followed by length bytes of strings:
+ * the one released last, if it is large enough, so the commands of a loop
+ * do not allocate theirs again and again.
+ */
+static char **argv_alloc(size_t count, size_t length)
+{
+	size_t size = count * sizeof(char *) + length;
+	struct argv_block *block = spare_argv;
+
+	if (block != NULL && block->size >= size) {
+		spare_argv = NULL;
+		return block->argv;
+	}
+
+	block = malloc(sizeof(*block) + size);
+	DIE(block == NULL, "Error allocating argv.");
+	block->size = size;
+
+	return block->argv;
+}
+
+void argv_free(char **argv)
+{
+	struct argv_block *block;
+
+	if (argv == NULL)
+		return;
+
+	block = (struct argv_block *)((char *)argv -
+				      offsetof(struct argv_block, argv));
+	if (spare_argv != NULL && spare_argv->size >= block->size) {
+		free(block);
+		return;
+	}
+
+	free(spare_argv);
+	spare_argv = block;
+}
+
+/**
+ * get_argv() for a command whose words need more than their values, once
+ * its substitutions ran: each word is generated once per item of its
+ * brace groups, its unquoted expansions are split into fields, and each
+ * field is replaced by the pathnames it matches, if it is a pattern. The
+ * fields are written straight into the argument list.
+ */
+static char **get_argv_expand(simple_command_t *command, struct outputs *o,
+		const struct ifs *ifs, int *size, struct argv_span *span)
+{
+	// kept from one command to the next, which then allocates nothing
+	static struct strlist args = STRLIST_INIT;
+	static struct field field = { &args, 0, STRLIST_INIT, false, false };
+	static struct brace_word braces = BRACE_WORD_INIT;
+	word_t *word, *part;
+	bool expanded, split;
+	size_t i, count;
+	const char *s;
+	char **argv;
+	int flags;
+
+	args.length = args.count = 0;
+	field.start = field.pattern.length = 0;
+	field.exists = field.magic = false;
+	strlist_append(&field.pattern, "", 0);
+	o->variables = false;
+
+	for (word = command->verb; word != NULL;
+	     word = word == command->verb ? command->params : word->next_word) {
+		brace_clear(&braces);
+		expanded = false;
+		for (part = word; part != NULL; part = part->next_part) {
+			s = part_has_output(o, part->string, part->expand,
+					part->command != NULL) ? output_next(o) :
+				part_value(part->string, part->expand);
+
+			split = part_is_split(part->quoted, part->expand,
+					part->command != NULL, part->string);
+			flags = split ? BRACE_SPLIT : 0;
+			if (part->quoted)
+				flags |= BRACE_QUOTED;
+			else if (!part->expand && part->command == NULL)
+				flags |= BRACE_GROUPS;
+			expanded |= split;
+
+			brace_add(&braces, s, strlen(s), flags);
+		}
+
+		count = args.count;
+		expanded |= braces.groups;
+		brace_start(&braces);
+		do {
+			expanded |= word_expand(&field, &braces, ifs);
+		} while (brace_next(&braces));
+
+		if (expanded && args.count > count) {
+			if (span->first == span->last)
+				span->first = count;
+			span->last = args.count;
+		}
+	}
+
+	argv = argv_alloc(args.count + 1, args.length);
+
+	memcpy(argv + args.count + 1, args.buffer, args.length);
+	for (i = 0; i < args.count; i++)
+		argv[i] = (char *)(argv + args.count + 1) + args.offsets[i];
+	argv[args.count] = NULL;
+
+	*size = args.count;
+
+	return argv;
+}
+
+static void outputs_free(struct outputs *o)
+{
+	int i;
+
+	for (i = 0; i < o->count; i++)
+		free(o->values[i]);
+	free(o->values);
+}
+
+/**
+ * Length of a word of the flat tree, with its variables expanded and its
+ * substitutions run.
+ */
+static size_t flat_word_length(const flat_tree_t *tree, const flat_word_t *w,
+		struct outputs *o, const struct ifs *ifs, bool *magic)
+{
+	const flat_part_t *p;
+	const char *value, *string;
+	size_t length = 0, n;
+
+	flat_for_each_part(tree, w, p) {
+		string = flat_part_string(tree, p);
+		if (p->command != 0)
+			value = output_add(o, substitute(
+					tree->nodes[p->command - 1].view, string));
+		else if (part_has_output(o, string, p->expand, false))
+			value = output_add(o, output_expand(p->view));
+		else
+			value = part_value(string, p->expand);
+
+		n = p->command != 0 || p->expand ? strlen(value) : p->length;
+		length += n;
+		*magic |= part_needs_expansion(value, n, p->quoted,
+				!p->expand && p->command == 0,
+				part_is_split(p->quoted, p->expand, p->command != 0,
+					      string), ifs);
+	}
+
+	return length;
+}
+
+/**
+ * Copy a word of the flat tree to dest; return the end of the copy.
+ */
+static char *flat_word_copy(const flat_tree_t *tree, const flat_word_t *w,
+		char *dest, struct outputs *o)
+{
+	const flat_part_t *p;
+	const char *value;
+	size_t length;
+
+	flat_for_each_part(tree, w, p) {
+		if (part_has_output(o, flat_part_string(tree, p), p->expand,
+				    p->command != 0)) {
+			value = output_next(o);
+			length = strlen(value);
+		} else {
+			value = part_value(flat_part_string(tree, p), p->expand);
+			length = p->expand ? strlen(value) : p->length;
+		}
+		memcpy(dest, value, length);
+		dest += length;
+	}
+	*dest++ = '\0';
+
+	return dest;
+}
+
+/**
+ * get_argv() for a simple command of the flat tree: the verb and params
+ * are consecutive, so this is a linear scan over the tree's buffers.
+ */
+static char **get_argv_flat(const flat_tree_t *tree, const flat_node_t *node,
+		const struct ifs *ifs, int *size, struct argv_span *span)
+{
+	struct outputs outputs = OUTPUTS_INIT;
+	const flat_word_t *w, *end;
+	bool magic = false;
+	size_t length;
+	char **argv;
+	char *dest;
+	int argc;
+
+	argc = node->param_count + 1;
+	end = flat_verb(tree, node) + argc;
+
+	length = 0;
+	for (w = flat_verb(tree, node); w != end; w++)
+		length += flat_word_length(tree, w, &outputs, ifs, &magic) + 1;
+
+	if (magic) {
+		argv = get_argv_expand(node->view->scmd, &outputs, ifs, size,
+				span);
+		outputs_free(&outputs);
+		return argv;
+	}
+
+	argv = argv_alloc(argc + 1, length);
+
+	dest = (char *)(argv + argc + 1);
+	outputs.variables = false;
+	for (w = flat_verb(tree, node); w != end; w++) {
+		argv[w - flat_verb(tree, node)] = dest;
+		dest = flat_word_copy(tree, w, dest, &outputs);
+	}
+	argv[argc] = NULL;
+
+	outputs_free(&outputs);
+
+	*size = argc;
+
+	return argv;
+}
+
 /**
  * Concatenate command arguments in a NULL terminated list in order to pass
  * them directly to execv.
+ *
+ * The list and the strings are a single allocation: argv_free(argv)
+ * releases everything.
  */
-char **get_argv(simple_command_t *command, int *size)
+char **get_argv_span(simple_command_t *command, int *size,
+		struct argv_span *span)
 {
+	const flat_tree_t *tree = parse_flat_tree();
+	struct outputs outputs = OUTPUTS_INIT;
+	word_t *param, *part;
+	bool magic = false;
+	const char *value;
+	size_t length, n;
+	struct ifs ifs;
 	char **argv;
+	char *dest;
 	int argc;
 
-	word_t *param;
+	span->first = span->last = 0;
+	ifs_load(&ifs);
 
-	argc = 1;
+	// trees copied out of the parser (e.g. function bodies) are not in it
+	if (tree != NULL && command->up->flat_index < tree->node_count &&
+	    tree->nodes[command->up->flat_index].view == command->up)
+		return get_argv_flat(tree, &tree->nodes[command->up->flat_index],
+				&ifs, size, span);
 
-	/* Get parameters number. */
-	param = command->params;
-	while (param != NULL) {
-		param = param->next_word;
+	/* Get parameters number and total length. */
+	argc = 0;
+	length = 0;
+	for (param = command->verb; param != NULL;
+	     param = argc == 1 ? command->params : param->next_word) {
+		for (part = param; part != NULL; part = part->next_part) {
+			value = part_run_value(part, &outputs);
+			n = strlen(value);
+			length += n;
+			magic |= part_needs_expansion(value, n, part->quoted,
+					!part->expand && part->command == NULL,
+					part_is_split(part->quoted, part->expand,
+						      part->command != NULL,
+						      part->string), &ifs);
+		}
+		length++;
 		argc++;
 	}
 
-	argv = calloc(argc + 1, sizeof(char *));
-	DIE(argv == NULL, "Error allocating argv.");
+	if (magic) {
+		argv = get_argv_expand(command, &outputs, &ifs, size, span);
+		outputs_free(&outputs);
+		return argv;
+	}
 
-	argv[0] = get_word(command->verb);
-	DIE(argv[0] == NULL, "Error retrieving word.");
+	argv = argv_alloc(argc + 1, length);
 
-	param = command->params;
-	argc = 1;
-	while (param != NULL) {
-		argv[argc] = get_word(param);
-		DIE(argv[argc] == NULL, "Error retrieving word.");
+	dest = (char *)(argv + argc + 1);
+	outputs.variables = false;
+	param = command->verb;
+	for (argc = 0; param != NULL; argc++) {
+		argv[argc] = dest;
+		for (part = param; part != NULL; part = part->next_part) {
+			strcpy(dest, part_has_output(&outputs, part->string,
+					part->expand, part->command != NULL) ?
+				output_next(&outputs) :
+				part_value(part->string, part->expand));
+			dest += strlen(dest);
+		}
+		*dest++ = '\0';
 
-		param = param->next_word;
-		argc++;
+		param = argc == 0 ? command->params : param->next_word;
 	}
+	argv[argc] = NULL;
+
+	outputs_free(&outputs);
 
 	*size = argc;
 
 	return argv;
 }
+
+char **get_argv(simple_command_t *command, int *size)
+{
+	struct argv_span span;
+
+	return get_argv_span(command, size, &span);
+}
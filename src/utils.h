@@ -19,6 +19,29 @@
 		}						\
 	} while (0)
 
+/**
+ * A list of strings in a single buffer, each one '\0' terminated at
+ * offsets[i].
+ */
+struct strlist {
+	char *buffer;
+	size_t length;
+	size_t size;
+	size_t *offsets;
+	size_t count;
+	size_t slots;
+};
+
+#define STRLIST_INIT { NULL, 0, 0, NULL, 0, 0 }
+
+void strlist_add(struct strlist *list, const char *s, size_t length);
+void strlist_free(struct strlist *list);
+
+static inline const char *strlist_get(const struct strlist *list, size_t i)
+{
+	return list->buffer + list->offsets[i];
+}
+
 /**
  * Concatenate parts of the word to obtain the command.
  */
@@ -26,8 +49,30 @@ char *get_word(word_t *s);
 
 /**
  * Concatenate command arguments in a NULL terminated list in order to pass
- * them directly to execv.
+ * them directly to execv, with their brace groups expanded, and their
+ * patterns expanded to the matching pathnames. argv_free(argv) releases
+ * the list and the strings.
  */
 char **get_argv(simple_command_t *command, int *size);
 
+/**
+ * Release an argv of get_argv(): the largest one is kept for the next.
+ */
+void argv_free(char **argv);
+
+/**
+ * The arguments that come from patterns and brace groups, argv[first] to
+ * argv[last - 1] (none if first == last).
+ */
+struct argv_span {
+	int first;
+	int last;
+};
+
+/**
+ * get_argv(), and the span of the arguments that come from expansions.
+ */
+char **get_argv_span(simple_command_t *command, int *size,
+		struct argv_span *span);
+
 #endif /* _UTILS_H */
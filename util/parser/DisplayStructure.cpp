@@ -19,17 +19,32 @@ void parse_error(const char * str, const int where)
 	fprintf(stderr, "Parse error near %d: %s\n", where, str);
 }
 
-static void displayWord(word_t * w)
+static void displayCommand(command_t * c, int level, command_t * father);
+
+
+static void displayWord(word_t * w, int level)
 {
 	assert(w != NULL);
 	word_t * crt = w;
 
 	while (crt != NULL) {
-		if (crt->expand)
-			std::cout << "expand(";
-		std::cout << "'" << crt->string << "'";
-		if (crt->expand)
-			std::cout << ")";
+		// "$(command)", "<(command)", ">(command)": the command is a tree of its own
+		if (crt->command != NULL) {
+			std::cout << (crt->quoted ? "quoted_substitution" : "substitution")
+				<< crt->string << "(" << std::endl;
+			displayCommand(crt->command, level + 1, NULL);
+			std::cout << std::setw(2 * indent * level) << "" << ")";
+		} else {
+			if (crt->quoted)
+				std::cout << "quoted(";
+			if (crt->expand)
+				std::cout << "expand(";
+			std::cout << "'" << crt->string << "'";
+			if (crt->expand)
+				std::cout << ")";
+			if (crt->quoted)
+				std::cout << ")";
+		}
 
 		crt = crt->next_part;
 		if (crt != NULL) {
@@ -49,7 +64,7 @@ static void displayList(word_t * w, int level)
 
 	while (crt != NULL) {
 		std::cout << std::setw(2 * indent * level) << "";
-		displayWord(crt);
+		displayWord(crt, level);
 		crt = crt->next_word;
 	}
 }
@@ -62,10 +77,13 @@ static void displaySimple(simple_command_t * s, int level, command_t * father)
 
 	std::cout << std::setw(2 * indent * level) << "" << "simple_command_t (" << std::endl;
 
-	std::cout << std::setw(2 * indent * level + indent) << "" << "verb (" << std::endl;
-	displayList(s->verb, level + 1);
-	assert(s->verb->next_word == NULL);
-	std::cout << std::setw(2 * indent * level + indent) << "" << ")" << std::endl;
+	// the redirections of a group have no verb
+	if (s->verb != NULL) {
+		std::cout << std::setw(2 * indent * level + indent) << "" << "verb (" << std::endl;
+		displayList(s->verb, level + 1);
+		assert(s->verb->next_word == NULL);
+		std::cout << std::setw(2 * indent * level + indent) << "" << ")" << std::endl;
+	}
 
 	if (s->params != NULL) {
 		std::cout << std::setw(2 * indent * level + indent) << "" << "params (" << std::endl;
@@ -76,6 +94,10 @@ static void displaySimple(simple_command_t * s, int level, command_t * father)
 	if (s->in != NULL) {
 		std::cout << std::setw(2 * indent * level + indent) << "" << "in (" << std::endl;
 		displayList(s->in, level + 1);
+		if (s->io_flags & IO_IN_HEREDOC)
+			std::cout << std::setw(2 * indent * (level+1)) << "" << "HEREDOC" << std::endl;
+		if (s->io_flags & IO_IN_HERESTRING)
+			std::cout << std::setw(2 * indent * (level+1)) << "" << "HERESTRING" << std::endl;
 		std::cout << std::setw(2 * indent * level + indent) << "" << ")" << std::endl;
 	}
 
@@ -111,6 +133,42 @@ static void displayCommand(command_t * c, int level, command_t * father)
 		std::cout << std::setw(2 * indent * level + indent) << "" << "scmd (" << std::endl;
 		displaySimple(c->scmd, level + 1, c);
 		std::cout << std::setw(2 * indent * level + indent) << "" << ")" << std::endl;
+	} else if (c->op >= OP_GROUP) {
+		assert((c->cmd2 != NULL) == (c->op == OP_WHILE));
+		std::cout << std::setw(2 * indent * level + indent) << "" << "op == ";
+
+		switch (c->op) {
+		case OP_GROUP:
+			std::cout << "OP_GROUP";
+			break;
+		case OP_SUBSHELL:
+			std::cout << "OP_SUBSHELL";
+			break;
+		case OP_FOR:
+			std::cout << "OP_FOR";
+			break;
+		case OP_WHILE:
+			std::cout << "OP_WHILE";
+			break;
+		case OP_FUNCTION:
+			std::cout << "OP_FUNCTION";
+			break;
+		default:
+			assert(false);
+		}
+
+		std::cout << std::endl;
+		std::cout << std::setw(2 * indent * level + indent) << "" << "cmd1 (" << std::endl;
+		displayCommand(c->cmd1, level + 1, c);
+		std::cout << std::setw(2 * indent * level + indent) << "" << ")" << std::endl;
+		if (c->cmd2 != NULL) {
+			std::cout << std::setw(2 * indent * level + indent) << "" << "cmd2 (" << std::endl;
+			displayCommand(c->cmd2, level + 1, c);
+			std::cout << std::setw(2 * indent * level + indent) << "" << ")" << std::endl;
+		}
+		std::cout << std::setw(2 * indent * level + indent) << "" << "scmd (" << std::endl;
+		displaySimple(c->scmd, level + 1, c);
+		std::cout << std::setw(2 * indent * level + indent) << "" << ")" << std::endl;
 	} else {
 		assert(c->scmd == NULL);
 		std::cout << std::setw(2 * indent * level + indent) << "" << "op == ";
@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/*
+ * Prints the token stream produced by the lexer for every input line.
+
+ * Used by "make lexer_diff" to check that the flex scanner (parser.l) and
+ * the hand-written one (parser.simd.c) agree on the tests in tests/.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define __PARSER_H_INTERNAL_INCLUDE
+#include "./parser.h"
+#include "./parser.tab.h"
+
+#define MAX_CMD_LEN		4096
+#define MAX_TOKENS		4096
+
+
+void parse_error(const char *str, const int where)
+{
+	fprintf(stderr, "Parse error near %d: %s\n", where, str);
+}
+
+
+static const char *token_name(int token)
+{
+	switch (token) {
+	case NOT_ACCEPTED_CHAR:		return "NOT_ACCEPTED_CHAR";
+	case INVALID_ENVIRONMENT_VAR:	return "INVALID_ENVIRONMENT_VAR";
+	case UNEXPECTED_EOF:		return "UNEXPECTED_EOF";
+	case CHARS_AFTER_EOL:		return "CHARS_AFTER_EOL";
+	case END_OF_FILE:		return "END_OF_FILE";
+	case END_OF_LINE:		return "END_OF_LINE";
+	case BLANK:			return "BLANK";
+	case REDIRECT_OE:		return "REDIRECT_OE";
+	case REDIRECT_O:		return "REDIRECT_O";
+	case REDIRECT_E:		return "REDIRECT_E";
+	case INDIRECT:			return "INDIRECT";
+	case REDIRECT_APPEND_E:		return "REDIRECT_APPEND_E";
+	case REDIRECT_APPEND_O:		return "REDIRECT_APPEND_O";
+	case HERE_STRING:		return "HERE_STRING";
+	case HERE_DOC:			return "HERE_DOC";
+	case WORD:			return "WORD";
+	case ENV_VAR:			return "ENV_VAR";
+	case QUOTED_WORD:		return "QUOTED_WORD";
+	case QUOTED_ENV_VAR:		return "QUOTED_ENV_VAR";
+	case SEQUENTIAL:		return "SEQUENTIAL";
+	case PARALLEL:			return "PARALLEL";
+	case CONDITIONAL_NZERO:		return "CONDITIONAL_NZERO";
+	case CONDITIONAL_ZERO:		return "CONDITIONAL_ZERO";
+	case PIPE:			return "PIPE";
+	case GROUP_BEGIN:		return "GROUP_BEGIN";
+	case GROUP_END:			return "GROUP_END";
+	case SUBSHELL_BEGIN:		return "SUBSHELL_BEGIN";
+	case SUBSHELL_END:		return "SUBSHELL_END";
+	case FOR:			return "FOR";
+	case WHILE:			return "WHILE";
+	case DO:			return "DO";
+	case DONE:			return "DONE";
+	case IN:			return "IN";
+	case SUBSTITUTION_BEGIN:	return "SUBSTITUTION_BEGIN";
+	case QUOTED_SUBSTITUTION_BEGIN:	return "QUOTED_SUBSTITUTION_BEGIN";
+	case SUBSTITUTION_END:		return "SUBSTITUTION_END";
+	case PROCESS_IN_BEGIN:		return "PROCESS_IN_BEGIN";
+	case PROCESS_OUT_BEGIN:		return "PROCESS_OUT_BEGIN";
+	default:			return "UNKNOWN";
+	}
+}
+
+
+int main(void)
+{
+	char line[MAX_CMD_LEN];
+	int token, count;
+
+	while (fgets(line, sizeof(line), stdin) != NULL) {
+		printf("> %s", line);
+		if (strchr(line, '\n') == NULL)
+			printf("\n");
+
+		globalParseAnotherString(line);
+		yylloc.first_line = yylloc.last_line = 1;
+		yylloc.first_column = yylloc.last_column = 0;
+
+		for (count = 0; count < MAX_TOKENS; count++) {
+			token = yylex();
+			printf("%s [%d, %d)", token_name(token),
+				yylloc.first_column, yylloc.last_column);
+			if (token == WORD || token == ENV_VAR ||
+			    token == QUOTED_WORD || token == QUOTED_ENV_VAR)
+				printf(" '%s'", yylval.string_un);
+			printf("\n");
+
+			if (token == END_OF_FILE || token == UNEXPECTED_EOF)
+				break;
+		}
+
+		printf("\n");
+		globalEndParsing();
+		free_parse_memory();
+	}
+
+	return EXIT_SUCCESS;
+}
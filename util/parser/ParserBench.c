@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/*
+ * Parser benchmark: times parse_line() + free_parse_memory() over
+ * - every line of the files given as arguments (e.g. the ones in tests/)
+ * - synthetic command lines with long argument lists, also fed to
+ *   parse_stream() in small chunks
+
+ * Build it against different backends (e.g. "make bench_lexers") and
+ * compare the reported throughput.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "./parser.h"
+
+#define MAX_CMD_LEN		4096
+#define MAX_LINES		1024
+#define FILE_ROUNDS		2000
+#define SYNTHETIC_ROUNDS	20
+#define SYNTHETIC_ARGS		10000
+#define STREAM_CHUNK		4096
+
+
+void parse_error(const char *str, const int where)
+{
+	(void)str;
+	(void)where;
+}
+
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void report(const char *name, size_t bytes, size_t lines, double elapsed)
+{
+	printf("%-24s %10zu lines %12zu bytes %9.3f s %9.1f MB/s %9.0f ns/line\n",
+		name, lines, bytes, elapsed, bytes / elapsed / 1e6,
+		elapsed * 1e9 / lines);
+}
+
+
+static void bench_lines(const char *name, char **lines, size_t count, int rounds)
+{
+	size_t bytes = 0, i;
+	command_t *root;
+	double start;
+	int r;
+
+	for (i = 0; i < count; i++)
+		bytes += strlen(lines[i]);
+
+	start = now();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < count; i++) {
+			root = NULL;
+			parse_line(lines[i], &root);
+			free_parse_memory();
+		}
+	}
+
+	report(name, bytes * rounds, count * rounds, now() - start);
+}
+
+
+struct stream {
+	const char *next;
+	size_t left;
+};
+
+
+static size_t read_stream(void *opaque, char *buf, size_t size)
+{
+	struct stream *stream = opaque;
+
+	if (size > stream->left)
+		size = stream->left;
+	if (size > STREAM_CHUNK)
+		size = STREAM_CHUNK;
+
+	memcpy(buf, stream->next, size);
+	stream->next += size;
+	stream->left -= size;
+
+	return size;
+}
+
+
+static void bench_stream(const char *name, const char *line, int rounds)
+{
+	size_t bytes = strlen(line);
+	struct stream stream;
+	command_t *root;
+	double start;
+	int r;
+
+	start = now();
+	for (r = 0; r < rounds; r++) {
+		stream.next = line;
+		stream.left = bytes;
+		root = NULL;
+		parse_stream(read_stream, &stream, &root);
+		free_parse_memory();
+	}
+
+	report(name, bytes * rounds, rounds, now() - start);
+}
+
+
+/*
+ * "cmd arg0 arg1 ..." with plain, quoted and $VAR arguments
+ */
+
+static char *synthetic_line(int args, int quoted)
+{
+	size_t size = 16 + (size_t)args * 64, len;
+	char *line = malloc(size);
+	int i;
+
+	if (line == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	len = sprintf(line, "generated_command");
+	for (i = 0; i < args; i++) {
+		if (quoted && i % 4 == 1)
+			len += sprintf(line + len, " \"quoted argument $HOME %d\"", i);
+		else if (quoted && i % 4 == 3)
+			len += sprintf(line + len, " $VAR_%d", i);
+		else
+			len += sprintf(line + len, " /some/long/path/to/file_%08d.c", i);
+	}
+	strcpy(line + len, "\n");
+
+	return line;
+}
+
+
+int main(int argc, char **argv)
+{
+	char *lines[MAX_LINES];
+	char buffer[MAX_CMD_LEN];
+	size_t count = 0;
+	char *line;
+	FILE *f;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		f = fopen(argv[i], "r");
+		if (f == NULL) {
+			perror(argv[i]);
+			continue;
+		}
+		while (count < MAX_LINES && fgets(buffer, sizeof(buffer), f) != NULL)
+			lines[count++] = strdup(buffer);
+		fclose(f);
+	}
+
+	if (count != 0)
+		bench_lines("test files", lines, count, FILE_ROUNDS);
+
+	line = synthetic_line(SYNTHETIC_ARGS, 0);
+	bench_lines("10k plain arguments", &line, 1, SYNTHETIC_ROUNDS);
+	free(line);
+
+	line = synthetic_line(SYNTHETIC_ARGS, 1);
+	bench_lines("10k mixed arguments", &line, 1, SYNTHETIC_ROUNDS);
+	bench_stream("10k mixed (stream)", line, SYNTHETIC_ROUNDS);
+	free(line);
+
+	while (count != 0)
+		free(lines[--count]);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Parse contexts (see parser.h), common to all the backends
+
+ * The backends own the memory of a context (parserContextParse() and
+ * parserContextRelease()); this file reports the errors of the line
+ * being parsed into its context, and serializes the parsing when one of
+ * the backends keeps its state in plain globals.
+ */
+
+
+#ifdef __cplusplus
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+
+using namespace std;
+
+#else
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#endif
+
+#include <pthread.h>
+
+
+#define __PARSER_H_INTERNAL_INCLUDE
+#include "parser.h"
+
+
+/* the context of the line being parsed by this thread, if any */
+static PARSER_THREAD_LOCAL parse_context_t * currentContext = NULL;
+
+static pthread_mutex_t globalParserLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+void parserError(const char * str, int where)
+{
+	if (currentContext == NULL) {
+		parse_error(str, where);
+		return;
+	}
+
+	/* keep the first one, as parse_error() would have shown it first */
+	if (currentContext->error == NULL) {
+		currentContext->error = str;
+		currentContext->where = where;
+	}
+}
+
+
+parse_context_t * parse_context_new(void)
+{
+	parse_context_t * ctx = (parse_context_t *)calloc(1, sizeof(parse_context_t));
+
+	if (ctx == NULL) {
+		fprintf(stderr, "calloc() failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return ctx;
+}
+
+
+bool parse_context_line(parse_context_t * ctx, const char * line, command_t ** root)
+{
+	bool serialize = !lexerIsReentrant || !parserIsReentrant;
+	bool ret;
+
+	if (ctx == NULL || line == NULL || *root != NULL) {
+		/* see the comment in parser.h */
+		assert(false);
+		return false;
+	}
+
+	if (serialize)
+		pthread_mutex_lock(&globalParserLock);
+
+	ctx->error = NULL;
+	currentContext = ctx;
+	ret = parserContextParse(ctx, line, root);
+	currentContext = NULL;
+
+	if (serialize)
+		pthread_mutex_unlock(&globalParserLock);
+
+	return ret;
+}
+
+
+const char * parse_context_error(const parse_context_t * ctx, int * where)
+{
+	if (ctx->error != NULL)
+		*where = ctx->where;
+
+	return ctx->error;
+}
+
+
+void parse_context_free(parse_context_t * ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	parserContextRelease(ctx);
+	free(ctx);
+}
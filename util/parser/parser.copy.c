@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Copies a parse tree out of the parser's memory (see parse_copy_tree()).
+
+ * As for the flat tree, a first pass over the tree sizes a single
+ * allocation that holds all the nodes, words and strings. Strings of the
+ * permanent intern table (see parse_intern()) are not copied, so users
+ * can still compare them by pointer.
+ */
+
+
+#ifdef __cplusplus
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+#else
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#endif
+
+
+#define __PARSER_H_INTERNAL_INCLUDE
+#include "parser.h"
+
+
+#define COPY_ALIGN(size)	(((size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+
+typedef struct {
+	size_t size;		/* first pass */
+	char * next;		/* second pass */
+} treeCopy;
+
+
+static void * copy_take(treeCopy * copy, size_t size)
+{
+	void * mem = copy->next;
+
+	copy->next += COPY_ALIGN(size);
+	return mem;
+}
+
+
+/*
+ * First pass: size
+ */
+
+static void size_string(treeCopy * copy, const char * str)
+{
+	if (parserInternPermanent(str) == NULL)
+		copy->size += COPY_ALIGN(strlen(str) + 1);
+}
+
+
+static void size_command(treeCopy * copy, const command_t * c);
+
+
+static void size_list(treeCopy * copy, const word_t * w)
+{
+	const word_t * part;
+
+	for (; w != NULL; w = w->next_word) {
+		for (part = w; part != NULL; part = part->next_part) {
+			copy->size += COPY_ALIGN(sizeof(word_t));
+			size_string(copy, part->string);
+			if (part->command != NULL)
+				size_command(copy, part->command);
+		}
+	}
+}
+
+
+static void size_command(treeCopy * copy, const command_t * c)
+{
+	copy->size += COPY_ALIGN(sizeof(command_t));
+
+	if (c->cmd1 != NULL)
+		size_command(copy, c->cmd1);
+	if (c->cmd2 != NULL)
+		size_command(copy, c->cmd2);
+	if (c->scmd == NULL)
+		return;
+
+	copy->size += COPY_ALIGN(sizeof(simple_command_t));
+	size_list(copy, c->scmd->verb);
+	size_list(copy, c->scmd->params);
+	size_list(copy, c->scmd->in);
+	size_list(copy, c->scmd->out);
+	size_list(copy, c->scmd->err);
+}
+
+
+/*
+ * Second pass: copy
+
+ * "&>" puts the same word in the out and the err list; the err list is
+ * rebuilt the same way, sharing the copies of the words of the out list.
+ */
+
+static const char * copy_string(treeCopy * copy, const char * str)
+{
+	const char * permanent = parserInternPermanent(str);
+	size_t len;
+	char * dest;
+
+	if (permanent != NULL)
+		return permanent;
+
+	len = strlen(str);
+	dest = (char *)copy_take(copy, len + 1);
+	memcpy(dest, str, len + 1);
+
+	return dest;
+}
+
+
+static command_t * copy_command(treeCopy * copy, const command_t * c, command_t * up);
+
+
+static word_t * copy_word(treeCopy * copy, const word_t * w)
+{
+	word_t * head = NULL, ** tail = &head;
+
+	for (; w != NULL; w = w->next_part) {
+		*tail = (word_t *)copy_take(copy, sizeof(word_t));
+		memset(*tail, 0, sizeof(word_t));
+		(*tail)->string = copy_string(copy, w->string);
+		(*tail)->expand = w->expand;
+		(*tail)->quoted = w->quoted;
+		if (w->command != NULL)
+			(*tail)->command = copy_command(copy, w->command, NULL);
+		tail = &(*tail)->next_part;
+	}
+
+	return head;
+}
+
+
+static word_t * copy_list(treeCopy * copy, const word_t * w,
+	const word_t * shared, word_t * sharedCopy)
+{
+	word_t * head = NULL, ** tail = &head;
+
+	for (; w != NULL; w = w->next_word) {
+		/* the rest of the list is the one of the out list */
+		if (w == shared) {
+			*tail = sharedCopy;
+			break;
+		}
+
+		*tail = copy_word(copy, w);
+		tail = &(*tail)->next_word;
+	}
+
+	return head;
+}
+
+
+/* The first word of the out list that is also in the err list */
+static void find_shared(const simple_command_t * s, const word_t ** shared, word_t ** sharedCopy, word_t * out)
+{
+	const word_t * o, * e;
+
+	*shared = NULL;
+	*sharedCopy = NULL;
+
+	for (o = s->out; o != NULL; o = o->next_word, out = out->next_word)
+		for (e = s->err; e != NULL; e = e->next_word)
+			if (o == e) {
+				*shared = o;
+				*sharedCopy = out;
+				return;
+			}
+}
+
+
+static command_t * copy_command(treeCopy * copy, const command_t * c, command_t * up)
+{
+	command_t * dest = (command_t *)copy_take(copy, sizeof(command_t));
+	const simple_command_t * s = c->scmd;
+	simple_command_t * scmd;
+	const word_t * shared;
+	word_t * sharedCopy;
+
+	memset(dest, 0, sizeof(*dest));
+	dest->up = up;
+	dest->op = c->op;
+
+	if (c->cmd1 != NULL)
+		dest->cmd1 = copy_command(copy, c->cmd1, dest);
+	if (c->cmd2 != NULL)
+		dest->cmd2 = copy_command(copy, c->cmd2, dest);
+	if (s == NULL)
+		return dest;
+
+	scmd = (simple_command_t *)copy_take(copy, sizeof(simple_command_t));
+	memset(scmd, 0, sizeof(*scmd));
+	scmd->up = dest;
+	scmd->io_flags = s->io_flags;
+	scmd->verb = copy_list(copy, s->verb, NULL, NULL);
+	scmd->params = copy_list(copy, s->params, NULL, NULL);
+	scmd->in = copy_list(copy, s->in, NULL, NULL);
+	scmd->out = copy_list(copy, s->out, NULL, NULL);
+	find_shared(s, &shared, &sharedCopy, scmd->out);
+	scmd->err = copy_list(copy, s->err, shared, sharedCopy);
+	dest->scmd = scmd;
+
+	return dest;
+}
+
+
+command_t * parse_copy_tree(const command_t * root)
+{
+	treeCopy copy;
+	command_t * tree;
+
+	if (root == NULL)
+		return NULL;
+
+	copy.size = 0;
+	size_command(&copy, root);
+
+	copy.next = (char *)malloc(copy.size);
+	if (copy.next == NULL) {
+		fprintf(stderr, "malloc() failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* the root is the first block, so free() releases the whole copy */
+	tree = copy_command(&copy, root, NULL);
+
+	return tree;
+}
@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Builds the flat parse tree (see parser.h) from the tree produced by
+ * either parser backend.
+
+ * The nodes, words and parts live in a single allocation, sized by a
+ * first counting pass over the tree, so walking a command line does not
+ * chase pointers across the heap. The parts point to the strings of the
+ * tree, which are not copied: a long line is held once.
+ */
+
+
+#ifdef __cplusplus
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+
+using namespace std;
+
+#else
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#endif
+
+
+#define __PARSER_H_INTERNAL_INCLUDE
+#include "parser.h"
+
+
+static bool flatEnabled = false;
+static PARSER_THREAD_LOCAL bool haveFlatTree = false;
+static PARSER_THREAD_LOCAL flat_tree_t flatTree;
+static PARSER_THREAD_LOCAL void * flatMemory = NULL;
+
+
+void parse_set_flat(bool enable)
+{
+	flatEnabled = enable;
+}
+
+
+const flat_tree_t * parse_flat_tree(void)
+{
+	return haveFlatTree ? &flatTree : NULL;
+}
+
+
+/*
+ * First pass: sizes
+ */
+
+static void count_command(const command_t * c);
+
+
+static void count_word(const word_t * w)
+{
+	flatTree.word_count++;
+	for (; w != NULL; w = w->next_part) {
+		flatTree.part_count++;
+		if (w->command != NULL)
+			count_command(w->command);
+	}
+}
+
+
+static void count_list(const word_t * w)
+{
+	for (; w != NULL; w = w->next_word)
+		count_word(w);
+}
+
+
+static void count_command(const command_t * c)
+{
+	flatTree.node_count++;
+
+	if (c->cmd1 != NULL)
+		count_command(c->cmd1);
+	if (c->cmd2 != NULL)
+		count_command(c->cmd2);
+	if (c->scmd == NULL)
+		return;
+
+	/* groups and loops may have no verb, count_word() then adds an empty word */
+	count_word(c->scmd->verb);
+	count_list(c->scmd->params);
+	count_list(c->scmd->in);
+	count_list(c->scmd->out);
+	count_list(c->scmd->err);
+}
+
+
+/*
+ * Second pass: copy, in post-order
+ */
+
+static void add_word(word_t * w)
+{
+	flat_word_t * fw = &flatTree.words[flatTree.word_count++];
+	flat_part_t * fp;
+
+	fw->first_part = flatTree.part_count;
+	fw->part_count = 0;
+
+	for (; w != NULL; w = w->next_part) {
+		fp = &flatTree.parts[flatTree.part_count++];
+		fp->string = w->string;
+		fp->view = w;
+		fp->length = (uint32_t)strlen(w->string);
+		fp->expand = w->expand;
+		fp->quoted = w->quoted;
+		fp->command = w->command != NULL ? w->command->flat_index + 1 : 0;
+		fw->part_count++;
+	}
+}
+
+
+static uint32_t add_list(word_t * w)
+{
+	uint32_t count = 0;
+
+	for (; w != NULL; w = w->next_word, count++)
+		add_word(w);
+
+	return count;
+}
+
+
+static uint32_t add_command(command_t * c);
+
+
+/* The commands of the "$(...)" parts in a list, before the words */
+static void add_substitutions(const word_t * w)
+{
+	const word_t * part;
+
+	for (; w != NULL; w = w->next_word)
+		for (part = w; part != NULL; part = part->next_part)
+			if (part->command != NULL)
+				add_command(part->command);
+}
+
+
+static uint32_t add_command(command_t * c)
+{
+	flat_node_t node;
+
+	memset(&node, 0, sizeof(node));
+	node.op = c->op;
+	node.view = c;
+
+	if (c->cmd1 != NULL)
+		node.cmd1 = add_command(c->cmd1);
+	if (c->cmd2 != NULL)
+		node.cmd2 = add_command(c->cmd2);
+
+	if (c->scmd != NULL) {
+		add_substitutions(c->scmd->verb);
+		add_substitutions(c->scmd->params);
+		add_substitutions(c->scmd->in);
+		add_substitutions(c->scmd->out);
+		add_substitutions(c->scmd->err);
+
+		node.first_word = flatTree.word_count;
+		add_word(c->scmd->verb);
+		node.param_count = add_list(c->scmd->params);
+		node.in_count = add_list(c->scmd->in);
+		node.out_count = add_list(c->scmd->out);
+		node.err_count = add_list(c->scmd->err);
+		node.io_flags = c->scmd->io_flags;
+	}
+
+	c->flat_index = flatTree.node_count;
+	flatTree.nodes[flatTree.node_count++] = node;
+
+	return c->flat_index;
+}
+
+
+void flatBuildTree(command_t * root)
+{
+	size_t nodesSize, wordsSize, partsSize;
+	char * mem;
+
+	flatFreeTree();
+	if (!flatEnabled || root == NULL)
+		return;
+
+	memset(&flatTree, 0, sizeof(flatTree));
+	count_command(root);
+
+	nodesSize = sizeof(flat_node_t) * flatTree.node_count;
+	wordsSize = sizeof(flat_word_t) * flatTree.word_count;
+	partsSize = sizeof(flat_part_t) * flatTree.part_count;
+
+	flatMemory = malloc(nodesSize + wordsSize + partsSize);
+	if (flatMemory == NULL) {
+		fprintf(stderr, "malloc() failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	mem = (char *)flatMemory;
+	flatTree.nodes = (flat_node_t *)mem;
+	flatTree.words = (flat_word_t *)(mem + nodesSize);
+	flatTree.parts = (flat_part_t *)(mem + nodesSize + wordsSize);
+
+	flatTree.node_count = flatTree.word_count = 0;
+	flatTree.part_count = 0;
+	add_command(root);
+
+	haveFlatTree = true;
+}
+
+
+void flatFreeTree(void)
+{
+	free(flatMemory);
+	flatMemory = NULL;
+	haveFlatTree = false;
+}
@@ -20,6 +20,10 @@
 
 
 
+#include <stddef.h>
+#include <stdint.h>
+
+
 #ifdef __cplusplus
 #else
 /*
@@ -47,6 +51,19 @@ typedef enum {
  * Some parts might need environment variable expansion (expand == true);
  * if that is the case, "string" points to the environment variable name
 
+ * A part entered as "$(command)" has command != NULL: it stands for the
+ * output of that command (a separate tree, whose root has up == NULL);
+ * string is then "" and expand is false. "<(command)" and ">(command)"
+ * parts (process substitution: a path to read the output of command
+ * from, or to write its input to) are the same, with string "<" or ">".
+
+ * Parts entered inside quotes ('...' or "...", including the "$name" and
+ * "$(command)" inside double quotes) have quoted == true: their text is
+ * not subject to pathname expansion.
+
+ * aux is NULL when parsed, and can be used as for simple_command_t (e.g.
+ * to keep a compiled form of the part).
+
  * The next string literal is pointed to by next_word
  * (NULL if there are no more list elements)
 
@@ -67,6 +84,9 @@ typedef struct word_t {
 	bool expand;
 	struct word_t *next_part;
 	struct word_t *next_word;
+	struct command_t *command;
+	bool quoted;
+	void *aux;
 } word_t;
 
 
@@ -96,13 +116,29 @@ typedef struct word_t {
  * Some string literals can be found in both the out list and the err list
  * (those entered as "command &> out").
 
+ * "<<word" (a here-document) and "<<<word" (a here-string) also go to the
+ * in list, and set IO_IN_HEREDOC or IO_IN_HERESTRING; another "<" clears
+ * them. The word of a here-document is its body: the lines after the
+ * command line, up to a line that is just word (with its quotes removed),
+ * which are part of the command line. When word is not quoted, the
+ * "$name" in the body are parts to expand, as in other words. The text
+ * of a here-string is its word followed by a newline.
+
  * up points to the command_t structure that points to this simple_command_t
  * (up != NULL)
+
+ * The redirections of a group or a loop (see OP_GROUP) are also stored in
+ * a simple_command_t, with verb == NULL and params == NULL (except for
+ * OP_FOR).
  */
 
 #define IO_REGULAR	0x00
 #define IO_OUT_APPEND	0x01
 #define IO_ERR_APPEND	0x02
+/* the last word of in is the text of a here-document or a here-string */
+#define IO_IN_HEREDOC	0x04
+#define IO_IN_HERESTRING	0x08
+#define IO_IN_HERE	(IO_IN_HEREDOC | IO_IN_HERESTRING)
 
 typedef struct {
 	word_t *verb;
@@ -122,6 +158,22 @@ typedef struct {
  * OP_NONE means no operator
  * (the scmd field points to a simple command and cmd1 == cmd2 == NULL)
 
+ * OP_GROUP ("{ list; }", run in the shell) and OP_SUBSHELL ("( list )",
+ * run in a child process) group a command list: cmd1 points to the list,
+ * cmd2 == NULL and scmd points to the redirections of the group
+
+ * OP_FOR ("for name in words; do list; done") runs cmd1 once for each of
+ * the words in scmd->params, with the variable in scmd->verb set to it;
+ * cmd2 == NULL
+
+ * OP_WHILE ("while list; do list; done") runs cmd2 as long as cmd1
+ * succeeds
+
+ * Loops, like groups, keep their redirections in scmd
+
+ * OP_FUNCTION ("name() group") defines the function scmd->verb, whose body
+ * is cmd1 (a group or a loop); cmd2 == NULL
+
  * The rest of the operators mean scmd == NULL
 
  * OP_DUMMY is a dummy value that can be used to count the number of operators
@@ -134,6 +186,11 @@ typedef enum {
 	OP_CONDITIONAL_ZERO,
 	OP_CONDITIONAL_NZERO,
 	OP_PIPE,
+	OP_GROUP,
+	OP_SUBSHELL,
+	OP_FOR,
+	OP_WHILE,
+	OP_FUNCTION,
 	OP_DUMMY
 } operator_t;
 
@@ -145,6 +202,13 @@ typedef enum {
       scmd != NULL
       cmd1 == cmd2 == NULL
       scmd points to a command to be executed
+ *  else if (op >= OP_GROUP)
+      scmd != NULL (with scmd->verb == NULL, except for OP_FOR and
+      OP_FUNCTION)
+      cmd1 != NULL
+      cmd2 != NULL only for OP_WHILE
+      cmd1 (and cmd2) must be executed, with the redirections in scmd
+      (except for OP_FUNCTION, which only stores cmd1)
  *  else
       scmd == NULL
       cmd1 != NULL
@@ -157,12 +221,14 @@ typedef enum {
  * (the father of the current node in the parse tree)
  * The root of the tree has up == NULL
 
- * The parsed expressions do not contain parantheses, this means that
- * the following holds:
+ * Outside groups and loops, the following holds:
  * for any op_lower that has a lower priority than op, there is no
  * parent in the tree with op == op_lower
  * In particular, if op == OP_PIPE descendants
- * can only have OP_PIPE or OP_NONE
+ * can only have OP_PIPE, OP_NONE, a group or a loop
+
+ * flat_index is the index of this node in the flat tree (see below),
+ * if one was built
  */
 
 typedef struct command_t {
@@ -172,9 +238,108 @@ typedef struct command_t {
 	operator_t op;
 	simple_command_t *scmd;
 	void *aux;
+	uint32_t flat_index;
 } command_t;
 
 
+/*
+ * Flat parse tree
+
+ * An optional, contiguous copy of the parse tree (see parse_set_flat());
+ * the pointer tree above stays valid and is a view of the same commands.
+
+ * nodes holds the command_t nodes in post-order (the operands of a node
+ * come before it, the root is the last one); cmd1 and cmd2 are node
+ * indices.
+
+ * The words of a simple command are consecutive in words, starting at
+ * first_word: the verb, then param_count params, then in_count, out_count
+ * and err_count redirection words (a word entered with "&>" is in both
+ * the out and the err range). Groups, loops and functions also have
+ * words: an empty verb (part_count == 0) for all but OP_FOR and
+ * OP_FUNCTION, then the same ranges.
+
+ * The parts of a word are consecutive in parts; a part points to the
+ * string of its word_t (NUL-terminated, not copied: it lives as long as
+ * the pointer tree; view is that word_t) and, as in word_t, the name of an environment
+ * variable if expand is true, and quoted if it was inside quotes. For a "$(command)" part (or "<(command)",
+ * ">(command)", whose string is "<" or ">"), command is the node index of
+ * the command plus one (0 for other parts); the nodes of such commands
+ * come before the node of the command that uses them.
+ */
+
+typedef struct {
+	const char *string;
+	uint32_t length;
+	bool expand;
+	bool quoted;
+	uint32_t command;
+	word_t *view;
+} flat_part_t;
+
+typedef struct {
+	uint32_t first_part;
+	uint32_t part_count;
+} flat_word_t;
+
+typedef struct {
+	operator_t op;
+	uint32_t cmd1;
+	uint32_t cmd2;
+	uint32_t first_word;
+	uint32_t param_count;
+	uint32_t in_count;
+	uint32_t out_count;
+	uint32_t err_count;
+	int io_flags;
+	command_t *view;
+} flat_node_t;
+
+typedef struct {
+	flat_node_t *nodes;
+	uint32_t node_count;
+	flat_word_t *words;
+	uint32_t word_count;
+	flat_part_t *parts;
+	uint32_t part_count;
+} flat_tree_t;
+
+
+/*
+ * Iterators over the flat tree
+
+ * const flat_word_t *w;
+ * flat_for_each_param(tree, node, w)
+ *     ... flat_part_string(tree, &tree->parts[w->first_part]) ...
+ */
+
+#define flat_verb(tree, node) \
+	(&(tree)->words[(node)->first_word])
+
+#define flat_params(tree, node) \
+	(&(tree)->words[(node)->first_word + 1])
+
+#define flat_in(tree, node) \
+	(flat_params(tree, node) + (node)->param_count)
+
+#define flat_out(tree, node) \
+	(flat_in(tree, node) + (node)->in_count)
+
+#define flat_err(tree, node) \
+	(flat_out(tree, node) + (node)->out_count)
+
+#define flat_for_each_param(tree, node, w) \
+	for ((w) = flat_params(tree, node); \
+	     (w) != flat_params(tree, node) + (node)->param_count; (w)++)
+
+#define flat_for_each_part(tree, word, p) \
+	for ((p) = &(tree)->parts[(word)->first_part]; \
+	     (p) != &(tree)->parts[(word)->first_part + (word)->part_count]; (p)++)
+
+#define flat_part_string(tree, p) \
+	((p)->string)
+
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -196,6 +361,9 @@ void parse_error(const char *str, const int where);
 
  * line must point to a string containig a single line
  * The line must end with "\r\n\0" or "\n\0" or "\0"
+ * A command line may span several lines: a backslash followed by a
+ * newline (outside quotes) is removed, and newlines inside quotes are
+ * part of the quoted string (see parse_scan())
  * (*root) must point to NULL ((*root) == NULL)
 
  * parse_line returns true if there was no error parsing the line
@@ -209,6 +377,72 @@ void parse_error(const char *str, const int where);
 bool parse_line(const char *line, command_t **root);
 
 
+/*
+ * Streaming alternative to parse_line(), for very long lines
+
+ * The line is read in chunks by calling read(opaque, buf, size), which
+ * must store at most size bytes of the line in buf and return their
+ * number, or 0 at the end of the line; the lexer consumes the chunks as
+ * they come, so the line is never held in memory as a whole.
+
+ * The parser may stop calling read() before the end of the line (e.g.
+ * on a parse error); the rest of the line is left unread.
+
+ * If the line is incomplete (it ends inside quotes or with a backslash
+ * followed by the newline), read() is called again after it returned 0,
+ * for the next line of the command; it returns 0 again if there is none.
+ * Everything is scanned once, however many lines are appended.
+
+ * The return value and (*root) are the same as for parse_line()
+ */
+
+typedef size_t (*parse_read_t)(void *opaque, char *buf, size_t size);
+
+bool parse_stream(parse_read_t read, void *opaque, command_t **root);
+
+
+/*
+ * Tells whether a command continues on the next line, e.g. to split a
+ * script into command lines
+
+ * Feed the input to parse_scan() in order, in chunks of any size, with
+ * a zero-initialized parse_scan_t; it returns true if the input given so
+ * far ends in the middle of a command line: inside quotes, right after
+ * a backslash-newline, before the end of a here-document ("<<" inside
+ * "$((...))" is a shift, not a here-document), or inside a compound
+ * command (a "for" or "while" loop, a "{ }" group, a subshell or a
+ * substitution, whose keywords count only where a command may start). The
+ * delimiters of the here-documents of a line are kept in delimiters (up
+ * to PARSE_SCAN_DELIMITERS_SIZE characters in all, longer ones are cut).
+ */
+
+#define PARSE_SCAN_DELIMITERS_SIZE	256
+
+typedef struct {
+	char quote;		/* the open quote, or '\0' */
+	char pending;		/* a backslash (and a '\r') was just seen */
+	bool incomplete;
+	char less;		/* '<' in a row, 3 is "<<<" */
+	char dollar;		/* "$" or "$(" was just seen (1 or 2) */
+	unsigned short parens;	/* open in a "$((...))", 0 outside */
+	char heredoc;		/* reading a delimiter or a body */
+	char heredoc_quote;	/* the open quote in the delimiter */
+	short match;		/* body line characters matching the delimiter, -1 if none */
+	unsigned short quote_start;	/* the delimiter length at heredoc_quote */
+	unsigned short length;	/* of delimiters, each ended by a '\0' */
+	unsigned short current;	/* the delimiter of the body being read */
+	char delimiters[PARSE_SCAN_DELIMITERS_SIZE];
+	unsigned short depth;	/* open compound commands and "(" */
+	unsigned short params;	/* open "${" */
+	bool argument;		/* past the first word of a command */
+	char brace;		/* "{" was just seen (1), or a "{" of a word is open (2) */
+	unsigned char word_length;	/* longer than word: not a keyword */
+	char word[5];		/* the start of the current word */
+} parse_scan_t;
+
+bool parse_scan(parse_scan_t *scan, const char *text, size_t len);
+
+
 /*
  * Should be called to free the parse tree
  * call this even if parse_line() returned false
@@ -216,6 +450,78 @@ bool parse_line(const char *line, command_t **root);
 
 void free_parse_memory(void);
 
+
+/*
+ * Call this (once) to have parse_line() also build the flat tree
+
+ * parse_flat_tree() returns the flat tree of the last line parsed, or
+ * NULL if there is none (flat trees disabled, empty line or parse error);
+ * it is freed by free_parse_memory()
+ */
+
+void parse_set_flat(bool enable);
+const flat_tree_t *parse_flat_tree(void);
+
+
+/*
+ * Short tokens are interned: equal tokens of a line share the same string,
+ * so they can be compared by pointer.
+
+ * parse_intern() makes str (which must stay valid) the string shared by all
+ * the tokens equal to it, in all the lines parsed afterwards; it returns
+ * the string to compare word_t strings with (str itself, unless an equal
+ * string was registered before, or the table is full).
+
+ * E.g.:
+ * const char *cd = parse_intern("cd");
+ * ...
+ * if (!s->verb->expand && s->verb->string == cd) ...
+ */
+
+const char *parse_intern(const char *str);
+
+
+/*
+ * Copies a parse tree (e.g. the body of a shell function) out of the
+ * parser's memory, so that it stays valid after free_parse_memory() or
+ * parse_context_free(); the copy is a single allocation, released with
+ * free(root of the copy).
+
+ * Interned strings of the permanent table (see parse_intern()) are kept,
+ * so the copy can still be compared by pointer. The copy has no flat tree.
+ */
+
+command_t *parse_copy_tree(const command_t *root);
+
+
+/*
+ * Parse contexts, for parsing many lines (e.g. of a script) up front,
+ * possibly from several threads
+
+ * The trees parsed with parse_context_line() belong to the context: they
+ * stay valid until parse_context_free(), which releases all of them at
+ * once, and free_parse_memory() does not touch them. They have no flat
+ * copy (parse_flat_tree() is not changed).
+
+ * Errors are not reported through parse_error(): when parse_context_line()
+ * returns false, parse_context_error() returns the description of the
+ * error and stores in (*where) its location, as parse_error() would get
+ * them (it returns NULL if the last line was parsed successfully).
+
+ * Each context must be used by a single thread at a time. Different
+ * contexts are parsed concurrently when both backends are reentrant
+ * (LEXER=simd and PARSER=rd); with flex or bison, parse_context_line()
+ * calls are serialized. parse_intern() must not be called while other
+ * threads are parsing.
+ */
+
+typedef struct parse_context parse_context_t;
+
+parse_context_t *parse_context_new(void);
+bool parse_context_line(parse_context_t *ctx, const char *line, command_t **root);
+const char *parse_context_error(const parse_context_t *ctx, int *where);
+void parse_context_free(parse_context_t *ctx);
+
 #ifdef __cplusplus
 }
 #endif
@@ -237,15 +543,94 @@ typedef struct {
 } redirect_t;
 
 
+/*
+ * State that is not shared between threads (the reentrant backends keep
+ * all of their state like this)
+ */
+
+#ifdef _MSC_VER
+#define PARSER_THREAD_LOCAL __declspec(thread)
+#else
+#define PARSER_THREAD_LOCAL __thread
+#endif
+
+
+struct parse_context {
+	void *memory;		/* owned by the parser backend */
+	const char *error;
+	int where;
+};
+
+/* true if the backend keeps all of its state in PARSER_THREAD_LOCAL variables */
+extern const bool lexerIsReentrant;
+extern const bool parserIsReentrant;
+
+/* token value and location, declared by parser.tab.h */
+union YYSTYPE;
+struct YYLTYPE;
+
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
 void pointerToMallocMemory(const void *ptr);
+void *parserAlloc(size_t size);
 int yylex(void);
+int parserLex(union YYSTYPE *lval, struct YYLTYPE *lloc);
+void parserError(const char *str, int where);
+bool parserContextParse(parse_context_t *ctx, const char *line, command_t **root);
+void parserContextRelease(parse_context_t *ctx);
 void globalParseAnotherString(const char *str);
+void globalParseAnotherStream(parse_read_t read, void *opaque);
+
+/* parse_stream() input, asking for the next line when the command continues */
+typedef struct {
+	parse_read_t read;
+	void *opaque;
+	parse_scan_t scan;
+} parserStream;
+
+void parserStreamInit(parserStream *stream, parse_read_t read, void *opaque);
+size_t parserStreamRead(parserStream *stream, char *buf, size_t size);
 void globalEndParsing(void);
+void flatBuildTree(command_t *root);
+void flatFreeTree(void);
+const char *parserInternToken(const char *str, size_t len);
+/* str if it is a string of the permanent table, NULL otherwise */
+const char *parserInternPermanent(const char *str);
+void parserInternReset(void);
+
+/* reserved words (see parser.keyword.c), tracked by the lexer */
+typedef struct {
+	bool command_start;	/* the next word may start a command */
+	bool blank;		/* the last token was a BLANK */
+	char for_state;
+	int depth;		/* open compound commands and substitutions */
+} parserKeywords;
+
+void parserKeywordsInit(parserKeywords *kw);
+int parserKeyword(const parserKeywords *kw, const char *str, size_t len, char next);
+bool parserKeywordsUpdate(parserKeywords *kw, int token);
+
+/* here-documents (see parser.heredoc.c), read by the lexer */
+#define PARSER_MAX_HEREDOCS	16
+
+typedef struct {
+	word_t *word;		/* the HERE_DOC token, set by parserHeredocSetBody() */
+	const char *delimiter;
+	bool expand;		/* the delimiter is not quoted */
+} parserHeredoc;
+
+const char *parserHeredocDelimiter(const char *p, char *delimiter, bool *quoted);
+bool parserHeredocIsDelimiter(const char *line, size_t len, const char *delimiter);
+const char *parserHeredocBody(const char *p, const char *delimiter, const char **bodyEnd);
+void parserHeredocSetBody(const parserHeredoc *heredoc, const char *body, size_t len);
+
+/* "${...}" expansions (see parser.param.c), read by the lexer */
+const char *parserParameterEnd(const char *p, const char *end, bool quoted);
+const char *parserArithmeticEnd(const char *p, const char *end);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,225 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Here-documents, shared by the lexer backends
+
+ * "<<word" is a single HERE_DOC token, whose value is a word_t with an
+ * empty string. At the end of the line, the lexer reads the bodies of the
+ * here-documents of the line, in order: each one goes up to a line that
+ * is exactly its delimiter (or to the end of the input), and is stored in
+ * the word. The command line then goes on after the last delimiter line.
+
+ * The delimiter is word with its quotes and backslashes removed: "<<EOF",
+ * "<<'EOF'" and "<<\EOF" all end at a line "EOF". It stops at a blank, a
+ * newline or an operator character, as a word does.
+
+ * If word has no quotes nor backslashes, "$name", "${...}" and "$((...))"
+ * in the body are expanded (they become ENV_VAR-like parts of the word,
+ * see parser.param.c; the body is like a double-quoted text) and a
+ * backslash quotes '$', '`' and '\\', and joins lines; "$(" is not a
+ * substitution there.
+ */
+
+
+#ifdef __cplusplus
+
+#include <cstring>
+#include <cctype>
+
+using namespace std;
+
+#else
+
+#include <string.h>
+#include <ctype.h>
+
+#endif
+
+
+#define __PARSER_H_INTERNAL_INCLUDE
+#include "parser.h"
+
+
+/* Characters that end the delimiter outside quotes */
+static bool heredoc_stop(char c)
+{
+	return c == '\0' || strchr(" \t\r\n;&|<>()", c) != NULL;
+}
+
+
+/*
+ * Returns the end of the delimiter that follows "<<" at p, blanks
+ * included; if delimiter is not NULL, the delimiter is stored there,
+ * unquoted (it takes at most end - p + 1 characters), and whether it was
+ * quoted in quoted. A quote that is not closed on the line is not part
+ * of the delimiter.
+ */
+
+const char * parserHeredocDelimiter(const char * p, char * delimiter, bool * quoted)
+{
+	const char * start, * close;
+
+	while (*p == ' ' || *p == '\t')
+		p++;
+	start = p;
+
+	for (;;) {
+		if (*p == '\'' || *p == '"') {
+			close = p + 1 + strcspn(p + 1, *p == '\'' ? "'\n" : "\"\n");
+			if (*close != *p)
+				break;
+			if (delimiter != NULL) {
+				memcpy(delimiter, p + 1, close - p - 1);
+				delimiter += close - p - 1;
+			}
+			p = close + 1;
+		} else if (*p == '\\') {
+			if (p[1] == '\0' || p[1] == '\r' || p[1] == '\n')
+				break;
+			if (delimiter != NULL)
+				*delimiter++ = p[1];
+			p += 2;
+		} else if (!heredoc_stop(*p)) {
+			if (delimiter != NULL)
+				*delimiter++ = *p;
+			p++;
+		} else {
+			break;
+		}
+	}
+
+	if (delimiter != NULL)
+		*delimiter = '\0';
+	if (quoted != NULL)
+		*quoted = strcspn(start, "'\"\\") < (size_t)(p - start);
+
+	return p;
+}
+
+
+/*
+ * True if line (len characters, with its "\n" or "\r\n" if there is one)
+ * is the delimiter line
+ */
+
+bool parserHeredocIsDelimiter(const char * line, size_t len, const char * delimiter)
+{
+	if (len != 0 && line[len - 1] == '\n')
+		len--;
+	if (len != 0 && line[len - 1] == '\r')
+		len--;
+
+	return strlen(delimiter) == len && memcmp(line, delimiter, len) == 0;
+}
+
+
+/*
+ * The body that starts at p, in a '\0' terminated string: returns the
+ * character after its delimiter line, and stores its end in bodyEnd
+ */
+
+const char * parserHeredocBody(const char * p, const char * delimiter, const char ** bodyEnd)
+{
+	const char * eol;
+
+	for (;;) {
+		eol = strchr(p, '\n');
+		eol = eol != NULL ? eol + 1 : p + strlen(p);
+
+		if (parserHeredocIsDelimiter(p, eol - p, delimiter)) {
+			*bodyEnd = p;
+			return eol;
+		}
+		if (*eol == '\0') {
+			*bodyEnd = eol;
+			return eol;
+		}
+		p = eol;
+	}
+}
+
+
+/* The next part of the word of a here-document (the first one is the word) */
+static word_t * heredoc_part(word_t * word, word_t * part, const char * str, bool expand)
+{
+	word_t * next = word;
+
+	if (part != NULL) {
+		next = (word_t *)parserAlloc(sizeof(word_t));
+		memset(next, 0, sizeof(*next));
+		part->next_part = next;
+	}
+
+	next->string = str;
+	next->expand = expand;
+	return next;
+}
+
+
+/*
+ * Stores the body (len characters at body) in the word of the
+ * here-document: the text as is, or split into parts to expand
+ */
+
+void parserHeredocSetBody(const parserHeredoc * heredoc, const char * body, size_t len)
+{
+	/* each "$name" (2 characters or more) ends a text with a '\0' */
+	char * text = (char *)parserAlloc(len + 1);
+	const char * end = body + len;
+	const char * p = body, * name, * close;
+	char * q = text;
+	word_t * part = NULL;
+
+	if (!heredoc->expand) {
+		memcpy(text, body, len);
+		text[len] = '\0';
+		heredoc_part(heredoc->word, NULL, text, false);
+		return;
+	}
+
+	while (p < end) {
+		if (p[0] == '\\' && p + 1 < end && strchr("$`\\\n", p[1]) != NULL) {
+			if (p[1] != '\n')
+				*q++ = p[1];
+			p += 2;
+		} else if (p[0] == '$' && p + 1 < end && (p[1] == '_' || isalpha((unsigned char)p[1]))) {
+			name = ++p;
+			while (p < end && (*p == '_' || isalnum((unsigned char)*p)))
+				p++;
+
+			*q++ = '\0';
+			if (text != q - 1)
+				part = heredoc_part(heredoc->word, part, text, false);
+			part = heredoc_part(heredoc->word, part, parserInternToken(name, p - name), true);
+			text = q;
+		} else if (p[0] == '$' && end - p > 2 && p[1] == '(' && p[2] == '(' &&
+			   (close = parserArithmeticEnd(p + 3, end)) != NULL &&
+			   close != end && *close == ')') {
+			name = p + 1;
+			p = close + 2;
+
+			*q++ = '\0';
+			if (text != q - 1)
+				part = heredoc_part(heredoc->word, part, text, false);
+			part = heredoc_part(heredoc->word, part, parserInternToken(name, p - name), true);
+			text = q;
+		} else if (p[0] == '$' && p + 1 < end && p[1] == '{' &&
+			   (close = parserParameterEnd(p + 2, end, true)) != NULL &&
+			   close != end && *close == '}') {
+			name = p + 2;
+			p = close + 1;
+
+			*q++ = '\0';
+			if (text != q - 1)
+				part = heredoc_part(heredoc->word, part, text, false);
+			part = heredoc_part(heredoc->word, part, parserInternToken(name, close - name), true);
+			text = q;
+		} else {
+			*q++ = *p++;
+		}
+	}
+
+	*q = '\0';
+	if (part == NULL || text != q)
+		heredoc_part(heredoc->word, part, text, false);
+}
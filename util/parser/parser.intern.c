@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * String interning for the tokens produced by the lexers
+
+ * Short tokens (verbs like echo or cat, "=", variable names) repeat a lot
+ * within a line; each distinct one is stored once and every occurrence
+ * points to the same string, so users of the tree can compare them by
+ * pointer.
+
+ * There are two tables:
+ * - the permanent one, filled by parse_intern() (e.g. with the names of
+ *   the builtin commands), which is never reset, and only read while
+ *   parsing, so it is shared by all the threads
+ * - the line one, for the other tokens, whose strings come from
+ *   parserAlloc() and which is reset by free_parse_memory(), together
+ *   with the arena; bumping the generation empties it in O(1); each
+ *   thread has its own
+
+ * Both have a bounded size; when one is full, or for tokens longer than
+ * INTERN_MAX_LENGTH, tokens are simply copied.
+ */
+
+
+#ifdef __cplusplus
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+#else
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#endif
+
+
+#define __PARSER_H_INTERNAL_INCLUDE
+#include "parser.h"
+
+
+#define INTERN_MAX_LENGTH		32
+#define INTERN_PERMANENT_SLOTS		256
+#define INTERN_LINE_SLOTS		2048
+
+
+typedef struct {
+	const char * string;
+	uint32_t length;
+	uint32_t hash;
+	uint32_t generation;
+} internSlot;
+
+typedef struct {
+	internSlot * slots;
+	uint32_t size;
+	uint32_t count;
+	uint32_t generation;
+} internTable;
+
+
+static internSlot permanentSlots[INTERN_PERMANENT_SLOTS];
+static PARSER_THREAD_LOCAL internSlot lineSlots[INTERN_LINE_SLOTS];
+
+static internTable permanentTable = { permanentSlots, INTERN_PERMANENT_SLOTS, 0, 1 };
+/* slots is set on first use: the address of lineSlots is per thread */
+static PARSER_THREAD_LOCAL internTable lineTable = { NULL, INTERN_LINE_SLOTS, 0, 1 };
+
+
+/* FNV-1a */
+static uint32_t intern_hash(const char * str, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)str[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+/*
+ * Returns the slot holding str, or the empty slot where it belongs
+ */
+
+static internSlot * intern_find(internTable * table, const char * str, size_t len, uint32_t hash)
+{
+	uint32_t i = hash & (table->size - 1);
+	internSlot * slot;
+
+	for (;;) {
+		slot = &table->slots[i];
+		if (slot->generation != table->generation)
+			return slot;
+		if (slot->hash == hash && slot->length == len && memcmp(slot->string, str, len) == 0)
+			return slot;
+		i = (i + 1) & (table->size - 1);
+	}
+}
+
+
+/* Keep the tables at most half full, so probing stays short */
+static bool intern_full(const internTable * table)
+{
+	return table->count >= table->size / 2;
+}
+
+
+static void intern_insert(internTable * table, internSlot * slot, const char * str, size_t len, uint32_t hash)
+{
+	slot->string = str;
+	slot->length = (uint32_t)len;
+	slot->hash = hash;
+	slot->generation = table->generation;
+	table->count++;
+}
+
+
+static const char * copy_token(const char * str, size_t len)
+{
+	char * copy = (char *)parserAlloc(len + 1);
+
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+
+	return copy;
+}
+
+
+const char * parse_intern(const char * str)
+{
+	size_t len = strlen(str);
+	uint32_t hash = intern_hash(str, len);
+	internSlot * slot;
+
+	if (len > INTERN_MAX_LENGTH)
+		return str;
+
+	slot = intern_find(&permanentTable, str, len, hash);
+	if (slot->generation == permanentTable.generation)
+		return slot->string;
+	if (intern_full(&permanentTable))
+		return str;
+
+	intern_insert(&permanentTable, slot, str, len, hash);
+	return str;
+}
+
+
+const char * parserInternPermanent(const char * str)
+{
+	size_t len = strlen(str);
+	internSlot * slot;
+
+	if (len > INTERN_MAX_LENGTH || permanentTable.count == 0)
+		return NULL;
+
+	slot = intern_find(&permanentTable, str, len, intern_hash(str, len));
+	if (slot->generation != permanentTable.generation || slot->string != str)
+		return NULL;
+
+	return slot->string;
+}
+
+
+const char * parserInternToken(const char * str, size_t len)
+{
+	uint32_t hash;
+	internSlot * slot;
+	const char * copy;
+
+	if (len > INTERN_MAX_LENGTH)
+		return copy_token(str, len);
+
+	hash = intern_hash(str, len);
+
+	if (permanentTable.count != 0) {
+		slot = intern_find(&permanentTable, str, len, hash);
+		if (slot->generation == permanentTable.generation)
+			return slot->string;
+	}
+
+	if (lineTable.slots == NULL)
+		lineTable.slots = lineSlots;
+
+	slot = intern_find(&lineTable, str, len, hash);
+	if (slot->generation == lineTable.generation)
+		return slot->string;
+
+	copy = copy_token(str, len);
+	if (!intern_full(&lineTable))
+		intern_insert(&lineTable, slot, copy, len, hash);
+
+	return copy;
+}
+
+
+void parserInternReset(void)
+{
+	if (lineTable.count == 0)
+		return;
+
+	lineTable.count = 0;
+	lineTable.generation++;
+
+	/* after 2^32 resets, generations would repeat */
+	if (lineTable.generation == 0) {
+		memset(lineSlots, 0, sizeof(lineSlots));
+		lineTable.generation = 1;
+	}
+}
@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Reserved words, shared by the lexer backends
+
+ * "for", "while", "do" and "done" are keywords only where a command may
+ * start, and "in" only as the third word of a "for"; anywhere else (as in
+ * "echo done") they are plain words. A keyword must also end where the
+ * lexer stopped: "done$x", "do=1" or "for'x'" are words too.
+
+ * The compound commands and substitutions still open are counted, so
+ * the lexers can tell a newline inside one (which ends a command like
+ * ";" does, or is a blank where a command may start) from the end of
+ * the command line.
+ */
+
+
+#ifdef __cplusplus
+
+#include <cstring>
+
+using namespace std;
+
+#else
+
+#include <string.h>
+
+#endif
+
+
+#define __PARSER_H_INTERNAL_INCLUDE
+#include "parser.h"
+#include "parser.tab.h"
+
+
+enum {
+	KEYWORD_FOR_NONE,
+	KEYWORD_FOR_NAME,	/* after "for" */
+	KEYWORD_FOR_IN		/* after "for name" */
+};
+
+
+void parserKeywordsInit(parserKeywords * kw)
+{
+	kw->command_start = true;
+	kw->blank = false;
+	kw->for_state = KEYWORD_FOR_NONE;
+	kw->depth = 0;
+}
+
+
+static bool keyword_is(const char * str, size_t len, const char * keyword)
+{
+	return strlen(keyword) == len && memcmp(str, keyword, len) == 0;
+}
+
+
+int parserKeyword(const parserKeywords * kw, const char * str, size_t len, char next)
+{
+	/* the word goes on */
+	if (next == '$' || next == '\'' || next == '"' || next == '=')
+		return 0;
+
+	if (kw->for_state == KEYWORD_FOR_IN && keyword_is(str, len, "in"))
+		return IN;
+
+	if (!kw->command_start)
+		return 0;
+
+	if (keyword_is(str, len, "for"))
+		return FOR;
+	if (keyword_is(str, len, "while"))
+		return WHILE;
+	if (keyword_is(str, len, "do"))
+		return DO;
+	if (keyword_is(str, len, "done"))
+		return DONE;
+
+	return 0;
+}
+
+
+/*
+ * Returns false for a BLANK right after another one (a newline inside a
+ * compound command may be one), which the lexer drops
+ */
+
+bool parserKeywordsUpdate(parserKeywords * kw, int token)
+{
+	if (token == BLANK) {
+		if (kw->blank)
+			return false;
+		kw->blank = true;
+		return true;
+	}
+	kw->blank = false;
+
+	if (token == FOR)
+		kw->for_state = KEYWORD_FOR_NAME;
+	else if (token == WORD && kw->for_state == KEYWORD_FOR_NAME)
+		kw->for_state = KEYWORD_FOR_IN;
+	else
+		kw->for_state = KEYWORD_FOR_NONE;
+
+	switch (token) {
+	case SEQUENTIAL:
+	case PARALLEL:
+	case CONDITIONAL_NZERO:
+	case CONDITIONAL_ZERO:
+	case PIPE:
+	case GROUP_BEGIN:
+	case SUBSHELL_BEGIN:
+	case SUBSTITUTION_BEGIN:
+	case QUOTED_SUBSTITUTION_BEGIN:
+	case PROCESS_IN_BEGIN:
+	case PROCESS_OUT_BEGIN:
+	case WHILE:
+	case DO:
+	case END_OF_LINE:
+	/* "name()" is followed by the body of the function */
+	case SUBSHELL_END:
+		kw->command_start = true;
+		break;
+	default:
+		kw->command_start = false;
+		break;
+	}
+
+	switch (token) {
+	case FOR:
+	case WHILE:
+	case GROUP_BEGIN:
+	case SUBSHELL_BEGIN:
+	case SUBSTITUTION_BEGIN:
+	case QUOTED_SUBSTITUTION_BEGIN:
+	case PROCESS_IN_BEGIN:
+	case PROCESS_OUT_BEGIN:
+		kw->depth++;
+		break;
+	case DONE:
+	case GROUP_END:
+	case SUBSHELL_END:
+	case SUBSTITUTION_END:
+		if (kw->depth != 0)
+			kw->depth--;
+		break;
+	default:
+		break;
+	}
+
+	return true;
+}
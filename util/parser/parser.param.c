@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Parameter expansions, shared by the lexer backends
+
+ * "${name}" is the same ENV_VAR token as "$name". The other forms are
+ * ENV_VAR tokens too, whose string is the text between the braces:
+ * "#name" (the length of the value), "name:-word", "name-word",
+ * "name:=word", "name=word", "name:+word", "name+word" (default,
+ * assigned and alternate values) and "name#pattern", "name##pattern",
+ * "name%pattern", "name%%pattern" (prefix and suffix removal). They are
+ * evaluated when the word is expanded, by the shell.
+
+ * The word goes up to the matching '}': the braces in it are counted,
+ * and the quoted characters (and the ones after a backslash) are
+ * skipped. Inside double quotes, a single quote is an ordinary character.
+
+ * "$((expression))" (arithmetic expansion) is an ENV_VAR token too, whose
+ * string is "((expression))": the "((" is one only if its "))" closes
+ * both parentheses, otherwise it is a "$(" with a subshell in it.
+ */
+
+
+#ifdef __cplusplus
+
+#include <cctype>
+
+using namespace std;
+
+#else
+
+#include <ctype.h>
+
+#endif
+
+
+#define __PARSER_H_INTERNAL_INCLUDE
+#include "parser.h"
+
+
+static bool param_name_start(char c)
+{
+	return c == '_' || isalpha((unsigned char)c);
+}
+
+
+static bool param_name_char(char c)
+{
+	return c == '_' || isalnum((unsigned char)c);
+}
+
+
+/* p reached the end of the input: a '\0', or end */
+static bool param_at_end(const char * p, const char * end)
+{
+	return p == end || *p == '\0';
+}
+
+
+/*
+ * The '}' that ends the "${" expansion whose text starts at p; the input
+ * ends at end, or at a '\0' if end is NULL. Returns where the scan
+ * stopped if the input ended first (the expansion may go on in the next
+ * part of the input), or NULL if the text is not a valid expansion.
+ */
+
+const char * parserParameterEnd(const char * p, const char * end, bool quoted)
+{
+	bool length = *p == '#';
+	int depth = 0;
+	char quote;
+
+	if (length)
+		p++;
+
+	if (param_at_end(p, end))
+		return p;
+	if (!param_name_start(*p))
+		return NULL;
+	while (!param_at_end(p, end) && param_name_char(*p))
+		p++;
+
+	if (param_at_end(p, end) || *p == '}')
+		return p;
+	if (length)
+		return NULL;
+
+	/* the operator */
+	if (*p == ':') {
+		p++;
+		if (param_at_end(p, end))
+			return p;
+		if (*p != '-' && *p != '=' && *p != '+')
+			return NULL;
+		p++;
+	} else if (*p == '#' || *p == '%') {
+		p += p[1] == p[0] ? 2 : 1;
+	} else if (*p == '-' || *p == '=' || *p == '+') {
+		p++;
+	} else {
+		return NULL;
+	}
+
+	/* the word */
+	for (; !param_at_end(p, end); p++) {
+		switch (*p) {
+		case '\\':
+			if (param_at_end(p + 1, end))
+				return p + 1;
+			p++;
+			break;
+
+		case '\'':
+		case '"':
+			if (*p == '\'' && quoted)
+				break;
+			quote = *p++;
+			while (!param_at_end(p, end) && *p != quote) {
+				if (quote == '"' && *p == '\\' && !param_at_end(p + 1, end))
+					p++;
+				p++;
+			}
+			if (param_at_end(p, end))
+				return p;
+			break;
+
+		case '{':
+			depth++;
+			break;
+
+		case '}':
+			if (depth == 0)
+				return p;
+			depth--;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return p;
+}
+
+
+/*
+ * The "))" that ends the "$((" whose expression starts at p (the first
+ * ')' of it), with the same end as parserParameterEnd(). Returns where the
+ * scan stopped if the input ended first, or NULL if the "$((" is not an
+ * arithmetic expansion.
+ */
+
+const char * parserArithmeticEnd(const char * p, const char * end)
+{
+	int depth = 0;
+
+	for (; !param_at_end(p, end); p++) {
+		if (*p == '(') {
+			depth++;
+		} else if (*p == ')') {
+			if (depth-- > 0)
+				continue;
+			if (param_at_end(p + 1, end))
+				return p + 1;
+			return p[1] == ')' ? p : NULL;
+		}
+	}
+
+	return p;
+}
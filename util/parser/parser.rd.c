@@ -0,0 +1,940 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Hand-written recursive-descent parser, an alternative to the bison
+ * parser in parser.y (build with PARSER=rd, see the Makefile).
+
+ * It reads the same tokens (from either lexer backend, through
+ * parserLex()) and builds exactly the same command_t / simple_command_t /
+ * word_t tree, so users of parser.h do not need to change. All of its
+ * state is thread local, so with the simd lexer different threads can
+ * parse at the same time (see parse_context_line()).
+
+ * The grammar of parser.y, with the BLANK placement spelled out:
+
+ *   command_tree   := command (END_OF_LINE | END_OF_FILE)
+ *                   | [BLANK] (END_OF_LINE | END_OF_FILE)
+ *   command        := operand (operator operand)*
+ *   operand        := function | group | simple_command
+ *   function       := [BLANK] WORD SUBSHELL_BEGIN SUBSHELL_END group
+ *   group          := [BLANK] group_body [BLANK] {redirect}
+ *   group_body     := GROUP_BEGIN command [SEQUENTIAL [BLANK]] GROUP_END
+ *                   | SUBSHELL_BEGIN command [SEQUENTIAL [BLANK]] SUBSHELL_END
+ *                   | FOR BLANK WORD BLANK IN {BLANK word} [BLANK] loop_body
+ *                   | WHILE command loop_body
+ *   loop_body      := SEQUENTIAL [BLANK] DO command SEQUENTIAL [BLANK] DONE
+
+ * The SEQUENTIAL before a closing token (GROUP_END, SUBSHELL_END,
+ * SUBSTITUTION_END, DO or DONE) is consumed by command, which stops there.
+ *   simple_command := [BLANK] word {BLANK word} [BLANK] {redirect}
+ *   redirect       := redirect_op [BLANK] word [BLANK]
+ *                   | HERE_DOC [BLANK]
+ *   word           := part+
+ *   part           := WORD | ENV_VAR | QUOTED_WORD | QUOTED_ENV_VAR | substitution
+ *   substitution   := substitution_begin command [SEQUENTIAL [BLANK]] SUBSTITUTION_END
+ *   substitution_begin := SUBSTITUTION_BEGIN | QUOTED_SUBSTITUTION_BEGIN
+ *                   | PROCESS_IN_BEGIN | PROCESS_OUT_BEGIN
+
+ * Operators are bound by precedence climbing, using the %left
+ * precedence of parser.y: SEQUENTIAL < PARALLEL < CONDITIONAL < PIPE.
+
+ * The tree and the token strings (see parserAlloc()) are allocated from
+ * an arena that is released all at once by free_parse_memory() (or by
+ * parse_context_free(), for the lines of a context); lists keep their
+ * tail, so long argument lists are built in linear time.
+ */
+
+
+#ifdef __cplusplus
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+
+using namespace std;
+
+#else
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#endif
+
+
+#define __PARSER_H_INTERNAL_INCLUDE
+#include "parser.h"
+#include "parser.tab.h"
+
+
+const bool parserIsReentrant = true;
+
+/* Filled in by yylex(), for the flex scanner and for DumpTokens */
+YYSTYPE yylval;
+YYLTYPE yylloc;
+
+/* Value and location of the lookahead token */
+static PARSER_THREAD_LOCAL YYSTYPE tokenValue;
+static PARSER_THREAD_LOCAL YYLTYPE tokenLocation;
+
+
+/*
+ * Arena
+
+ * Memory is handed out from chunks of at least ARENA_CHUNK_SIZE bytes,
+ * all of them released by free_parse_memory(); a context keeps its own
+ * list of chunks, which replaces this one while it parses a line.
+ */
+
+#define ARENA_CHUNK_SIZE	(64 * 1024)
+#define ARENA_ALIGN		(2 * sizeof(void *))
+
+typedef struct arenaChunk {
+	struct arenaChunk * next;
+	size_t used;
+	size_t size;
+} arenaChunk;
+
+#define ARENA_HEADER_SIZE \
+	((sizeof(arenaChunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+static PARSER_THREAD_LOCAL arenaChunk * arenaHead = NULL;
+
+
+static arenaChunk * arena_new_chunk(size_t size, arenaChunk * next)
+{
+	arenaChunk * chunk;
+
+	if (size < ARENA_CHUNK_SIZE)
+		size = ARENA_CHUNK_SIZE;
+
+	chunk = (arenaChunk *) malloc(ARENA_HEADER_SIZE + size);
+	if (chunk == NULL) {
+		fprintf(stderr, "malloc() failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	chunk->next = next;
+	chunk->used = 0;
+	chunk->size = size;
+
+	return chunk;
+}
+
+
+void * parserAlloc(size_t size)
+{
+	void * ptr;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	if (arenaHead == NULL || arenaHead->size - arenaHead->used < size)
+		arenaHead = arena_new_chunk(size, arenaHead);
+
+	ptr = (char *)arenaHead + ARENA_HEADER_SIZE + arenaHead->used;
+	arenaHead->used += size;
+
+	return ptr;
+}
+
+
+static void arena_reset(void)
+{
+	arenaChunk * next;
+
+	while (arenaHead != NULL) {
+		next = arenaHead->next;
+		free(arenaHead);
+		arenaHead = next;
+	}
+}
+
+
+/*
+ * Tree construction (same shapes as the helpers in parser.y)
+ */
+
+static simple_command_t * bind_parts(word_t * exe_name, word_t * params, redirect_t red)
+{
+	simple_command_t * s = (simple_command_t *) parserAlloc(sizeof(simple_command_t));
+
+	memset(s, 0, sizeof(*s));
+	assert(exe_name != NULL);
+	assert(exe_name->next_word == NULL);
+	s->verb = exe_name;
+	s->params = params;
+	s->in = red.red_i;
+	s->out = red.red_o;
+	s->err = red.red_e;
+	s->io_flags = red.red_flags;
+	return s;
+}
+
+
+static command_t * new_command(simple_command_t * scmd)
+{
+	command_t * c = (command_t *) parserAlloc(sizeof(command_t));
+
+	memset(c, 0, sizeof(*c));
+	c->op = OP_NONE;
+	assert(scmd != NULL);
+	c->scmd = scmd;
+	scmd->up = c;
+	return c;
+}
+
+
+static command_t * bind_commands(command_t * cmd1, command_t * cmd2, operator_t op)
+{
+	command_t * c = (command_t *) parserAlloc(sizeof(command_t));
+
+	memset(c, 0, sizeof(*c));
+	assert(cmd1 != NULL && cmd1->up == NULL);
+	assert(cmd2 != NULL && cmd2->up == NULL);
+	c->cmd1 = cmd1;
+	cmd1->up = c;
+	c->cmd2 = cmd2;
+	cmd2->up = c;
+	assert((op > OP_NONE) && (op < OP_DUMMY));
+	c->op = op;
+	return c;
+}
+
+
+static word_t * new_word(const char * str, bool expand)
+{
+	word_t * w = (word_t *) parserAlloc(sizeof(word_t));
+
+	memset(w, 0, sizeof(*w));
+	assert(str != NULL);
+	w->string = str;
+	w->expand = expand;
+	return w;
+}
+
+
+/*
+ * Groups and loops: the redirections (and the variable and the words of
+ * a for) go to a simple command without verb
+ */
+static command_t * bind_compound(command_t * cmd1, command_t * cmd2, operator_t op)
+{
+	command_t * c = (command_t *) parserAlloc(sizeof(command_t));
+	simple_command_t * s = (simple_command_t *) parserAlloc(sizeof(simple_command_t));
+
+	memset(c, 0, sizeof(*c));
+	assert(cmd1 != NULL && cmd1->up == NULL);
+	c->cmd1 = cmd1;
+	cmd1->up = c;
+	if (cmd2 != NULL) {
+		assert(cmd2->up == NULL);
+		c->cmd2 = cmd2;
+		cmd2->up = c;
+	}
+	assert((op >= OP_GROUP) && (op < OP_DUMMY));
+	c->op = op;
+
+	memset(s, 0, sizeof(*s));
+	s->up = c;
+	c->scmd = s;
+	return c;
+}
+
+
+static command_t * bind_for(const char * name, word_t * words, command_t * body)
+{
+	command_t * c = bind_compound(body, NULL, OP_FOR);
+
+	c->scmd->verb = new_word(name, false);
+	c->scmd->params = words;
+	return c;
+}
+
+
+static command_t * bind_group_redirect(command_t * c, redirect_t red)
+{
+	c->scmd->in = red.red_i;
+	c->scmd->out = red.red_o;
+	c->scmd->err = red.red_e;
+	c->scmd->io_flags = red.red_flags;
+	return c;
+}
+
+
+/*
+ * A list of words linked by next_word, with its last element
+
+ * The "&>" redirection puts the same word in both the out and the err
+ * list (as parser.y does), so a later redirection appended to one of them
+ * is seen by the other one too; the tail is therefore advanced to the
+ * real end of the list before appending.
+ */
+
+typedef struct {
+	word_t * head;
+	word_t * tail;
+} wordList;
+
+
+static void add_word_to_list(word_t * w, wordList * lst)
+{
+	assert(w != NULL);
+	assert(w->next_word == NULL);
+
+	if (lst->head == NULL) {
+		lst->head = lst->tail = w;
+		return;
+	}
+
+	while (lst->tail->next_word != NULL)
+		lst->tail = lst->tail->next_word;
+
+	/* already reachable through a word shared with the other list */
+	if (lst->tail == w)
+		return;
+
+	lst->tail->next_word = w;
+	lst->tail = w;
+}
+
+
+/*
+ * Parser state
+ */
+
+static PARSER_THREAD_LOCAL int lookahead;
+static PARSER_THREAD_LOCAL bool syntaxError;
+static PARSER_THREAD_LOCAL bool needsFree = false;
+
+
+static void next_token(void)
+{
+	lookahead = parserLex(&tokenValue, &tokenLocation);
+}
+
+
+static void * syntax_error(void)
+{
+	if (!syntaxError) {
+		syntaxError = true;
+		parserError("syntax error", tokenLocation.first_column);
+	}
+
+	return NULL;
+}
+
+
+static bool accept_token(int token)
+{
+	if (lookahead != token)
+		return false;
+
+	next_token();
+	return true;
+}
+
+
+static bool is_word_token(int token)
+{
+	switch (token) {
+	case WORD:
+	case ENV_VAR:
+	case QUOTED_WORD:
+	case QUOTED_ENV_VAR:
+	case SUBSTITUTION_BEGIN:
+	case QUOTED_SUBSTITUTION_BEGIN:
+	case PROCESS_IN_BEGIN:
+	case PROCESS_OUT_BEGIN:
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+static command_t * parse_command(int minPrecedence, bool blankSeen);
+
+
+/* part := WORD | ENV_VAR | QUOTED_WORD | QUOTED_ENV_VAR | substitution */
+static word_t * parse_part(void)
+{
+	bool quoted = lookahead == QUOTED_WORD || lookahead == QUOTED_ENV_VAR ||
+		lookahead == QUOTED_SUBSTITUTION_BEGIN;
+	const char * kind;
+	command_t * c;
+	word_t * w;
+
+	switch (lookahead) {
+	case SUBSTITUTION_BEGIN:
+	case QUOTED_SUBSTITUTION_BEGIN:
+		kind = "";
+		break;
+	case PROCESS_IN_BEGIN:
+		kind = "<";
+		break;
+	case PROCESS_OUT_BEGIN:
+		kind = ">";
+		break;
+	default:
+		w = new_word(tokenValue.string_un,
+			lookahead == ENV_VAR || lookahead == QUOTED_ENV_VAR);
+		w->quoted = quoted;
+		next_token();
+		return w;
+	}
+
+	next_token();
+	c = parse_command(1, false);
+	if (c == NULL)
+		return NULL;
+	if (!accept_token(SUBSTITUTION_END))
+		return (word_t *) syntax_error();
+
+	w = new_word(kind, false);
+	w->command = c;
+	w->quoted = quoted;
+	return w;
+}
+
+
+/* The parts of a word after head, which was already read */
+static word_t * parse_word_tail(word_t * head)
+{
+	word_t * tail = head;
+
+	while (is_word_token(lookahead)) {
+		tail->next_part = parse_part();
+		if (tail->next_part == NULL)
+			return NULL;
+		tail = tail->next_part;
+	}
+
+	return head;
+}
+
+
+/* word := part+ */
+static word_t * parse_word(void)
+{
+	word_t * head;
+
+	if (!is_word_token(lookahead))
+		return (word_t *) syntax_error();
+
+	head = parse_part();
+	if (head == NULL)
+		return NULL;
+
+	return parse_word_tail(head);
+}
+
+
+/* redirect := redirect_op [BLANK] word [BLANK] | HERE_DOC [BLANK] */
+static bool parse_redirect(redirect_t * red, wordList * in, wordList * out, wordList * err)
+{
+	int op = lookahead;
+	word_t * w;
+
+	/* the lexer made the word, its body comes at the end of the line */
+	if (op == HERE_DOC) {
+		add_word_to_list(tokenValue.word_un, in);
+		red->red_flags &= ~IO_IN_HERE;
+		red->red_flags |= IO_IN_HEREDOC;
+		next_token();
+		accept_token(BLANK);
+		return true;
+	}
+
+	next_token();
+	accept_token(BLANK);
+
+	w = parse_word();
+	if (w == NULL)
+		return false;
+
+	switch (op) {
+	case REDIRECT_OE:
+		add_word_to_list(w, out);
+		add_word_to_list(w, err);
+		break;
+	case REDIRECT_E:
+		add_word_to_list(w, err);
+		break;
+	case REDIRECT_O:
+		add_word_to_list(w, out);
+		break;
+	case REDIRECT_APPEND_E:
+		add_word_to_list(w, err);
+		red->red_flags |= IO_ERR_APPEND;
+		break;
+	case REDIRECT_APPEND_O:
+		add_word_to_list(w, out);
+		red->red_flags |= IO_OUT_APPEND;
+		break;
+	case INDIRECT:
+		add_word_to_list(w, in);
+		red->red_flags &= ~IO_IN_HERE;
+		break;
+	case HERE_STRING:
+		add_word_to_list(w, in);
+		red->red_flags &= ~IO_IN_HERE;
+		red->red_flags |= IO_IN_HERESTRING;
+		break;
+	default:
+		assert(false);
+	}
+
+	accept_token(BLANK);
+	return true;
+}
+
+
+static bool is_redirect_token(int token)
+{
+	switch (token) {
+	case REDIRECT_OE:
+	case REDIRECT_O:
+	case REDIRECT_E:
+	case INDIRECT:
+	case REDIRECT_APPEND_E:
+	case REDIRECT_APPEND_O:
+	case HERE_STRING:
+	case HERE_DOC:
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+/* {redirect}, into red */
+static bool parse_redirects(redirect_t * red)
+{
+	wordList in = { NULL, NULL }, out = { NULL, NULL }, err = { NULL, NULL };
+
+	red->red_flags = IO_REGULAR;
+	while (is_redirect_token(lookahead))
+		if (!parse_redirect(red, &in, &out, &err))
+			return false;
+
+	red->red_i = in.head;
+	red->red_o = out.head;
+	red->red_e = err.head;
+	return true;
+}
+
+
+/*
+ * simple_command := [BLANK] word {BLANK word} [BLANK] {redirect}
+
+ * exe_name is the first word, already read
+ */
+static simple_command_t * parse_simple_command(word_t * exe_name)
+{
+	wordList params = { NULL, NULL };
+	redirect_t red;
+	word_t * w;
+
+	while (accept_token(BLANK)) {
+		if (!is_word_token(lookahead))
+			break;
+
+		w = parse_word();
+		if (w == NULL)
+			return NULL;
+		add_word_to_list(w, &params);
+	}
+
+	if (!parse_redirects(&red))
+		return NULL;
+
+	return bind_parts(exe_name, params.head, red);
+}
+
+
+/* %left precedence from parser.y; 0 for tokens that are not operators */
+static int operator_precedence(int token, operator_t * op)
+{
+	switch (token) {
+	case SEQUENTIAL:
+		*op = OP_SEQUENTIAL;
+		return 1;
+	case PARALLEL:
+		*op = OP_PARALLEL;
+		return 2;
+	case CONDITIONAL_ZERO:
+		*op = OP_CONDITIONAL_ZERO;
+		return 3;
+	case CONDITIONAL_NZERO:
+		*op = OP_CONDITIONAL_NZERO;
+		return 3;
+	case PIPE:
+		*op = OP_PIPE;
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+
+static bool is_group_end_token(int token)
+{
+	return token == GROUP_END || token == SUBSHELL_END ||
+		token == SUBSTITUTION_END || token == DO || token == DONE;
+}
+
+
+static command_t * parse_operand(bool blankSeen);
+
+
+/* command := operand (operator operand)*, by precedence */
+static command_t * parse_command(int minPrecedence, bool blankSeen)
+{
+	command_t * lhs, * rhs;
+	operator_t op = OP_NONE;
+	int precedence;
+
+	lhs = parse_operand(blankSeen);
+	if (lhs == NULL)
+		return NULL;
+
+	for (;;) {
+		precedence = operator_precedence(lookahead, &op);
+		if (precedence == 0 || precedence < minPrecedence)
+			return lhs;
+
+		next_token();
+		blankSeen = false;
+		if (op == OP_SEQUENTIAL) {
+			/* "list; }": the ";" ends the list, see parse_group() */
+			blankSeen = accept_token(BLANK);
+			if (is_group_end_token(lookahead))
+				return lhs;
+		}
+
+		/* left associative: the right operand binds tighter operators only */
+		rhs = parse_command(precedence + 1, blankSeen);
+		if (rhs == NULL)
+			return NULL;
+
+		lhs = bind_commands(lhs, rhs, op);
+	}
+}
+
+
+/* command, which must have ended with a SEQUENTIAL, then closer */
+static command_t * parse_loop_list(int closer)
+{
+	command_t * list;
+
+	list = parse_command(1, false);
+	if (list == NULL)
+		return NULL;
+
+	if (!accept_token(closer))
+		return (command_t *) syntax_error();
+
+	return list;
+}
+
+
+/* FOR BLANK WORD BLANK IN {BLANK word} [BLANK] loop_body, after FOR */
+static command_t * parse_for(void)
+{
+	wordList words = { NULL, NULL };
+	const char * name;
+	command_t * body;
+	word_t * w;
+
+	if (!accept_token(BLANK) || lookahead != WORD)
+		return (command_t *) syntax_error();
+	name = tokenValue.string_un;
+	next_token();
+
+	if (!accept_token(BLANK) || !accept_token(IN))
+		return (command_t *) syntax_error();
+
+	while (accept_token(BLANK)) {
+		if (!is_word_token(lookahead))
+			break;
+		w = parse_word();
+		if (w == NULL)
+			return NULL;
+		add_word_to_list(w, &words);
+	}
+
+	if (!accept_token(SEQUENTIAL))
+		return (command_t *) syntax_error();
+	accept_token(BLANK);
+	if (!accept_token(DO))
+		return (command_t *) syntax_error();
+
+	body = parse_loop_list(DONE);
+	if (body == NULL)
+		return NULL;
+
+	return bind_for(name, words.head, body);
+}
+
+
+/* WHILE command loop_body, after WHILE */
+static command_t * parse_while(void)
+{
+	command_t * condition, * body;
+
+	condition = parse_loop_list(DO);
+	if (condition == NULL)
+		return NULL;
+
+	body = parse_loop_list(DONE);
+	if (body == NULL)
+		return NULL;
+
+	return bind_compound(condition, body, OP_WHILE);
+}
+
+
+/* group := [BLANK] group_body [BLANK] {redirect}, the BLANK already seen */
+static command_t * parse_group(void)
+{
+	int token = lookahead;
+	command_t * c;
+	redirect_t red;
+
+	next_token();
+	switch (token) {
+	case GROUP_BEGIN:
+		c = parse_command(1, false);
+		if (c != NULL && !accept_token(GROUP_END))
+			return (command_t *) syntax_error();
+		if (c != NULL)
+			c = bind_compound(c, NULL, OP_GROUP);
+		break;
+	case SUBSHELL_BEGIN:
+		c = parse_command(1, false);
+		if (c != NULL && !accept_token(SUBSHELL_END))
+			return (command_t *) syntax_error();
+		if (c != NULL)
+			c = bind_compound(c, NULL, OP_SUBSHELL);
+		break;
+	case FOR:
+		c = parse_for();
+		break;
+	default:
+		c = parse_while();
+		break;
+	}
+
+	if (c == NULL)
+		return NULL;
+
+	accept_token(BLANK);
+	if (!parse_redirects(&red))
+		return NULL;
+
+	return bind_group_redirect(c, red);
+}
+
+
+/* SUBSHELL_BEGIN SUBSHELL_END group, after the name */
+static command_t * parse_function(const char * name)
+{
+	command_t * body, * c;
+
+	next_token();
+	if (!accept_token(SUBSHELL_END))
+		return (command_t *) syntax_error();
+
+	accept_token(BLANK);
+	if (lookahead != GROUP_BEGIN && lookahead != SUBSHELL_BEGIN &&
+	    lookahead != FOR && lookahead != WHILE)
+		return (command_t *) syntax_error();
+
+	body = parse_group();
+	if (body == NULL)
+		return NULL;
+
+	c = bind_compound(body, NULL, OP_FUNCTION);
+	c->scmd->verb = new_word(name, false);
+	return c;
+}
+
+
+/* operand := function | group | simple_command */
+static command_t * parse_operand(bool blankSeen)
+{
+	simple_command_t * scmd;
+	word_t * exe_name;
+	const char * name;
+
+	if (!blankSeen)
+		accept_token(BLANK);
+
+	if (lookahead == GROUP_BEGIN || lookahead == SUBSHELL_BEGIN ||
+	    lookahead == FOR || lookahead == WHILE)
+		return parse_group();
+
+	if (lookahead == WORD) {
+		/* "name()" starts a function, anything else a command */
+		name = tokenValue.string_un;
+		next_token();
+		if (lookahead == SUBSHELL_BEGIN)
+			return parse_function(name);
+		exe_name = parse_word_tail(new_word(name, false));
+		if (exe_name == NULL)
+			return NULL;
+	} else {
+		exe_name = parse_word();
+		if (exe_name == NULL)
+			return NULL;
+	}
+
+	scmd = parse_simple_command(exe_name);
+	if (scmd == NULL)
+		return NULL;
+
+	return new_command(scmd);
+}
+
+
+static bool is_end_token(int token)
+{
+	return token == END_OF_LINE || token == END_OF_FILE;
+}
+
+
+/* command_tree := command END | [BLANK] END */
+static bool parse_command_tree(command_t ** root)
+{
+	bool blankSeen;
+	command_t * c;
+
+	next_token();
+
+	blankSeen = accept_token(BLANK);
+	if (is_end_token(lookahead))
+		return true;
+
+	c = parse_command(1, blankSeen);
+	if (c == NULL)
+		return false;
+
+	if (!is_end_token(lookahead)) {
+		syntax_error();
+		return false;
+	}
+
+	*root = c;
+	return true;
+}
+
+
+/* Parses the input the lexer was just given */
+static bool parse_input(command_t ** root)
+{
+	syntaxError = false;
+
+	tokenLocation.first_line = tokenLocation.last_line = 1;
+	tokenLocation.first_column = tokenLocation.last_column = 0;
+
+	return parse_command_tree(root);
+}
+
+
+static bool parse_started(command_t ** root)
+{
+	needsFree = true;
+
+	if (!parse_input(root))
+		return false;
+
+	flatBuildTree(*root);
+	return true;
+}
+
+
+bool parse_line(const char * line, command_t ** root)
+{
+	if (*root != NULL) {
+		/* see the comment in parser.h */
+		assert(false);
+		return false;
+	}
+
+	if (line == NULL) {
+		/* see the comment in parser.h */
+		assert(false);
+		return false;
+	}
+
+	free_parse_memory();
+	globalParseAnotherString(line);
+
+	return parse_started(root);
+}
+
+
+bool parse_stream(parse_read_t read, void * opaque, command_t ** root)
+{
+	if (*root != NULL || read == NULL) {
+		/* see the comment in parser.h */
+		assert(false);
+		return false;
+	}
+
+	free_parse_memory();
+	globalParseAnotherStream(read, opaque);
+
+	return parse_started(root);
+}
+
+
+/*
+ * Lines of a context: its arena replaces the one of free_parse_memory()
+ * while they are parsed; the interned strings of the line are forgotten
+ * before and after, since they belong to one arena or the other.
+ */
+
+bool parserContextParse(parse_context_t * ctx, const char * line, command_t ** root)
+{
+	arenaChunk * saved = arenaHead;
+	bool ret;
+
+	arenaHead = (arenaChunk *)ctx->memory;
+	parserInternReset();
+	globalParseAnotherString(line);
+
+	ret = parse_input(root);
+
+	globalEndParsing();
+	parserInternReset();
+	ctx->memory = arenaHead;
+	arenaHead = saved;
+
+	return ret;
+}
+
+
+void parserContextRelease(parse_context_t * ctx)
+{
+	arenaChunk * saved = arenaHead;
+
+	arenaHead = (arenaChunk *)ctx->memory;
+	arena_reset();
+	ctx->memory = NULL;
+	arenaHead = saved;
+}
+
+
+void free_parse_memory(void)
+{
+	if (needsFree) {
+		globalEndParsing();
+		flatFreeTree();
+		parserInternReset();
+		arena_reset();
+		needsFree = false;
+	}
+}
@@ -0,0 +1,857 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Hand-written lexer, an alternative to the flex scanner in parser.l
+ * (build with LEXER=simd, see the Makefile).
+
+ * It emits exactly the same token stream as parser.l through yylex(),
+ * yylval and yylloc, so it can be linked with the bison parser unchanged.
+ * Its state is thread local, and parserLex() stores the token in the
+ * caller's variables instead, so it can be used by several threads at once
+ * (see parse_context_line()).
+
+ * The scanner works in place on the string passed to
+ * globalParseAnotherString() (nothing is copied up front, unlike
+ * yy_scan_string()), or on a window over the stream passed to
+ * globalParseAnotherStream(). A token that reaches the end of the window
+ * is scanned again after the window is refilled (and doubled, if the
+ * token takes half of it), so the tokens are the same as for the whole
+ * line.
+
+ * Runs of plain argument characters and the bodies of quoted strings,
+ * which make up most of the input, are skipped with SSE2/AVX2 compare
+ * masks, 16/32 bytes at a time; the rest of the tokens are at most three
+ * characters long and are matched by hand.
+ */
+
+
+#ifdef _WIN32
+#  ifndef WIN32
+#    define WIN32
+#  endif
+#endif
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define __PARSER_H_INTERNAL_INCLUDE
+#include "parser.h"
+#include "parser.tab.h"
+
+
+/*
+ * Same start conditions as in parser.l
+ */
+
+typedef enum {
+	LEX_INITIAL,
+	LEX_ACCEPT_ANY,
+	LEX_ACCEPT_ANY_AND_EXPANSION
+} lexStartCondition;
+
+const bool lexerIsReentrant = true;
+
+static PARSER_THREAD_LOCAL const char * lexCursor = NULL;
+static PARSER_THREAD_LOCAL lexStartCondition lexCondition = LEX_INITIAL;
+static PARSER_THREAD_LOCAL parserKeywords lexKeywords;
+
+/*
+ * The open "$(", "<(" and ">(", innermost last: the start condition to go back to at its
+ * ")" (it may be inside double quotes), and the number of "(" opened
+ * inside it and not closed yet
+ */
+#define LEX_MAX_SUBSTITUTIONS	64
+
+typedef struct {
+	lexStartCondition condition;
+	int parens;
+} lexSubstitution;
+
+static PARSER_THREAD_LOCAL lexSubstitution lexSubstitutions[LEX_MAX_SUBSTITUTIONS];
+static PARSER_THREAD_LOCAL int lexSubstitutionDepth;
+
+/* the here-documents of the line, whose bodies are read at its end */
+static PARSER_THREAD_LOCAL parserHeredoc lexHeredocs[PARSER_MAX_HEREDOCS];
+static PARSER_THREAD_LOCAL int lexHeredocCount;
+
+/* where parserLex() stores the token */
+static PARSER_THREAD_LOCAL YYSTYPE * lexValue = NULL;
+static PARSER_THREAD_LOCAL YYLTYPE * lexLocation = NULL;
+
+
+/*
+ * Stream input (see globalParseAnotherStream())
+
+ * lexLimit is the end of the data read so far, where a '\0' is stored;
+ * lexEof is set once read() returned 0 (and always for strings).
+ */
+
+#define LEX_WINDOW_SIZE		(16 * 1024)
+
+/* returned when a token may continue past lexLimit */
+#define LEX_NEED_MORE		(-1)
+
+static PARSER_THREAD_LOCAL parserStream lexStream;
+static PARSER_THREAD_LOCAL char * lexBuffer = NULL;
+static PARSER_THREAD_LOCAL size_t lexBufferSize = 0;
+static PARSER_THREAD_LOCAL const char * lexLimit = NULL;
+static PARSER_THREAD_LOCAL bool lexEof = true;
+
+
+static bool lexNeedMore(const char * p)
+{
+	return !lexEof && p == lexLimit;
+}
+
+
+/* at least count characters (or the end of the input) are available */
+static bool lexHaveAhead(const char * p, size_t count)
+{
+	return lexEof || (size_t)(lexLimit - p) >= count;
+}
+
+
+static void lexRefill(void)
+{
+	size_t keep = lexLimit - lexCursor;
+	char * newBuffer;
+	size_t count;
+
+	/* the pending token moves to the start of the window */
+	memmove(lexBuffer, lexCursor, keep);
+
+	if (keep >= lexBufferSize / 2) {
+		newBuffer = (char *)realloc(lexBuffer, 2 * lexBufferSize);
+		if (newBuffer == NULL) {
+			fprintf(stderr, "realloc() failed\n");
+			exit(EXIT_FAILURE);
+		}
+		lexBuffer = newBuffer;
+		lexBufferSize *= 2;
+	}
+
+	/* fill the window, so a long token is not scanned again for every chunk */
+	while (keep < lexBufferSize - 1) {
+		count = parserStreamRead(&lexStream, lexBuffer + keep, lexBufferSize - 1 - keep);
+		if (count == 0) {
+			lexEof = true;
+			break;
+		}
+		keep += count;
+	}
+
+	lexCursor = lexBuffer;
+	lexLimit = lexBuffer + keep;
+	lexBuffer[keep] = '\0';
+}
+
+
+#define UPD_LOCATION(len) \
+	do { \
+		lexLocation->first_column = lexLocation->last_column; \
+		lexLocation->last_column += (int)(len); \
+	} while (0)
+
+
+/*
+ * {parameterChar} from parser.l: [a-zA-Z0-9\-\\+:._%?*~/,]
+ */
+
+static bool isParameterChar(unsigned char c)
+{
+	if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')
+		return true;
+
+	/* '+' ',' '-' '.' '/' digits ':' are contiguous */
+	if (c >= '+' && c <= ':')
+		return true;
+
+	switch (c) {
+	case '!':
+	case '%':
+	case '*':
+	case '?':
+	case '[':
+	case ']':
+	case '~':
+	case '_':
+	case '\\':
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+/*
+ * Length of the backslash-newline ("\\\n" or "\\\r\n") at p, 0 if there is
+ * none; it joins two lines and is skipped, even inside a blank or a word
+ */
+
+static size_t continuationLength(const char * p)
+{
+	if (p[0] != '\\')
+		return 0;
+	if (p[1] == '\n')
+		return 2;
+	if (p[1] == '\r' && p[2] == '\n')
+		return 3;
+	return 0;
+}
+
+
+static bool isEnvVarStart(unsigned char c)
+{
+	return c == '_' || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+}
+
+
+static bool isEnvVarChar(unsigned char c)
+{
+	return isEnvVarStart(c) || (c >= '0' && c <= '9');
+}
+
+
+/*
+ * Vector helpers
+
+ * Loads are always aligned to the vector width, so they never cross a page
+ * boundary and it is safe to read past the terminating '\0' of the line;
+ * the bytes before the cursor are masked out of the first block.
+
+ * The *StopMask() helpers return one bit per byte that ends the current
+ * run (the terminating '\0' always does).
+ */
+
+#if defined(__AVX2__)
+
+typedef __m256i lexVector;
+#define LEX_VECTOR_SIZE		32
+#define vecLoad(p)		_mm256_load_si256((const __m256i *)(p))
+#define vecSet(c)		_mm256_set1_epi8((char)(c))
+#define vecEq(a, b)		_mm256_cmpeq_epi8((a), (b))
+#define vecOr(a, b)		_mm256_or_si256((a), (b))
+#define vecSub(a, b)		_mm256_sub_epi8((a), (b))
+#define vecMinU(a, b)		_mm256_min_epu8((a), (b))
+#define vecMask(a)		((uint32_t)_mm256_movemask_epi8(a))
+#define LEX_VECTOR_BITS		0xffffffffu
+
+#elif defined(__SSE2__)
+
+typedef __m128i lexVector;
+#define LEX_VECTOR_SIZE		16
+#define vecLoad(p)		_mm_load_si128((const __m128i *)(p))
+#define vecSet(c)		_mm_set1_epi8((char)(c))
+#define vecEq(a, b)		_mm_cmpeq_epi8((a), (b))
+#define vecOr(a, b)		_mm_or_si128((a), (b))
+#define vecSub(a, b)		_mm_sub_epi8((a), (b))
+#define vecMinU(a, b)		_mm_min_epu8((a), (b))
+#define vecMask(a)		((uint32_t)_mm_movemask_epi8(a))
+#define LEX_VECTOR_BITS		0xffffu
+
+#endif
+
+
+#ifdef LEX_VECTOR_SIZE
+
+/* lo <= x <= hi, as unsigned bytes */
+static inline lexVector vecInRange(lexVector x, unsigned char lo, unsigned char hi)
+{
+	lexVector t = vecSub(x, vecSet(lo));
+
+	return vecEq(vecMinU(t, vecSet(hi - lo)), t);
+}
+
+
+static inline uint32_t parameterStopMask(lexVector x)
+{
+	lexVector ok;
+
+	ok = vecInRange(vecOr(x, vecSet(0x20)), 'a', 'z');
+	ok = vecOr(ok, vecInRange(x, '+', ':'));
+	ok = vecOr(ok, vecEq(x, vecSet('!')));
+	ok = vecOr(ok, vecEq(x, vecSet('%')));
+	ok = vecOr(ok, vecEq(x, vecSet('*')));
+	ok = vecOr(ok, vecEq(x, vecSet('?')));
+	ok = vecOr(ok, vecEq(x, vecSet('[')));
+	ok = vecOr(ok, vecEq(x, vecSet(']')));
+	ok = vecOr(ok, vecEq(x, vecSet('~')));
+	ok = vecOr(ok, vecEq(x, vecSet('_')));
+	ok = vecOr(ok, vecEq(x, vecSet('\\')));
+
+	return ~vecMask(ok) & LEX_VECTOR_BITS;
+}
+
+
+static inline uint32_t quoteStopMask(lexVector x, char quote, bool expansion)
+{
+	lexVector stop;
+
+	stop = vecOr(vecEq(x, vecSet(quote)), vecEq(x, vecSet('\0')));
+	if (expansion)
+		stop = vecOr(stop, vecEq(x, vecSet('$')));
+
+	return vecMask(stop);
+}
+
+
+#define SCAN_WITH(maskExpr) \
+	do { \
+		uintptr_t offset = (uintptr_t)p % LEX_VECTOR_SIZE; \
+		const char * block = p - offset; \
+		uint32_t mask; \
+		lexVector x = vecLoad(block); \
+		\
+		mask = (maskExpr) >> offset; \
+		if (mask != 0) \
+			return p + __builtin_ctz(mask); \
+		\
+		for (;;) { \
+			block += LEX_VECTOR_SIZE; \
+			x = vecLoad(block); \
+			mask = (maskExpr); \
+			if (mask != 0) \
+				return block + __builtin_ctz(mask); \
+		} \
+	} while (0)
+
+#endif
+
+
+/*
+ * Returns the first character after the run of {parameterChar}
+ * characters starting at p
+ */
+
+static const char * skipParameterChars(const char * p)
+{
+#ifdef LEX_VECTOR_SIZE
+	SCAN_WITH(parameterStopMask(x));
+#else
+	while (isParameterChar((unsigned char)*p))
+		p++;
+	return p;
+#endif
+}
+
+
+/*
+ * Returns the end of the word at p: {parameterValue} characters, and
+ * "{...}" groups of them, which are split by brace expansion. A "{" that
+ * is not closed on the line is not part of the word.
+ */
+
+static const char * skipWordChars(const char * p)
+{
+	const char * close;
+
+	for (;;) {
+		p = skipParameterChars(p);
+		if (*p != '{')
+			return p;
+
+		close = skipParameterChars(p + 1);
+		if (*close != '}')
+			return lexNeedMore(close) ? close : p;
+		p = close + 1;
+	}
+}
+
+
+/*
+ * Returns the first occurrence of quote (or '$' when expansion is true)
+ * or of the terminating '\0', starting at p
+ */
+
+static const char * skipQuotedChars(const char * p, char quote, bool expansion)
+{
+#ifdef LEX_VECTOR_SIZE
+	SCAN_WITH(quoteStopMask(x, quote, expansion));
+#else
+	while (*p != '\0' && *p != quote && !(expansion && *p == '$'))
+		p++;
+	return p;
+#endif
+}
+
+
+/*
+ * Handles "$(", "<(" and ">(", which return token: the lexer goes on as
+ * outside quotes until the matching ")"
+ */
+
+static int lexSubstitutionBegin(int token)
+{
+	if (lexSubstitutionDepth == LEX_MAX_SUBSTITUTIONS) {
+		lexCursor++;
+		UPD_LOCATION(1);
+		return NOT_ACCEPTED_CHAR;
+	}
+
+	lexSubstitutions[lexSubstitutionDepth].condition = lexCondition;
+	lexSubstitutions[lexSubstitutionDepth].parens = 0;
+	lexSubstitutionDepth++;
+	lexCondition = LEX_INITIAL;
+
+	lexCursor += 2;
+	UPD_LOCATION(2);
+	return token;
+}
+
+
+/*
+ * Handles "${...}" (see parser.param.c); lexCursor points to the '$'.
+ */
+
+static int lexParameter(bool quoted)
+{
+	const char * start = lexCursor + 2;
+	const char * end = parserParameterEnd(start, NULL, quoted);
+
+	if (end != NULL && lexNeedMore(end))
+		return LEX_NEED_MORE;
+
+	if (end == NULL || *end != '}') {
+		lexCursor++;
+		UPD_LOCATION(1);
+		return INVALID_ENVIRONMENT_VAR;
+	}
+
+	lexCursor = end + 1;
+	UPD_LOCATION(end - start + 3);
+	lexValue->string_un = parserInternToken(start, end - start);
+	return quoted ? QUOTED_ENV_VAR : ENV_VAR;
+}
+
+
+/*
+ * Handles "$((...))" (see parser.param.c), or returns 0 if the "$((" is
+ * a "$(" followed by a subshell; lexCursor points to the '$'.
+ */
+
+static int lexArithmetic(bool quoted)
+{
+	const char * start = lexCursor + 1;
+	const char * end = parserArithmeticEnd(start + 2, NULL);
+
+	if (end != NULL && lexNeedMore(end))
+		return LEX_NEED_MORE;
+	if (end == NULL || *end != ')')
+		return 0;
+
+	end += 2;
+	lexCursor = end;
+	UPD_LOCATION(end - start + 1);
+	lexValue->string_un = parserInternToken(start, end - start);
+	return quoted ? QUOTED_ENV_VAR : ENV_VAR;
+}
+
+
+/*
+ * Handles {substitutionCharacter}{envVarName}, {substitutionCharacter},
+ * "$(", "$((" and "${"; lexCursor points to the '$'. Inside double
+ * quotes, the tokens are the QUOTED_ ones.
+ */
+
+static int lexEnvVar(void)
+{
+	const char * start = lexCursor + 1;
+	const char * end = start;
+	bool quoted = lexCondition == LEX_ACCEPT_ANY_AND_EXPANSION;
+	int token;
+
+	if (lexNeedMore(end))
+		return LEX_NEED_MORE;
+
+	if (*end == '(') {
+		if (lexNeedMore(end + 1))
+			return LEX_NEED_MORE;
+		if (end[1] == '(') {
+			token = lexArithmetic(quoted);
+			if (token != 0)
+				return token;
+		}
+		return lexSubstitutionBegin(quoted ? QUOTED_SUBSTITUTION_BEGIN : SUBSTITUTION_BEGIN);
+	}
+
+	if (*end == '{')
+		return lexParameter(quoted);
+
+	if (!isEnvVarStart((unsigned char)*end)) {
+		lexCursor++;
+		UPD_LOCATION(1);
+		return INVALID_ENVIRONMENT_VAR;
+	}
+
+	while (isEnvVarChar((unsigned char)*end))
+		end++;
+
+	if (lexNeedMore(end))
+		return LEX_NEED_MORE;
+
+	lexCursor = end;
+	UPD_LOCATION(end - start + 1);
+	lexValue->string_un = parserInternToken(start, end - start);
+	return quoted ? QUOTED_ENV_VAR : ENV_VAR;
+}
+
+
+static int lexOperator(int token, size_t len)
+{
+	lexCursor += len;
+	UPD_LOCATION(len);
+	return token;
+}
+
+
+/*
+ * Handles "<<word"; lexCursor points to the first '<'. Without a
+ * delimiter, the first '<' is an INDIRECT, as in parser.l.
+ */
+
+static int lexHeredoc(void)
+{
+	const char * end;
+	char * delimiter;
+	bool quoted;
+	word_t * w;
+
+	/* the delimiter (and its quotes) ends on the line */
+	if (!lexEof && strchr(lexCursor, '\n') == NULL)
+		return LEX_NEED_MORE;
+
+	end = parserHeredocDelimiter(lexCursor + 2, NULL, NULL);
+
+	if (lexHeredocCount == PARSER_MAX_HEREDOCS)
+		return lexOperator(NOT_ACCEPTED_CHAR, 1);
+
+	delimiter = (char *)parserAlloc(end - lexCursor - 1);
+	parserHeredocDelimiter(lexCursor + 2, delimiter, &quoted);
+	if (delimiter[0] == '\0')
+		return lexOperator(INDIRECT, 1);
+
+	w = (word_t *)parserAlloc(sizeof(word_t));
+	memset(w, 0, sizeof(*w));
+	w->string = "";
+	lexHeredocs[lexHeredocCount].word = w;
+	lexHeredocs[lexHeredocCount].delimiter = delimiter;
+	lexHeredocs[lexHeredocCount].expand = !quoted;
+	lexHeredocCount++;
+
+	lexValue->word_un = w;
+	return lexOperator(HERE_DOC, end - lexCursor);
+}
+
+
+/*
+ * The end of a line, len characters at lexCursor (the newline and the
+ * bodies of its here-documents): inside a compound command or a
+ * substitution, it ends a command like ";" does, or is a blank where a
+ * command may start
+ */
+
+static int lexLineEnd(size_t len)
+{
+	if (lexKeywords.depth != 0)
+		return lexOperator(lexKeywords.command_start ? BLANK : SEQUENTIAL, len);
+	if (lexCursor[len] != '\0')
+		return lexOperator(CHARS_AFTER_EOL, len + 1);
+	return lexOperator(END_OF_LINE, len);
+}
+
+
+/*
+ * The end of a line with here-documents, the newline (len characters) at
+ * lexCursor: reads their bodies, then ends the line like the newline does
+ */
+
+static int lexHeredocBodies(size_t len)
+{
+	const char * start[PARSER_MAX_HEREDOCS];
+	const char * end[PARSER_MAX_HEREDOCS];
+	const char * p = lexCursor + len;
+	int i;
+
+	/* all of the bodies must be in the window */
+	for (i = 0; i < lexHeredocCount; i++) {
+		start[i] = p;
+		p = parserHeredocBody(p, lexHeredocs[i].delimiter, &end[i]);
+		if (lexNeedMore(p))
+			return LEX_NEED_MORE;
+	}
+
+	for (i = 0; i < lexHeredocCount; i++)
+		parserHeredocSetBody(&lexHeredocs[i], start[i], end[i] - start[i]);
+	lexHeredocCount = 0;
+
+	return lexLineEnd(p - lexCursor);
+}
+
+
+static int lexInitial(void)
+{
+	const char * p = lexCursor;
+	const char * end;
+	size_t len;
+	int token;
+
+	/* operators are up to three characters long */
+	if (!lexHaveAhead(p, 3))
+		return LEX_NEED_MORE;
+
+	switch (*p) {
+	case '\0':
+		return END_OF_FILE;
+
+	case '\r':
+		if (p[1] != '\n')
+			return lexOperator(NOT_ACCEPTED_CHAR, 1);
+		if (lexHeredocCount != 0)
+			return lexHeredocBodies(2);
+		return lexLineEnd(2);
+
+	case '\n':
+		if (lexHeredocCount != 0)
+			return lexHeredocBodies(1);
+		return lexLineEnd(1);
+
+	case '\'':
+		lexOperator(0, 1);
+		lexCondition = LEX_ACCEPT_ANY;
+		return 0;
+
+	case '"':
+		lexOperator(0, 1);
+		lexCondition = LEX_ACCEPT_ANY_AND_EXPANSION;
+		return 0;
+
+	case ';':
+		return lexOperator(SEQUENTIAL, 1);
+
+	case '|':
+		if (p[1] == '|')
+			return lexOperator(CONDITIONAL_NZERO, 2);
+		return lexOperator(PIPE, 1);
+
+	case '&':
+		if (p[1] == '&')
+			return lexOperator(CONDITIONAL_ZERO, 2);
+		if (p[1] == '>')
+			return lexOperator(REDIRECT_OE, 2);
+		return lexOperator(PARALLEL, 1);
+
+	case '2':
+		if (p[1] != '>')
+			break;
+		if (p[2] == '>')
+			return lexOperator(REDIRECT_APPEND_E, 3);
+		return lexOperator(REDIRECT_E, 2);
+
+	case '>':
+		if (p[1] == '>')
+			return lexOperator(REDIRECT_APPEND_O, 2);
+		if (p[1] == '(')
+			return lexSubstitutionBegin(PROCESS_OUT_BEGIN);
+		return lexOperator(REDIRECT_O, 1);
+
+	case '<':
+		if (p[1] == '(')
+			return lexSubstitutionBegin(PROCESS_IN_BEGIN);
+		if (p[1] == '<' && p[2] == '<')
+			return lexOperator(HERE_STRING, 3);
+		if (p[1] == '<')
+			return lexHeredoc();
+		return lexOperator(INDIRECT, 1);
+
+	case '{':
+		/* "{" only opens a group when a blank follows */
+		if (p[1] != ' ' && p[1] != '\t' && p[1] != '\n' && p[1] != '\r')
+			break;
+		return lexOperator(GROUP_BEGIN, 1);
+
+	case '}':
+		return lexOperator(GROUP_END, 1);
+
+	case '(':
+		if (lexSubstitutionDepth != 0)
+			lexSubstitutions[lexSubstitutionDepth - 1].parens++;
+		return lexOperator(SUBSHELL_BEGIN, 1);
+
+	case ')':
+		if (lexSubstitutionDepth != 0 &&
+		    lexSubstitutions[lexSubstitutionDepth - 1].parens-- == 0) {
+			lexCondition = lexSubstitutions[--lexSubstitutionDepth].condition;
+			return lexOperator(SUBSTITUTION_END, 1);
+		}
+		return lexOperator(SUBSHELL_END, 1);
+
+	case ' ':
+	case '\t':
+		end = p + 1;
+		for (;;) {
+			while (*end == ' ' || *end == '\t')
+				end++;
+			if (!lexHaveAhead(end, 3))
+				return LEX_NEED_MORE;
+			len = continuationLength(end);
+			if (len == 0)
+				break;
+			end += len;
+		}
+		return lexOperator(BLANK, end - p);
+
+	case '\\':
+		len = continuationLength(p);
+		if (len == 0)
+			break;
+		lexOperator(0, len);
+		return 0;
+
+	case '=':
+		lexValue->string_un = parserInternToken(p, 1);
+		return lexOperator(WORD, 1);
+
+	case '$':
+		return lexEnvVar();
+
+	default:
+		break;
+	}
+
+	end = skipWordChars(p);
+	if (!lexHaveAhead(end, 2))
+		return LEX_NEED_MORE;
+	if (end == p)
+		return lexOperator(NOT_ACCEPTED_CHAR, 1);
+	/* a trailing backslash may start a backslash-newline */
+	if (continuationLength(end - 1) != 0)
+		end--;
+	token = parserKeyword(&lexKeywords, p, end - p, *end);
+	if (token != 0)
+		return lexOperator(token, end - p);
+	lexValue->string_un = parserInternToken(p, end - p);
+	return lexOperator(WORD, end - p);
+}
+
+
+static int lexQuoted(char quote, bool expansion)
+{
+	const char * p = lexCursor;
+	const char * end;
+
+	if (!lexHaveAhead(p, 2))
+		return LEX_NEED_MORE;
+
+	if (*p == '\0')
+		return UNEXPECTED_EOF;
+
+	if (*p == quote) {
+		lexOperator(0, 1);
+		lexCondition = LEX_INITIAL;
+		return 0;
+	}
+
+	if (expansion && *p == '$')
+		return lexEnvVar();
+
+	end = skipQuotedChars(p + 1, quote, expansion);
+	if (lexNeedMore(end))
+		return LEX_NEED_MORE;
+	lexValue->string_un = parserInternToken(p, end - p);
+	return lexOperator(QUOTED_WORD, end - p);
+}
+
+
+int parserLex(YYSTYPE * lval, YYLTYPE * lloc)
+{
+	int token;
+
+	assert(lexCursor != NULL);
+	lexValue = lval;
+	lexLocation = lloc;
+
+	/* quotes only switch the start condition, as in parser.l */
+	do {
+		switch (lexCondition) {
+		case LEX_ACCEPT_ANY:
+			token = lexQuoted('\'', false);
+			break;
+		case LEX_ACCEPT_ANY_AND_EXPANSION:
+			token = lexQuoted('"', true);
+			break;
+		default:
+			token = lexInitial();
+			break;
+		}
+
+		if (token == LEX_NEED_MORE) {
+			lexRefill();
+			token = 0;
+		} else if (token != 0 && !parserKeywordsUpdate(&lexKeywords, token)) {
+			token = 0;
+		}
+	} while (token == 0);
+
+	return token;
+}
+
+
+int yylex(void)
+{
+	return parserLex(&yylval, &yylloc);
+}
+
+
+void globalParseAnotherString(const char * str)
+{
+	globalEndParsing();
+	lexCursor = str;
+	lexCondition = LEX_INITIAL;
+	parserKeywordsInit(&lexKeywords);
+	lexSubstitutionDepth = 0;
+	lexHeredocCount = 0;
+}
+
+
+void globalParseAnotherStream(parse_read_t read, void * opaque)
+{
+	globalEndParsing();
+
+	lexBufferSize = LEX_WINDOW_SIZE;
+	lexBuffer = (char *)malloc(lexBufferSize);
+	if (lexBuffer == NULL) {
+		fprintf(stderr, "malloc() failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	lexBuffer[0] = '\0';
+	lexCursor = lexLimit = lexBuffer;
+	parserStreamInit(&lexStream, read, opaque);
+	lexEof = false;
+	lexCondition = LEX_INITIAL;
+	parserKeywordsInit(&lexKeywords);
+	lexSubstitutionDepth = 0;
+	lexHeredocCount = 0;
+}
+
+
+void globalEndParsing(void)
+{
+	free(lexBuffer);
+	lexBuffer = NULL;
+	lexBufferSize = 0;
+	lexLimit = NULL;
+	memset(&lexStream, 0, sizeof(lexStream));
+	lexEof = true;
+
+	lexCursor = NULL;
+	lexCondition = LEX_INITIAL;
+}
@@ -0,0 +1,375 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Stream input common to both lexers (see parse_stream())
+
+ * The chunks returned by the reader go through parse_scan(), which keeps
+ * just enough of the lexer state (the open quote, a trailing
+ * backslash-newline, the delimiters of the here-documents and the
+ * compound commands still open) to tell whether the command line goes
+ * on; in that case the reader is asked for the next line when it reaches
+ * the end of the current one, and the lexer sees a single stream and
+ * never scans the previous lines again.
+ */
+
+
+#ifdef __cplusplus
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+#else
+
+#include <stdlib.h>
+#include <string.h>
+
+#endif
+
+
+#define __PARSER_H_INTERNAL_INCLUDE
+#include "parser.h"
+
+
+enum {
+	SCAN_HEREDOC_NONE,
+	SCAN_HEREDOC_BLANKS,	/* after "<<" */
+	SCAN_HEREDOC_WORD,	/* in the delimiter */
+	SCAN_HEREDOC_BACKSLASH,	/* after a backslash in the delimiter */
+	SCAN_HEREDOC_BODY	/* in the bodies, after the end of the line */
+};
+
+
+static void scan_delimiter_add(parse_scan_t * scan, char c)
+{
+	/* the last character is kept for the '\0' */
+	if (scan->length < PARSE_SCAN_DELIMITERS_SIZE - 1)
+		scan->delimiters[scan->length++] = c;
+}
+
+
+static void scan_delimiter_end(parse_scan_t * scan)
+{
+	unsigned short start = scan->current;
+
+	scan->heredoc = SCAN_HEREDOC_NONE;
+	/* an empty delimiter is two "<" */
+	if (scan->length == start)
+		return;
+
+	scan->delimiters[scan->length] = '\0';
+	if (scan->length < PARSE_SCAN_DELIMITERS_SIZE - 1)
+		scan->length++;
+	scan->current = scan->length;
+}
+
+
+/*
+ * The delimiter after "<<" (see parserHeredocDelimiter()), one character
+ * at a time; returns false at its end, where c is scanned as usual
+ */
+
+static bool scan_delimiter(parse_scan_t * scan, char c)
+{
+	if (scan->heredoc_quote != '\0') {
+		if (c == scan->heredoc_quote) {
+			scan->heredoc_quote = '\0';
+		} else if (c != '\n') {
+			scan_delimiter_add(scan, c);
+		} else {
+			/* not closed: the quote is an open quote of the line */
+			scan->length = scan->quote_start;
+			scan->quote = scan->heredoc_quote;
+			scan->heredoc_quote = '\0';
+			scan_delimiter_end(scan);
+		}
+		return true;
+	}
+
+	switch (scan->heredoc) {
+	case SCAN_HEREDOC_BLANKS:
+		if (c == ' ' || c == '\t')
+			return true;
+		scan->heredoc = SCAN_HEREDOC_WORD;
+		return scan_delimiter(scan, c);
+	case SCAN_HEREDOC_BACKSLASH:
+		if (c == '\r' || c == '\n') {
+			scan_delimiter_end(scan);
+			scan->pending = '\\';
+			return false;
+		}
+		scan_delimiter_add(scan, c);
+		scan->heredoc = SCAN_HEREDOC_WORD;
+		return true;
+	default:
+		break;
+	}
+
+	if (c == '\'' || c == '"') {
+		scan->heredoc_quote = c;
+		scan->quote_start = scan->length;
+	} else if (c == '\\') {
+		scan->heredoc = SCAN_HEREDOC_BACKSLASH;
+	} else if (strchr(" \t\r\n;&|<>()", c) == NULL) {
+		scan_delimiter_add(scan, c);
+	} else {
+		scan_delimiter_end(scan);
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * A character of the bodies: at the end of each line, checks whether the
+ * line was the delimiter of the current body
+ */
+
+static void scan_body(parse_scan_t * scan, char c)
+{
+	const char * delimiter = scan->delimiters + scan->current;
+	short len = (short)strlen(delimiter);
+
+	if (c != '\n') {
+		if (scan->match >= 0 && scan->match < len && delimiter[scan->match] == c)
+			scan->match++;
+		else if (!(c == '\r' && scan->match == len))
+			scan->match = -1;
+		return;
+	}
+
+	if (scan->match == len) {
+		scan->current += len + 1;
+		if (scan->current >= scan->length) {
+			scan->heredoc = SCAN_HEREDOC_NONE;
+			scan->length = scan->current = 0;
+		}
+	}
+	scan->match = 0;
+}
+
+
+static bool scan_word_is(const parse_scan_t * scan, const char * keyword)
+{
+	return scan->word_length == strlen(keyword) &&
+		memcmp(scan->word, keyword, scan->word_length) == 0;
+}
+
+
+/*
+ * The end of a word, which may be a keyword (see parser.keyword.c) if it
+ * is the first one of a command
+ */
+
+static void scan_word_end(parse_scan_t * scan)
+{
+	if (scan->word_length == 0)
+		return;
+
+	if (!scan->argument) {
+		if (scan_word_is(scan, "for")) {
+			scan->depth++;
+			scan->argument = true;
+		} else if (scan_word_is(scan, "while")) {
+			scan->depth++;
+		} else if (scan_word_is(scan, "done")) {
+			if (scan->depth != 0)
+				scan->depth--;
+			scan->argument = true;
+		} else if (!scan_word_is(scan, "do")) {
+			scan->argument = true;
+		}
+	}
+
+	scan->word_length = 0;
+}
+
+
+/*
+ * The compound commands opened and closed by c, outside quotes and
+ * arithmetic expansions; dollar tells whether a "$" was just seen
+ */
+
+static void scan_compound(parse_scan_t * scan, char c, bool dollar)
+{
+	/* "{" opens a group when a blank follows, else it is part of a word */
+	if (scan->brace == 1) {
+		scan->brace = 2;
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			scan->brace = 0;
+			scan->depth++;
+			scan->argument = false;
+		}
+	}
+
+	if (strchr(" \t\r\n;&|<>(){}", c) == NULL) {
+		/* quotes and expansions make a word that is not a keyword */
+		if (strchr("'\"\\$", c) != NULL)
+			scan->word_length = sizeof(scan->word) + 1;
+		else if (scan->word_length < sizeof(scan->word))
+			scan->word[scan->word_length++] = c;
+		else
+			scan->word_length = sizeof(scan->word) + 1;
+		return;
+	}
+
+	/* a backslash-newline does not end the word */
+	if (c == '\n' && scan->pending != '\0')
+		return;
+
+	scan_word_end(scan);
+	if (c != '{' && c != '}')
+		scan->brace = 0;
+
+	switch (c) {
+	case '\n':
+	case ';':
+	case '&':
+	case '|':
+		scan->argument = false;
+		break;
+	case '(':
+		scan->depth++;
+		scan->argument = false;
+		break;
+	case ')':
+		if (scan->depth != 0)
+			scan->depth--;
+		scan->argument = true;
+		break;
+	case '{':
+		if (dollar)
+			scan->params++;
+		else
+			scan->brace = 1;
+		break;
+	case '}':
+		if (scan->params != 0) {
+			scan->params--;
+		} else if (scan->brace == 2) {
+			scan->brace = 0;
+		} else if (scan->depth != 0) {
+			scan->depth--;
+			scan->argument = true;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+
+bool parse_scan(parse_scan_t * scan, const char * text, size_t len)
+{
+	const char * p = text;
+	const char * end = text + len;
+	const char * close;
+
+	while (p < end) {
+		if (scan->heredoc == SCAN_HEREDOC_BODY) {
+			scan_body(scan, *p++);
+			continue;
+		}
+
+		if (scan->heredoc != SCAN_HEREDOC_NONE && scan_delimiter(scan, *p)) {
+			p++;
+			continue;
+		}
+
+		if (scan->quote != '\0') {
+			/* everything up to the closing quote, newlines included */
+			close = (const char *)memchr(p, scan->quote, end - p);
+			if (close == NULL)
+				break;
+			scan->quote = '\0';
+			p = close + 1;
+			continue;
+		}
+
+		/* an arithmetic expansion, up to its "))" */
+		if (scan->parens != 0) {
+			if (*p == '(')
+				scan->parens++;
+			else if (*p == ')')
+				scan->parens--;
+			p++;
+			continue;
+		}
+
+		/* "<<" starts a here-document, but not "<<<" */
+		if (*p != '<' && scan->less == 2) {
+			scan->less = 0;
+			scan->heredoc = SCAN_HEREDOC_BLANKS;
+			continue;
+		}
+		scan->less = *p != '<' ? 0 : scan->less == 3 ? 1 : scan->less + 1;
+
+		if (*p == '(' && scan->dollar == 2) {
+			/* the first "(" did not open a subshell */
+			scan->parens = 2;
+			scan->depth--;
+		} else {
+			scan_compound(scan, *p, scan->dollar == 1);
+		}
+		scan->dollar = *p == '$' ? 1 : *p == '(' && scan->dollar == 1 ? 2 : 0;
+
+		switch (*p) {
+		case '\n':
+			scan->incomplete = scan->pending != '\0';
+			/* the bodies start on the next line */
+			if (scan->pending == '\0' && scan->length != 0) {
+				scan->heredoc = SCAN_HEREDOC_BODY;
+				scan->current = 0;
+				scan->match = 0;
+			}
+			scan->pending = '\0';
+			break;
+		case '\r':
+			scan->pending = scan->pending == '\\' ? '\r' : '\0';
+			break;
+		case '\\':
+			scan->pending = '\\';
+			break;
+		case '\'':
+		case '"':
+			scan->quote = *p;
+			scan->pending = '\0';
+			break;
+		default:
+			scan->pending = '\0';
+			break;
+		}
+
+		if (*p != '\n')
+			scan->incomplete = false;
+		p++;
+	}
+
+	return scan->incomplete || scan->quote != '\0' ||
+		scan->heredoc == SCAN_HEREDOC_BODY || scan->depth != 0;
+}
+
+
+void parserStreamInit(parserStream * stream, parse_read_t read, void * opaque)
+{
+	memset(stream, 0, sizeof(*stream));
+	stream->read = read;
+	stream->opaque = opaque;
+}
+
+
+size_t parserStreamRead(parserStream * stream, char * buf, size_t size)
+{
+	size_t count = stream->read(stream->opaque, buf, size);
+
+	/* end of a line, but not of the command: ask for the next line */
+	if (count == 0 && parse_scan(&stream->scan, NULL, 0))
+		count = stream->read(stream->opaque, buf, size);
+
+	if (count != 0)
+		parse_scan(&stream->scan, buf, count);
+
+	return count;
+}
@@ -39,6 +39,9 @@ static size_t globalAllocSize  = 0;
 static bool needsFree = false;
 static command_t * command_root = NULL;
 
+/* yyparse() and its globals are not reentrant, see parse_context_line() */
+const bool parserIsReentrant = false;
+
 
 void yyerror(const char* str);
 
@@ -88,6 +91,19 @@ void pointerToMallocMemory(const void * ptr)
 }
 
 
+/*
+ * Memory that lives until free_parse_memory() (used by parser.simd.c)
+ */
+
+void * parserAlloc(size_t size)
+{
+	void * ptr = malloc(size);
+
+	pointerToMallocMemory(ptr);
+	return ptr;
+}
+
+
 static simple_command_t * bind_parts(word_t * exe_name, word_t * params, redirect_t red)
 {
 	simple_command_t * s = (simple_command_t *) malloc(sizeof(simple_command_t));
@@ -154,6 +170,79 @@ static command_t * bind_commands(command_t * cmd1, command_t * cmd2, operator_t
 }
 
 
+static word_t * new_word(const char * str, bool expand);
+
+
+/*
+ * Groups and loops: the redirections (and the variable and the words of
+ * a for) go to a simple command without verb
+ */
+
+static command_t * bind_compound(command_t * cmd1, command_t * cmd2, operator_t op)
+{
+	command_t * c = (command_t *) malloc(sizeof(command_t));
+	simple_command_t * s = (simple_command_t *) malloc(sizeof(simple_command_t));
+	pointerToMallocMemory(c);
+	pointerToMallocMemory(s);
+
+	memset(c, 0, sizeof(*c));
+	c->up = NULL;
+	assert(cmd1 != NULL);
+	assert(cmd1->up == NULL);
+	c->cmd1 = cmd1;
+	cmd1->up = c;
+	c->cmd2 = cmd2;
+	if (cmd2 != NULL) {
+		assert(cmd2->up == NULL);
+		cmd2->up = c;
+	}
+	assert((op >= OP_GROUP) && (op < OP_DUMMY));
+	c->op = op;
+	c->aux = NULL;
+
+	memset(s, 0, sizeof(*s));
+	s->verb = NULL;
+	s->params = NULL;
+	s->up = c;
+	s->aux = NULL;
+	c->scmd = s;
+
+	return c;
+}
+
+
+static command_t * bind_for(const char * name, word_t * words, command_t * body)
+{
+	command_t * c = bind_compound(body, NULL, OP_FOR);
+
+	c->scmd->verb = new_word(name, false);
+	c->scmd->params = words;
+
+	return c;
+}
+
+
+static command_t * bind_function(const char * name, command_t * body)
+{
+	command_t * c = bind_compound(body, NULL, OP_FUNCTION);
+
+	c->scmd->verb = new_word(name, false);
+
+	return c;
+}
+
+
+static command_t * bind_group_redirect(command_t * c, redirect_t red)
+{
+	c->scmd->in = red.red_i;
+	c->scmd->out = red.red_o;
+	c->scmd->err = red.red_e;
+	c->scmd->io_flags = red.red_flags;
+
+	return c;
+}
+
+
 static word_t * new_word(const char * str, bool expand)
 {
 	word_t * w = (word_t *) malloc(sizeof(word_t));
@@ -165,6 +254,35 @@ static word_t * new_word(const char * str, bool expand)
 	w->expand = expand;
 	w->next_part = NULL;
 	w->next_word = NULL;
+	w->command = NULL;
+	w->quoted = false;
+
+	return w;
+}
+
+
+/* A part from inside quotes */
+static word_t * new_quoted_word(const char * str, bool expand)
+{
+	word_t * w = new_word(str, expand);
+
+	w->quoted = true;
+	return w;
+}
+
+
+/*
+ * A "$(command)" part, or a "<(command)" or ">(command)" one (kind is
+ * "", "<" or ">")
+ */
+
+static word_t * new_substitution(command_t * c, const char * kind)
+{
+	word_t * w = new_word(kind, false);
+
+	assert(c != NULL);
+	assert(c->up == NULL);
+	w->command = c;
 
 	return w;
 }
@@ -237,20 +355,29 @@ static word_t * add_word_to_list(word_t * w, word_t * lst)
 %token END_OF_FILE END_OF_LINE BLANK
 %token REDIRECT_OE REDIRECT_O REDIRECT_E INDIRECT
 %token REDIRECT_APPEND_E REDIRECT_APPEND_O
+%token GROUP_BEGIN GROUP_END SUBSHELL_BEGIN SUBSHELL_END
+%token FOR WHILE DO DONE IN
+%token SUBSTITUTION_BEGIN SUBSTITUTION_END PROCESS_IN_BEGIN PROCESS_OUT_BEGIN
+%token QUOTED_SUBSTITUTION_BEGIN
+%token HERE_STRING
+%token <word_un> HERE_DOC
 %token <string_un> WORD
 %token <string_un> ENV_VAR
+%token <string_un> QUOTED_WORD
+%token <string_un> QUOTED_ENV_VAR
 
 %left SEQUENTIAL
 %left PARALLEL
 %left CONDITIONAL_NZERO CONDITIONAL_ZERO
 %left PIPE
 
-%type <command_un> command
+%type <command_un> command group group_body function
+%type <params_un> for_words
 %type <exe_un> exe_name
 %type <params_un> params
 %type <redirect_un> redirect
 %type <simple_command_un> simple_command
-%type <word_un> word
+%type <word_un> word substitution
 
 %start command_tree
 
@@ -296,6 +423,14 @@ command:
 		$$ = new_command($1);
 	}
 
+	| group {
+		$$ = $1;
+	}
+
+	| function {
+		$$ = $1;
+	}
+
 	| command SEQUENTIAL command {
 		$$ = bind_commands($1, $3, OP_SEQUENTIAL);
 	}
@@ -318,6 +453,109 @@ command:
 
 	;
 
+group:
+
+	  group_body redirect {
+		$$ = bind_group_redirect($1, $2);
+	}
+
+	| group_body BLANK redirect {
+		$$ = bind_group_redirect($1, $3);
+	}
+
+	| BLANK group_body redirect {
+		$$ = bind_group_redirect($2, $3);
+	}
+
+	| BLANK group_body BLANK redirect {
+		$$ = bind_group_redirect($2, $4);
+	}
+
+	;
+
+group_body:
+
+	  GROUP_BEGIN command group_end {
+		$$ = bind_compound($2, NULL, OP_GROUP);
+	}
+
+	| SUBSHELL_BEGIN command subshell_end {
+		$$ = bind_compound($2, NULL, OP_SUBSHELL);
+	}
+
+	| FOR BLANK WORD BLANK IN for_words for_do command loop_done {
+		$$ = bind_for($3, $6, $8);
+	}
+
+	| WHILE command loop_do command loop_done {
+		$$ = bind_compound($2, $4, OP_WHILE);
+	}
+
+	;
+
+function:
+
+	  WORD SUBSHELL_BEGIN SUBSHELL_END group {
+		$$ = bind_function($1, $4);
+	}
+
+	| BLANK WORD SUBSHELL_BEGIN SUBSHELL_END group {
+		$$ = bind_function($2, $5);
+	}
+
+	;
+
+for_words:
+
+	  { /* empty */
+		$$ = NULL;
+	}
+
+	| for_words BLANK word {
+		$$ = add_word_to_list($3, $1);
+	}
+
+	;
+
+for_do:
+
+	  loop_do
+	| BLANK loop_do
+	;
+
+loop_do:
+
+	  SEQUENTIAL DO
+	| SEQUENTIAL BLANK DO
+	;
+
+loop_done:
+
+	  SEQUENTIAL DONE
+	| SEQUENTIAL BLANK DONE
+	;
+
+group_end:
+
+	  GROUP_END
+	| SEQUENTIAL GROUP_END
+	| SEQUENTIAL BLANK GROUP_END
+	;
+
+subshell_end:
+
+	  SUBSHELL_END
+	| SEQUENTIAL SUBSHELL_END
+	| SEQUENTIAL BLANK SUBSHELL_END
+	;
+
+substitution_end:
+
+	  SUBSTITUTION_END
+	| SEQUENTIAL SUBSTITUTION_END
+	| SEQUENTIAL BLANK SUBSTITUTION_END
+	;
+
 simple_command:
 
 	  exe_name BLANK params redirect {
@@ -401,6 +639,7 @@ redirect:
 
 	| redirect INDIRECT word {
 		$1.red_i = add_word_to_list($3, $1.red_i);
+		$1.red_flags &= ~IO_IN_HERE;
 		$$ = $1;
 	}
 
@@ -434,6 +673,7 @@ redirect:
 
 	| redirect INDIRECT word BLANK {
 		$1.red_i = add_word_to_list($3, $1.red_i);
+		$1.red_flags &= ~IO_IN_HERE;
 		$$ = $1;
 	}
 
@@ -467,6 +707,7 @@ redirect:
 
 	| redirect INDIRECT BLANK word {
 		$1.red_i = add_word_to_list($4, $1.red_i);
+		$1.red_flags &= ~IO_IN_HERE;
 		$$ = $1;
 	}
 	| redirect REDIRECT_OE BLANK word BLANK {
@@ -499,6 +740,49 @@ redirect:
 
 	| redirect INDIRECT BLANK word BLANK {
 		$1.red_i = add_word_to_list($4, $1.red_i);
+		$1.red_flags &= ~IO_IN_HERE;
+		$$ = $1;
+	}
+
+	| redirect HERE_DOC {
+		$1.red_i = add_word_to_list($2, $1.red_i);
+		$1.red_flags &= ~IO_IN_HERE;
+		$1.red_flags |= IO_IN_HEREDOC;
+		$$ = $1;
+	}
+
+	| redirect HERE_DOC BLANK {
+		$1.red_i = add_word_to_list($2, $1.red_i);
+		$1.red_flags &= ~IO_IN_HERE;
+		$1.red_flags |= IO_IN_HEREDOC;
+		$$ = $1;
+	}
+
+	| redirect HERE_STRING word {
+		$1.red_i = add_word_to_list($3, $1.red_i);
+		$1.red_flags &= ~IO_IN_HERE;
+		$1.red_flags |= IO_IN_HERESTRING;
+		$$ = $1;
+	}
+
+	| redirect HERE_STRING word BLANK {
+		$1.red_i = add_word_to_list($3, $1.red_i);
+		$1.red_flags &= ~IO_IN_HERE;
+		$1.red_flags |= IO_IN_HERESTRING;
+		$$ = $1;
+	}
+
+	| redirect HERE_STRING BLANK word {
+		$1.red_i = add_word_to_list($4, $1.red_i);
+		$1.red_flags &= ~IO_IN_HERE;
+		$1.red_flags |= IO_IN_HERESTRING;
+		$$ = $1;
+	}
+
+	| redirect HERE_STRING BLANK word BLANK {
+		$1.red_i = add_word_to_list($4, $1.red_i);
+		$1.red_flags &= ~IO_IN_HERE;
+		$1.red_flags |= IO_IN_HERESTRING;
 		$$ = $1;
 	}
 
@@ -514,6 +798,14 @@ word:
 		$$ = add_part_to_word(new_word($2, true), $1);
 	}
 
+	| word QUOTED_WORD {
+		$$ = add_part_to_word(new_quoted_word($2, false), $1);
+	}
+
+	| word QUOTED_ENV_VAR {
+		$$ = add_part_to_word(new_quoted_word($2, true), $1);
+	}
+
 	| WORD {
 		$$ = new_word($1, false);
 	}
@@ -522,10 +814,79 @@ word:
 		$$ = new_word($1, true);
 	}
 
+	| QUOTED_WORD {
+		$$ = new_quoted_word($1, false);
+	}
+
+	| QUOTED_ENV_VAR {
+		$$ = new_quoted_word($1, true);
+	}
+
+	| word substitution {
+		$$ = add_part_to_word($2, $1);
+	}
+
+	| substitution {
+		$$ = $1;
+	}
+
+	;
+
+substitution:
+
+	  SUBSTITUTION_BEGIN command substitution_end {
+		$$ = new_substitution($2, "");
+	}
+	| QUOTED_SUBSTITUTION_BEGIN command substitution_end {
+		$$ = new_substitution($2, "");
+		$$->quoted = true;
+	}
+	| PROCESS_IN_BEGIN command substitution_end {
+		$$ = new_substitution($2, "<");
+	}
+	| PROCESS_OUT_BEGIN command substitution_end {
+		$$ = new_substitution($2, ">");
+	}
+
 	;
 %%
 
 
+/*
+ * Parses the input the lexer was just given
+ */
+
+static bool parse_input(command_t ** root)
+{
+	command_root = NULL;
+
+	yylloc.first_line = yylloc.last_line = 1;
+	yylloc.first_column = yylloc.last_column = 0;
+
+	if (yyparse() != 0) {
+		/* yyparse failed */
+		return false;
+	}
+
+	*root = command_root;
+
+	return true;
+}
+
+
+static bool parse_started(command_t ** root)
+{
+	needsFree = true;
+
+	if (!parse_input(root))
+		return false;
+
+	flatBuildTree(command_root);
+
+	return true;
+}
+
+
 bool parse_line(const char * line, command_t ** root)
 {
 	if (*root != NULL) {
@@ -542,20 +903,94 @@ bool parse_line(const char * line, command_t ** root)
 
 	free_parse_memory();
 	globalParseAnotherString(line);
-	needsFree = true;
-	command_root = NULL;
 
-	yylloc.first_line = yylloc.last_line = 1;
-	yylloc.first_column = yylloc.last_column = 0;
+	return parse_started(root);
+}
 
-	if (yyparse() != 0) {
-		/* yyparse failed */
+
+bool parse_stream(parse_read_t read, void * opaque, command_t ** root)
+{
+	if (*root != NULL || read == NULL) {
+		/* see the comment in parser.h */
+		assert(false);
 		return false;
 	}
 
-	*root = command_root;
+	free_parse_memory();
+	globalParseAnotherStream(read, opaque);
 
-	return true;
+	return parse_started(root);
+}
+
+
+/*
+ * Lines of a context: the pointers allocated for them go to the list of
+ * the context, which replaces the one of free_parse_memory() meanwhile
+ */
+
+typedef struct {
+	GenericPointer * mem;
+	size_t count;
+	size_t size;
+} contextMemory;
+
+
+static void swapContextMemory(contextMemory * other)
+{
+	contextMemory current = { globalAllocMem, globalAllocCount, globalAllocSize };
+
+	globalAllocMem = other->mem;
+	globalAllocCount = other->count;
+	globalAllocSize = other->size;
+	*other = current;
+}
+
+
+static contextMemory * getContextMemory(parse_context_t * ctx)
+{
+	if (ctx->memory == NULL) {
+		ctx->memory = calloc(1, sizeof(contextMemory));
+		if (ctx->memory == NULL) {
+			fprintf(stderr, "calloc() failed\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return (contextMemory *)ctx->memory;
+}
+
+
+bool parserContextParse(parse_context_t * ctx, const char * line, command_t ** root)
+{
+	contextMemory * memory = getContextMemory(ctx);
+	bool ret;
+
+	swapContextMemory(memory);
+	parserInternReset();
+	globalParseAnotherString(line);
+
+	ret = parse_input(root);
+
+	globalEndParsing();
+	parserInternReset();
+	swapContextMemory(memory);
+
+	return ret;
+}
+
+
+void parserContextRelease(parse_context_t * ctx)
+{
+	contextMemory * memory = (contextMemory *)ctx->memory;
+
+	if (memory == NULL)
+		return;
+
+	while (memory->count != 0)
+		free(memory->mem[--memory->count]);
+	free((void *)memory->mem);
+	free(memory);
+	ctx->memory = NULL;
 }
 
 
@@ -563,6 +998,8 @@ void free_parse_memory()
 {
 	if (needsFree) {
 		globalEndParsing();
+		flatFreeTree();
+		parserInternReset();
 		while (globalAllocCount != 0) {
 			globalAllocCount--;
 			assert(globalAllocMem[globalAllocCount] != NULL);
@@ -583,5 +1020,5 @@ void free_parse_memory()
 
 void yyerror(const char* str)
 {
-	parse_error(str, yylloc.first_column);
+	parserError(str, yylloc.first_column);
 }